@@ -0,0 +1,58 @@
+#include "arena.h"
+
+// Set up an empty arena, blocks are only allocated on first use
+void arena_init(arena *a, size_t block_size) {
+    a->head = NULL;
+    a->tail = NULL;
+    a->block_size = block_size;
+    a->num_blocks = 0;
+    a->reserved = 0;
+}
+
+// Free every block, O(number of blocks)
+void arena_destroy(arena *a) {
+    if (!a) return;
+
+    arena_block *block = a->head;
+    while (block) {
+        arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena_init(a, a->block_size);
+}
+
+// Carve size bytes aligned to align (a power of two, at most 8) from the arena,
+// starting a new block when the current one cannot hold them.
+// Requests larger than a block get a block of their own.
+// return a pointer to the memory, or NULL on failure
+void* arena_alloc(arena *a, size_t size, size_t align) {
+    if (!a) return NULL;
+
+    arena_block *block = a->tail;
+    if (block) {
+        size_t offset = (block->used + align - 1) & ~(align - 1);
+        if (offset + size <= block->size) {
+            block->used = offset + size;
+            return block->data + offset;
+        }
+    }
+
+    size_t block_size = size > a->block_size ? size : a->block_size;
+    block = malloc(sizeof(arena_block) + block_size);
+    if (!block) return NULL;
+
+    // data follows three size_t-sized fields, so it is 8-byte aligned
+    block->next = NULL;
+    block->used = size;
+    block->size = block_size;
+    if (a->tail) {
+        a->tail->next = block;
+    } else {
+        a->head = block;
+    }
+    a->tail = block;
+    a->num_blocks++;
+    a->reserved += block_size;
+    return block->data;
+}
@@ -0,0 +1,36 @@
+#ifndef __arena_h__
+#define __arena_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "func_status.h"
+
+// One slab of an arena; allocations are carved from data front to back
+typedef struct arena_block_struct {
+    struct arena_block_struct *next;
+    size_t used;
+    size_t size;
+    char data[];
+} arena_block;
+
+// Bump allocator over a chain of large blocks.
+// Memory is never moved or freed individually: pointers stay valid until
+// arena_destroy, which frees one block at a time. Blocks are chained in
+// allocation order, so walking them from head revisits every allocation
+// in the order it was made.
+typedef struct arena_struct {
+    arena_block *head;      // first block
+    arena_block *tail;      // block currently carved from
+    size_t block_size;      // bytes per regular block
+    size_t num_blocks;
+    size_t reserved;        // bytes held in blocks, used or not
+} arena;
+
+// Function declarations
+void arena_init(arena *a, size_t block_size);
+void arena_destroy(arena *a);
+void* arena_alloc(arena *a, size_t size, size_t align);
+
+#endif // __arena_h__
@@ -0,0 +1,462 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
+
+#include "datetime_util.h"
+#include "datetime_simd.h"
+#include "hash_set.h"
+#include "key_set.h"
+#include "shared_key_set.h"
+#include "line_reader.h"
+
+/* Benchmark of the hot paths and of the whole program.
+    The first max_lines tokens of the input are loaded into memory, then
+    the parsers and the sets are timed on them (best of BENCH_REPEAT runs,
+    reported per call). The binary given with -b is then run on the whole
+    input once per configuration, with its output thrown away, and timed
+    end to end. Results are printed as one JSON object on stdout.
+*/
+
+#define BENCH_REPEAT        3
+#define BENCH_MAX_LINES     10000000
+#define BENCH_BATCH_KEYS    1024        // values per normalize_iso8601_key_batch call
+
+typedef struct bench_input_struct {
+    char *text;             // tokens, each NUL-terminated
+    size_t *offsets;        // start of each token in text
+    size_t count;
+    char (*norm)[DT_ISO8601_SIZE];       // normalized strings of the valid tokens
+    dt_key *keys;           // packed keys of the valid tokens
+    size_t valid;
+} bench_input;
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static long bench_peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Load up to max_lines tokens of the file, skipping blank lines
+// return RET_SUCCESS, or a negative status on failure
+static FunctionStatus bench_load(const char *path, size_t max_lines, bench_input *in) {
+    line_reader *reader = line_reader_open(path);
+    if (!reader) return NULL_INPUT_POINTER;
+
+    size_t text_capacity = 1 << 20;
+    size_t offset_capacity = 1 << 16;
+    size_t text_used = 0;
+    in->text = malloc(text_capacity);
+    in->offsets = malloc(offset_capacity * sizeof(size_t));
+    in->count = 0;
+
+    const char *line;
+    size_t line_len;
+    FunctionStatus rstat = RET_SUCCESS;
+    while (in->text && in->offsets && in->count < max_lines &&
+           line_reader_next(reader, &line, &line_len) == TRUE_STATUS) {
+        size_t len;
+        const char *token = dt_line_token(line, line_len, &len);
+        if (len == 0) continue;
+
+        if (text_used + len + 1 > text_capacity) {
+            while (text_used + len + 1 > text_capacity) text_capacity *= 2;
+            char *text = realloc(in->text, text_capacity);
+            if (!text) break;
+            in->text = text;
+        }
+        if (in->count == offset_capacity) {
+            size_t *offsets = realloc(in->offsets, offset_capacity * 2 * sizeof(size_t));
+            if (!offsets) break;
+            in->offsets = offsets;
+            offset_capacity *= 2;
+        }
+        in->offsets[in->count++] = text_used;
+        memcpy(in->text + text_used, token, len);
+        in->text[text_used + len] = '\0';
+        text_used += len + 1;
+    }
+    line_reader_close(reader);
+
+    in->norm = malloc((in->count ? in->count : 1) * sizeof(*in->norm));
+    in->keys = malloc((in->count ? in->count : 1) * sizeof(dt_key));
+    if (!in->text || !in->offsets || !in->norm || !in->keys) rstat = MEMORY_ALLOCATION_ERR;
+    return rstat;
+}
+
+static void bench_free(bench_input *in) {
+    free(in->text);
+    free(in->offsets);
+    free(in->norm);
+    free(in->keys);
+}
+
+static void bench_print_micro(const char *name, size_t ops, double seconds, int last) {
+    printf("    {\"name\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.2f}%s\n", name, ops,
+           ops ? seconds * 1e9 / (double)ops : 0.0, last ? "" : ",");
+}
+
+// Time normalize_iso8601 over every token, keeping the valid results
+static double bench_normalize(bench_input *in) {
+    double best = 0;
+    for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+        size_t valid = 0;
+        double start = bench_now();
+        for (size_t i = 0; i < in->count; i++) {
+            if (normalize_iso8601(in->text + in->offsets[i], in->norm[valid]) == RET_SUCCESS) {
+                valid++;
+            }
+        }
+        double elapsed = bench_now() - start;
+        if (rep == 0 || elapsed < best) best = elapsed;
+        in->valid = valid;
+    }
+    return best;
+}
+
+static double bench_normalize_key(bench_input *in) {
+    double best = 0;
+    for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+        size_t valid = 0;
+        double start = bench_now();
+        for (size_t i = 0; i < in->count; i++) {
+            if (normalize_iso8601_key(in->text + in->offsets[i], &in->keys[valid]) == RET_SUCCESS) {
+                valid++;
+            }
+        }
+        double elapsed = bench_now() - start;
+        if (rep == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// Time normalize_iso8601_key_batch over the tokens as one newline-separated
+// buffer, BENCH_BATCH_KEYS values per call; *valid receives the number
+// of values that parsed, to be checked against the single value calls
+// return the best time, or -1 on failure
+static double bench_normalize_key_batch(bench_input *in, size_t *valid) {
+    size_t len = in->count ? in->offsets[in->count - 1] + strlen(in->text + in->offsets[in->count - 1]) + 1 : 0;
+    char *buffer = malloc(len ? len : 1);
+    if (!buffer) return -1;
+    for (size_t i = 0; i < len; i++) {
+        buffer[i] = in->text[i] ? in->text[i] : '\n';
+    }
+
+    dt_key keys[BENCH_BATCH_KEYS];
+    FunctionStatus status[BENCH_BATCH_KEYS];
+    double best = 0;
+    for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+        *valid = 0;
+        size_t pos = 0;
+        double start = bench_now();
+        while (pos < len) {
+            size_t consumed;
+            size_t n = normalize_iso8601_key_batch(buffer + pos, len - pos, keys, status,
+                                                   BENCH_BATCH_KEYS, &consumed);
+            for (size_t i = 0; i < n; i++) {
+                if (status[i] == RET_SUCCESS) (*valid)++;
+            }
+            pos += consumed;
+            if (n == 0) break;
+        }
+        double elapsed = bench_now() - start;
+        if (rep == 0 || elapsed < best) best = elapsed;
+    }
+    free(buffer);
+    return best;
+}
+
+// Time inserting every valid value, duplicates included, into a fresh set,
+// one call per value or through the batch call
+static double bench_hash_set_insert(bench_input *in, size_t *unique, int batch) {
+    const char **values = NULL;
+    if (batch) {
+        values = malloc((in->valid ? in->valid : 1) * sizeof(*values));
+        if (!values) return -1;
+        for (size_t i = 0; i < in->valid; i++) values[i] = in->norm[i];
+    }
+
+    double best = 0;
+    for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+        hash_set *set = hash_set_create();
+        if (!set) {
+            free(values);
+            return -1;
+        }
+        double start = bench_now();
+        if (batch) {
+            hash_set_insert_batch(set, values, NULL, in->valid, NULL);
+        } else {
+            for (size_t i = 0; i < in->valid; i++) {
+                hash_set_insert(set, in->norm[i]);
+            }
+        }
+        double elapsed = bench_now() - start;
+        if (rep == 0 || elapsed < best) best = elapsed;
+        *unique = hash_set_get_size(set);
+        hash_set_destroy(set);
+    }
+    free(values);
+    return best;
+}
+
+static double bench_key_set_insert(bench_input *in, int batch) {
+    double best = 0;
+    for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+        key_set *set = key_set_create();
+        if (!set) return -1;
+        double start = bench_now();
+        if (batch) {
+            key_set_insert_batch(set, in->keys, in->valid, NULL);
+        } else {
+            for (size_t i = 0; i < in->valid; i++) {
+                key_set_insert(set, in->keys[i]);
+            }
+        }
+        double elapsed = bench_now() - start;
+        if (rep == 0 || elapsed < best) best = elapsed;
+        key_set_destroy(set);
+    }
+    return best;
+}
+
+// One thread's slice of the keys for the shared set
+typedef struct bench_shared_slice_struct {
+    shared_key_set *set;
+    const dt_key *keys;
+    size_t count;
+    size_t inserted;        // inserts told the key was new
+} bench_shared_slice;
+
+static void* bench_shared_insert_main(void *arg) {
+    bench_shared_slice *slice = arg;
+    for (size_t i = 0; i < slice->count; i++) {
+        if (shared_key_set_insert(slice->set, slice->keys[i]) == TRUE_STATUS) slice->inserted++;
+    }
+    return NULL;
+}
+
+// Time inserting every valid key into one shared set, the keys split
+// into contiguous slices over threads. Every run must end up with unique
+// keys, told new exactly once each.
+// return the best time, or -1 on failure or a wrong count
+static double bench_shared_key_set_insert(bench_input *in, int threads, size_t unique) {
+    pthread_t thread[threads];
+    bench_shared_slice slice[threads];
+    double best = 0;
+    for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+        shared_key_set *set = shared_key_set_create();
+        if (!set) return -1;
+        double start = bench_now();
+        int started = 0;
+        for (; started < threads; started++) {
+            size_t first = in->valid * (size_t)started / (size_t)threads;
+            size_t last = in->valid * (size_t)(started + 1) / (size_t)threads;
+            slice[started] = (bench_shared_slice){ set, in->keys + first, last - first, 0 };
+            if (threads == 1) {
+                bench_shared_insert_main(&slice[0]);
+            } else if (pthread_create(&thread[started], NULL, bench_shared_insert_main, &slice[started]) != 0) {
+                break;
+            }
+        }
+        size_t inserted = 0;
+        for (int t = 0; t < started; t++) {
+            if (threads > 1) pthread_join(thread[t], NULL);
+            inserted += slice[t].inserted;
+        }
+        double elapsed = bench_now() - start;
+        if (rep == 0 || elapsed < best) best = elapsed;
+        int ok = started == threads && inserted == unique && shared_key_set_get_size(set) == unique;
+        shared_key_set_destroy(set);
+        if (!ok) {
+            fprintf(stderr, "Error: shared_key_set on %d threads counted %zu new keys of %zu\n",
+                    threads, inserted, unique);
+            return -1;
+        }
+    }
+    return best;
+}
+
+// Run binary with the given extra options on input, output discarded
+// return the wall time in seconds; *rss_kb and *exit_status describe the run
+static double bench_binary(const char *binary, const char *options, const char *input,
+                           long *rss_kb, int *exit_status) {
+    char *argv[8];
+    int argc = 0;
+    char *copy = strdup(options);
+    argv[argc++] = (char *)binary;
+    for (char *arg = strtok(copy, " "); arg && argc < 5; arg = strtok(NULL, " ")) {
+        argv[argc++] = arg;
+    }
+    argv[argc++] = (char *)input;
+    argv[argc++] = "/dev/null";
+    argv[argc] = NULL;
+
+    double start = bench_now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        // the program logs every invalid line, keep that out of the timing
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+        execv(binary, argv);
+        _exit(127);
+    }
+
+    int status = -1;
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    if (pid > 0) wait4(pid, &status, 0, &usage);
+    double elapsed = bench_now() - start;
+    free(copy);
+
+    *rss_kb = usage.ru_maxrss;
+    *exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return elapsed;
+}
+
+static void bench_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n max_lines] [-b binary] [-j threads] <input_file>\n", prog);
+    fprintf(stderr, "       %s -t     run the self tests of the library\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_lines = BENCH_MAX_LINES;
+    const char *binary = NULL;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:b:j:t")) != -1) {
+        switch (opt) {
+        case 't': {
+            int failed = 0;
+            printf("Running ISO 8601 Validator Tests:\n");
+            failed += test_validator();
+            printf("\nRunning ISO 8601 Normalizer Tests:\n");
+            failed += test_normalizer();
+            printf("\nRunning ISO 8601 Packed Key Tests:\n");
+            failed += test_packed_key();
+            printf("\nRunning ISO 8601 Key Batch Tests:\n");
+            failed += test_key_batch();
+            printf("\nRunning Shared Key Set Tests:\n");
+            failed += test_shared_key_set();
+            if (failed) printf("\n%d tests failed\n", failed);
+            return failed ? 1 : 0;
+        }
+        case 'n': max_lines = strtoull(optarg, NULL, 10); break;
+        case 'b': binary = optarg; break;
+        case 'j': threads = atoi(optarg); break;
+        default:
+            bench_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+    const char *path = argv[optind];
+    if (threads < 2) threads = 2;
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Error: Cannot open input file '%s'\n", path);
+        return 1;
+    }
+
+    bench_input in;
+    if (bench_load(path, max_lines, &in) != RET_SUCCESS) {
+        fprintf(stderr, "Error: Cannot load input file '%s'\n", path);
+        bench_free(&in);
+        return 1;
+    }
+
+    double t_norm = bench_normalize(&in);
+    double t_key = bench_normalize_key(&in);
+    size_t batch_valid = 0;
+    double t_key_batch = bench_normalize_key_batch(&in, &batch_valid);
+    if (t_key_batch < 0 || batch_valid != in.valid) {
+        fprintf(stderr, "Error: normalize_iso8601_key_batch parsed %zu valid values, expected %zu\n",
+                batch_valid, in.valid);
+        bench_free(&in);
+        return 1;
+    }
+    size_t unique = 0;
+    double t_hset = bench_hash_set_insert(&in, &unique, 0);
+    double t_hset_batch = bench_hash_set_insert(&in, &unique, 1);
+    double t_kset = bench_key_set_insert(&in, 0);
+    double t_kset_batch = bench_key_set_insert(&in, 1);
+    size_t packed_unique = 0;
+    key_set *distinct = key_set_create();
+    if (distinct && key_set_insert_batch(distinct, in.keys, in.valid, NULL) == RET_SUCCESS) {
+        packed_unique = key_set_get_size(distinct);
+    }
+    key_set_destroy(distinct);
+    double t_sset = bench_shared_key_set_insert(&in, 1, packed_unique);
+    double t_sset_mt = bench_shared_key_set_insert(&in, threads, packed_unique);
+
+    printf("{\n");
+    printf("  \"input\": \"%s\",\n", path);
+    printf("  \"input_bytes\": %lld,\n", (long long)st.st_size);
+    printf("  \"micro_lines\": %zu,\n", in.count);
+    printf("  \"micro_valid\": %zu,\n", in.valid);
+    printf("  \"micro_unique\": %zu,\n", unique);
+    printf("  \"parse_kernel\": \"%s\",\n", dt_parse_prefix_kernel());
+    printf("  \"micro\": [\n");
+    bench_print_micro("normalize_iso8601", in.count, t_norm, 0);
+    bench_print_micro("normalize_iso8601_key", in.count, t_key, 0);
+    bench_print_micro("normalize_iso8601_key_batch", in.count, t_key_batch, 0);
+    bench_print_micro("hash_set_insert", in.valid, t_hset, 0);
+    bench_print_micro("hash_set_insert_batch", in.valid, t_hset_batch, 0);
+    bench_print_micro("key_set_insert", in.valid, t_kset, 0);
+    bench_print_micro("key_set_insert_batch", in.valid, t_kset_batch, 0);
+    bench_print_micro("shared_key_set_insert", in.valid, t_sset, 0);
+    printf("    {\"name\": \"shared_key_set_insert\", \"threads\": %d, \"ops\": %zu, \"ns_per_op\": %.2f}\n",
+           threads, in.valid, in.valid ? t_sset_mt * 1e9 / (double)in.valid : 0.0);
+    printf("  ],\n");
+    printf("  \"micro_peak_rss_kb\": %ld", bench_peak_rss_kb());
+    bench_free(&in);
+
+    if (binary) {
+        char jobs[32];
+        char packed_jobs[40];
+        snprintf(jobs, sizeof(jobs), "-j %d", threads);
+        snprintf(packed_jobs, sizeof(packed_jobs), "-p -j %d", threads);
+        const char *runs[] = { "", "-p", jobs, packed_jobs };
+        size_t num_runs = sizeof(runs) / sizeof(runs[0]);
+        double input_mb = (double)st.st_size / (1 << 20);
+
+        long rss_kb;
+        int exit_status;
+        fflush(stdout);
+
+        // the page cache gets the file first, so every run reads it from memory
+        bench_binary(binary, "-p", path, &rss_kb, &exit_status);
+        printf(",\n  \"binary\": [\n");
+        for (size_t i = 0; i < num_runs; i++) {
+            double elapsed = bench_binary(binary, runs[i], path, &rss_kb, &exit_status);
+            printf("    {\"args\": \"%s\", \"seconds\": %.3f, \"mb_per_s\": %.1f, "
+                   "\"peak_rss_kb\": %ld, \"exit_status\": %d}%s\n",
+                   runs[i], elapsed, elapsed > 0 ? input_mb / elapsed : 0.0, rss_kb,
+                   exit_status, i + 1 == num_runs ? "" : ",");
+            fflush(stdout);
+        }
+        printf("  ]");
+    }
+    printf("\n}\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+
+#include "key_blocks.h"
+#include "datetime_util.h"
+
+/* Decoder for the key block files written by datetime_unique --binary.
+    Writes the values back as normalized ISO 8601 lines, all of them or
+    those from -f up to and including -t. A range starts at the block the
+    index gives for its first value, so the blocks before it are never
+    touched.
+*/
+
+#define DECODE_WRITE_BUFFER (1 << 16)   // bytes of text per write
+
+static void decode_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-f FROM] [-t TO] <key_block_file> [<output_file>]\n", prog);
+    fprintf(stderr, "  -f FROM   start at the first value at or after datetime FROM\n");
+    fprintf(stderr, "  -t TO     stop after the last value at or before datetime TO\n");
+    fprintf(stderr, "  -c        only print the number of values in the range\n");
+    fprintf(stderr, "  the output defaults to stdout\n");
+}
+
+// Parse a range bound given as any datetime normalize_iso8601_key accepts
+// return 1, or 0 after reporting an invalid value
+static int decode_bound(const char *text, const char *name, dt_key *key) {
+    if (normalize_iso8601_key(text, key) == RET_SUCCESS) return 1;
+    fprintf(stderr, "Error: %s expects a datetime such as 2024-01-01T00:00:00Z\n", name);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    dt_key from = 0;
+    dt_key to = UINT64_MAX;
+    int count_only = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:t:c")) != -1) {
+        switch (opt) {
+        case 'f':
+            if (!decode_bound(optarg, "-f", &from)) return 1;
+            break;
+        case 't':
+            if (!decode_bound(optarg, "-t", &to)) return 1;
+            break;
+        case 'c':
+            count_only = 1;
+            break;
+        default:
+            decode_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind < 1 || argc - optind > 2) {
+        decode_usage(argv[0]);
+        return 1;
+    }
+
+    key_blocks *blocks = key_blocks_open(argv[optind]);
+    if (!blocks) {
+        fprintf(stderr, "Error: '%s' is not a readable key block file\n", argv[optind]);
+        return 1;
+    }
+    dt_key *keys = malloc(blocks->block_keys * sizeof(dt_key));
+    if (!keys) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        key_blocks_close(blocks);
+        return 1;
+    }
+    const char *out_path = optind + 1 < argc ? argv[optind + 1] : "-";
+    FILE *out = optind + 1 < argc ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Error: Cannot create output file '%s'\n", out_path);
+        free(keys);
+        key_blocks_close(blocks);
+        return 1;
+    }
+
+    char buffer[DECODE_WRITE_BUFFER];
+    size_t total = 0;
+    FunctionStatus rstat = RET_SUCCESS;
+    int done = 0;
+    int write_failed = 0;
+    for (size_t b = key_blocks_find(blocks, from); b < blocks->block_count && !done && !write_failed; b++) {
+        size_t count;
+        rstat = key_blocks_read_block(blocks, b, keys, &count);
+        if (rstat != RET_SUCCESS) break;
+
+        size_t first = 0;
+        while (first < count && keys[first] < from) first++;
+        size_t last = first;
+        while (last < count && keys[last] <= to) last++;
+        done = last < count;
+        total += last - first;
+        for (size_t i = first; i < last && !count_only && !write_failed;) {
+            size_t written;
+            i += dt_key_format_batch(keys + i, last - i, buffer, sizeof(buffer), &written);
+            if (fwrite(buffer, 1, written, out) != written) write_failed = 1;
+        }
+    }
+    if (count_only && rstat == RET_SUCCESS) fprintf(out, "%zu\n", total);
+
+    free(keys);
+    key_blocks_close(blocks);
+    // write errors stick to out; stdout is flushed, a file closed, and
+    // either way a failure fails the run instead of truncating the output
+    if (fflush(out) != 0 || ferror(out)) write_failed = 1;
+    if (out != stdout && fclose(out) != 0) write_failed = 1;
+    if (rstat != RET_SUCCESS) {
+        fprintf(stderr, "Error: Damaged block in '%s' (error code: %d)\n", argv[optind], rstat);
+        return 1;
+    }
+    if (write_failed) {
+        fprintf(stderr, "Error: Cannot write output '%s'\n", out_path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "datetime_simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DT_HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// Template of the fixed prefix, 'd' marks a digit position
+static const char dt_template[19] = {
+    'd','d','d','d','-','d','d','-','d','d','T','d','d',':','d','d',':','d','d'
+};
+
+// Byte 10 separates date and time, 'T' or a space
+#define DT_DATE_TIME_SEP    10
+
+// Range check shared by all kernels, one branch for all six fields
+static inline int dt_prefix_in_range(const dt_fields* dt) {
+    return ((unsigned)(dt->month - 1) < 12) & ((unsigned)(dt->day - 1) < 31) &
+           ((unsigned)dt->hour < 24) & ((unsigned)dt->minute < 60) &
+           ((unsigned)dt->second < 60);
+}
+
+// Portable kernel: accumulate mismatches over the template without
+// branching per byte, then convert the digit pairs
+static int dt_parse_prefix_scalar(const char* datetime, size_t readable, dt_fields* dt) {
+    (void)readable;
+    const unsigned char* p = (const unsigned char*)datetime;
+
+    unsigned bad = 0;
+    for (int i = 0; i < 19; i++) {
+        if (dt_template[i] == 'd') {
+            bad |= (unsigned)(p[i] - '0') > 9;
+        } else if (i != DT_DATE_TIME_SEP) {
+            bad |= p[i] != (unsigned char)dt_template[i];
+        }
+    }
+    bad |= (p[DT_DATE_TIME_SEP] != 'T') & (p[DT_DATE_TIME_SEP] != ' ');
+    if (bad) return 0;
+
+    dt->year   = (p[0] - '0') * 1000 + (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+    dt->month  = (p[5] - '0') * 10 + (p[6] - '0');
+    dt->day    = (p[8] - '0') * 10 + (p[9] - '0');
+    dt->hour   = (p[11] - '0') * 10 + (p[12] - '0');
+    dt->minute = (p[14] - '0') * 10 + (p[15] - '0');
+    dt->second = (p[17] - '0') * 10 + (p[18] - '0');
+    return dt_prefix_in_range(dt);
+}
+
+#ifdef DT_HAVE_X86_KERNELS
+
+// Turn 16 digit bytes (already minus '0') laid out as
+// Y Y Y Y M M D D h h m m s s 0 0 into the six fields.
+// maddubs folds each pair into tens * 10 + ones in one instruction,
+// then all field ranges are checked with two 16-bit compares.
+__attribute__((target("sse4.2")))
+static inline int dt_prefix_convert(__m128i digits, dt_fields* dt) {
+    const __m128i weights = _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1,
+                                          10, 1, 10, 1, 10, 1, 10, 1);
+    const __m128i max_values = _mm_setr_epi16(99, 99, 12, 31, 23, 59, 59, 0);
+    const __m128i min_values = _mm_setr_epi16(0, 0, 1, 1, 0, 0, 0, 0);
+
+    __m128i pairs = _mm_maddubs_epi16(digits, weights);
+    __m128i out_of_range = _mm_or_si128(_mm_cmpgt_epi16(pairs, max_values),
+                                        _mm_cmpgt_epi16(min_values, pairs));
+    if (_mm_movemask_epi8(out_of_range)) return 0;
+
+    uint16_t fields[8];
+    _mm_storeu_si128((__m128i*)fields, pairs);
+    dt->year   = (int16_t)(fields[0] * 100 + fields[1]);
+    dt->month  = (int8_t)fields[2];
+    dt->day    = (int8_t)fields[3];
+    dt->hour   = (int8_t)fields[4];
+    dt->minute = (int8_t)fields[5];
+    dt->second = (int8_t)fields[6];
+    return 1;
+}
+
+// Compare 16 bytes against the template: digit lanes must be 0..9 after
+// subtracting '0', separator lanes must equal the template byte or its
+// alternative (the same byte except ' ' for the T)
+__attribute__((target("sse4.2")))
+static inline int dt_template_match_16(__m128i digits, __m128i raw, __m128i digit_lanes,
+                                       __m128i separators, __m128i alt_separators) {
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+    __m128i is_sep = _mm_or_si128(_mm_cmpeq_epi8(raw, separators),
+                                  _mm_cmpeq_epi8(raw, alt_separators));
+    __m128i ok = _mm_blendv_epi8(is_sep, is_digit, digit_lanes);
+    return _mm_movemask_epi8(ok) == 0xFFFF;
+}
+
+// SSE4.2 kernel: two overlapping 16-byte loads at offsets 0 and 3 cover
+// exactly the 19 prefix bytes, so nothing past the prefix is ever read
+__attribute__((target("sse4.2")))
+static int dt_parse_prefix_sse42(const char* datetime, size_t readable, dt_fields* dt) {
+    (void)readable;
+    const __m128i zero_char = _mm_set1_epi8('0');
+    // bytes 0..15
+    const __m128i digit_lanes_lo = _mm_setr_epi8(-1, -1, -1, -1, 0, -1, -1, 0,
+                                                 -1, -1, 0, -1, -1, 0, -1, -1);
+    const __m128i separators_lo = _mm_setr_epi8(0, 0, 0, 0, '-', 0, 0, '-',
+                                                0, 0, 'T', 0, 0, ':', 0, 0);
+    const __m128i alt_separators_lo = _mm_setr_epi8(0, 0, 0, 0, '-', 0, 0, '-',
+                                                    0, 0, ' ', 0, 0, ':', 0, 0);
+    // bytes 3..18
+    const __m128i digit_lanes_hi = _mm_setr_epi8(-1, 0, -1, -1, 0, -1, -1, 0,
+                                                 -1, -1, 0, -1, -1, 0, -1, -1);
+    const __m128i separators_hi = _mm_setr_epi8(0, '-', 0, 0, '-', 0, 0, 'T',
+                                                0, 0, ':', 0, 0, ':', 0, 0);
+    const __m128i alt_separators_hi = _mm_setr_epi8(0, '-', 0, 0, '-', 0, 0, ' ',
+                                                    0, 0, ':', 0, 0, ':', 0, 0);
+
+    __m128i raw_lo = _mm_loadu_si128((const __m128i*)datetime);
+    __m128i raw_hi = _mm_loadu_si128((const __m128i*)(datetime + 3));
+    __m128i digits_lo = _mm_sub_epi8(raw_lo, zero_char);
+    __m128i digits_hi = _mm_sub_epi8(raw_hi, zero_char);
+
+    if (!dt_template_match_16(digits_lo, raw_lo, digit_lanes_lo, separators_lo, alt_separators_lo) ||
+        !dt_template_match_16(digits_hi, raw_hi, digit_lanes_hi, separators_hi, alt_separators_hi)) {
+        return 0;
+    }
+
+    // gather Y Y Y Y M M D D h h m m from the low load, s s from the high one
+    __m128i gathered_lo = _mm_shuffle_epi8(digits_lo,
+        _mm_setr_epi8(0, 1, 2, 3, 5, 6, 8, 9, 11, 12, 14, 15, -1, -1, -1, -1));
+    __m128i gathered_hi = _mm_shuffle_epi8(digits_hi,
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 14, 15, -1, -1));
+    return dt_prefix_convert(_mm_or_si128(gathered_lo, gathered_hi), dt);
+}
+
+// AVX2 kernel: the whole prefix is checked with one 32-byte compare.
+// The load reaches past the prefix, so it is only issued when the caller
+// vouches for 32 readable bytes; shorter views, such as a lone
+// NUL-terminated value, go to the SSE4.2 kernel, which loads exactly the
+// 19 prefix bytes.
+__attribute__((target("avx2")))
+static int dt_parse_prefix_avx2(const char* datetime, size_t readable, dt_fields* dt) {
+    if (readable < 32) {
+        return dt_parse_prefix_sse42(datetime, readable, dt);
+    }
+
+    const __m256i zero_char = _mm256_set1_epi8('0');
+    const __m256i digit_lanes = _mm256_setr_epi8(
+        -1, -1, -1, -1, 0, -1, -1, 0, -1, -1, 0, -1, -1, 0, -1, -1,
+        0, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i separators = _mm256_setr_epi8(
+        0, 0, 0, 0, '-', 0, 0, '-', 0, 0, 'T', 0, 0, ':', 0, 0,
+        ':', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i alt_separators = _mm256_setr_epi8(
+        0, 0, 0, 0, '-', 0, 0, '-', 0, 0, ' ', 0, 0, ':', 0, 0,
+        ':', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    __m256i raw = _mm256_loadu_si256((const __m256i*)datetime);
+    __m256i digits = _mm256_sub_epi8(raw, zero_char);
+
+    __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digits, _mm256_set1_epi8(9)), digits);
+    __m256i is_sep = _mm256_or_si256(_mm256_cmpeq_epi8(raw, separators),
+                                     _mm256_cmpeq_epi8(raw, alt_separators));
+    __m256i ok = _mm256_blendv_epi8(is_sep, is_digit, digit_lanes);
+    // only the 19 prefix lanes matter
+    if (((unsigned)_mm256_movemask_epi8(ok) & 0x7FFFFu) != 0x7FFFFu) return 0;
+
+    __m128i gathered_lo = _mm_shuffle_epi8(_mm256_castsi256_si128(digits),
+        _mm_setr_epi8(0, 1, 2, 3, 5, 6, 8, 9, 11, 12, 14, 15, -1, -1, -1, -1));
+    __m128i gathered_hi = _mm_shuffle_epi8(_mm256_extracti128_si256(digits, 1),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 2, -1, -1));
+    return dt_prefix_convert(_mm_or_si128(gathered_lo, gathered_hi), dt);
+}
+
+#endif // DT_HAVE_X86_KERNELS
+
+typedef int (*dt_prefix_fn)(const char*, size_t, dt_fields*);
+
+static int dt_parse_prefix_resolve(const char* datetime, size_t readable, dt_fields* dt);
+
+static dt_prefix_fn dt_prefix_impl = dt_parse_prefix_resolve;
+static const char* dt_prefix_impl_name = "scalar";
+
+// Pick the widest kernel the CPU supports on first use.
+// DATETIME_SIMD=scalar|sse4.2|avx2 caps the choice, for benchmarking.
+// Concurrent first calls may all resolve; they store the same pointer,
+// and the relaxed atomics keep that well-defined.
+static int dt_parse_prefix_resolve(const char* datetime, size_t readable, dt_fields* dt) {
+    dt_prefix_fn impl = dt_parse_prefix_scalar;
+    const char* name = "scalar";
+
+#ifdef DT_HAVE_X86_KERNELS
+    const char* cap = getenv("DATETIME_SIMD");
+    int allow_sse42 = !cap || strcmp(cap, "scalar") != 0;
+    int allow_avx2 = allow_sse42 && (!cap || strcmp(cap, "sse4.2") != 0);
+
+    __builtin_cpu_init();
+    if (allow_avx2 && __builtin_cpu_supports("avx2")) {
+        impl = dt_parse_prefix_avx2;
+        name = "avx2";
+    } else if (allow_sse42 && __builtin_cpu_supports("sse4.2")) {
+        impl = dt_parse_prefix_sse42;
+        name = "sse4.2";
+    }
+#endif
+
+    __atomic_store_n(&dt_prefix_impl_name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&dt_prefix_impl, impl, __ATOMIC_RELAXED);
+    return impl(datetime, readable, dt);
+}
+
+int dt_parse_prefix(const char* datetime, size_t readable, dt_fields* dt) {
+    return __atomic_load_n(&dt_prefix_impl, __ATOMIC_RELAXED)(datetime, readable, dt);
+}
+
+const char* dt_parse_prefix_kernel(void) {
+    if (__atomic_load_n(&dt_prefix_impl, __ATOMIC_RELAXED) == dt_parse_prefix_resolve) {
+        dt_fields dt;
+        dt_parse_prefix_resolve("0000-01-01T00:00:00", 19, &dt);
+    }
+    return __atomic_load_n(&dt_prefix_impl_name, __ATOMIC_RELAXED);
+}
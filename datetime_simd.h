@@ -0,0 +1,44 @@
+#ifndef __datetime_simd_h__
+#define __datetime_simd_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+
+// Timezone designator found by the parser
+#define DT_TZ_LOCAL     0
+#define DT_TZ_UTC       1
+#define DT_TZ_OFFSET    2
+
+// Broken-down fields of a parsed datetime string
+typedef struct dt_fields_struct {
+    int16_t year;
+    int8_t  month;
+    int8_t  day;
+    int8_t  hour;
+    int8_t  minute;
+    int8_t  second;
+    int8_t  tz;         // DT_TZ_LOCAL, DT_TZ_UTC or DT_TZ_OFFSET
+    int16_t tz_offset;  // minutes east of UTC, only for DT_TZ_OFFSET
+    int32_t nanosecond; // fraction of the second, 0 when there is none
+} dt_fields;
+
+/* Fast check of the fixed 19-byte "YYYY-MM-DDThh:mm:ss" prefix
+    (a space may stand for the T).
+    datetime must hold at least 19 bytes; readable is how many bytes
+    from datetime may be loaded (>= 19), which lets wide kernels skip the
+    copy into a padded buffer when the caller knows more data follows.
+    return 1 and fill year..second when every byte matches the template
+    and every field is in range, otherwise 0. On 0 the caller runs the
+    byte-by-byte parser to find the exact FunctionStatus, so the kernels
+    never have to rank errors themselves.
+*/
+int dt_parse_prefix(const char* datetime, size_t readable, dt_fields* dt);
+
+// Name of the kernel picked at runtime: "avx2", "sse4.2" or "scalar"
+const char* dt_parse_prefix_kernel(void);
+
+#endif // __datetime_simd_h__
@@ -2,115 +2,132 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-#include <ctype.h>
 
 #include "datetime_util.h"
+#include "datetime_simd.h"
+
+// Locale-independent digit test, unlike isdigit
+#define IS_DIGIT(c)     ((unsigned)((c) - '0') < 10)
+// Whitespace as isspace sees it in the "C" locale
+#define IS_SPACE(c)     ((c) == ' ' || (unsigned)((c) - '\t') < 5)
+
+// Days in each month of a common year and of a leap year, [0] unused
+static const uint8_t dt_month_days[2][13] = {
+    { 0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 },
+    { 0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 }
+};
+
+// Days of a common year before the first of each month, [0] unused
+static const uint16_t dt_days_before_month[13] = {
+    0, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+
+// Proleptic Gregorian leap year, 0000 included. For multiples of 4,
+// "not divisible by 100" is "not by 25" and "divisible by 400" is "by 16".
+static inline int dt_is_leap(int32_t year)
+{
+    return ((year & 3) == 0) & ((year % 25 != 0) | ((year & 15) == 0));
+}
 
 /* Function to validate following ISO 8601 formats:
     YYYY-MM-DDThh:mm:ss
     YYYY-MM-DDThh:mm:ssZ
     YYYY-MM-DDThh:mm:ss+hh:mm
     YYYY-MM-DDThh:mm:ss-hh:mm
+    with a space allowed for the T, a fraction of the second
+    (.f to .fffffffff, or with a comma), a lowercase z, and offsets
+    written without the colon (+hhmm / -hhmm)
     */
 
+// Scale of a fraction with n digits to nanoseconds
+static const int32_t dt_fraction_scale[10] = {
+    1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1
+};
 
-FunctionStatus validate_iso8601(const char* datetime)
+// Parse what follows the 19-byte prefix: an optional fraction of the
+// second ('.' or ',' and 1 to 9 digits), then the timezone designator:
+// nothing, 'Z' / 'z', +hh:mm / -hh:mm or +hhmm / -hhmm
+static inline FunctionStatus parse_iso8601_tz(const char* datetime, size_t dtstr_len, dt_fields* dt)
 {
-    // check string length
-    size_t dtstr_len = strlen(datetime);
-    if (dtstr_len < 19) return DT_ERR_TOO_SHORT;
-    
-    // Check YYYY (year)
-    for (int i = 0; i < 4; i++) {
-        if (!isdigit(datetime[i])) return DT_ERR_WRONG_YEAR;
+    dt->nanosecond = 0;
+
+    // the bulk of the input, settled before looking for the rarer forms
+    if (dtstr_len == 20 && datetime[19] == 'Z') {
+        dt->tz = DT_TZ_UTC;
+        return RET_SUCCESS;
     }
-    
-    // Check first dash
-    if (datetime[4] != '-') return DT_ERR_WRONG_SEPARATOR;
-    
-    // Check MM (month)
-    if (!isdigit(datetime[5]) || !isdigit(datetime[6])) return DT_ERR_WRONG_MONTH;
-    uint8_t month = (datetime[5] - '0') * 10 + (datetime[6] - '0');
-    if (month < 1 || month > 12) return DT_ERR_WRONG_MONTH;
-    
-    // Check second dash
-    if (datetime[7] != '-') return DT_ERR_WRONG_SEPARATOR;
-    
-    // Check DD (day)
-    if (!isdigit(datetime[8]) || !isdigit(datetime[9])) return DT_ERR_WRONG_DAY;
-    uint8_t day = (datetime[8] - '0') * 10 + (datetime[9] - '0');
-    if (day < 1 || day > 31) return DT_ERR_WRONG_DAY;
-    
-    // Check T separator
-    if (datetime[10] != 'T') return DT_ERR_WRONG_SEPARATOR;
-    
-    // Check hh (hour)
-    if (!isdigit(datetime[11]) || !isdigit(datetime[12])) return DT_ERR_WRONG_HOUR;
-    uint8_t hour = (datetime[11] - '0') * 10 + (datetime[12] - '0');
-    if ( hour > 23) return DT_ERR_WRONG_HOUR;
-    
-    // Check first colon
-    if (datetime[13] != ':') return DT_ERR_WRONG_SEPARATOR;
-    
-    // Check mm (minute)
-    if (!isdigit(datetime[14]) || !isdigit(datetime[15])) return DT_ERR_WRONG_MINUTE;
-    uint8_t minute = (datetime[14] - '0') * 10 + (datetime[15] - '0');
-    if ( minute > 59) return DT_ERR_WRONG_MINUTE;
-    
-    // Check second colon
-    if (datetime[16] != ':') return DT_ERR_WRONG_SEPARATOR;
-    
-    // Check ss (second)
-    if (!isdigit(datetime[17]) || !isdigit(datetime[18])) return DT_ERR_WRONG_SECOND;
-    uint8_t second = (datetime[17] - '0') * 10 + (datetime[18] - '0');
-    if ( second > 59) return DT_ERR_WRONG_SECOND;
-    
-    // Check timezone designator (TZD)
     if (dtstr_len == 19) {
         // No timezone specified - local time
+        dt->tz = DT_TZ_LOCAL;
         return RET_SUCCESS;
     }
-    
-    // Check for Z (UTC) 
-    if (dtstr_len == 20 && datetime[19] == 'Z') {
+
+    size_t pos = 19;
+    if (datetime[19] == '.' || datetime[19] == ',') {
+        int32_t fraction = 0;
+        for (pos = 20; pos < dtstr_len && IS_DIGIT(datetime[pos]); pos++) {
+            if (pos == 29) return DT_ERR_WRONG_SECOND; // finer than nanoseconds
+            fraction = fraction * 10 + (datetime[pos] - '0');
+        }
+        if (pos == 20) return DT_ERR_WRONG_SECOND;
+        dt->nanosecond = fraction * dt_fraction_scale[pos - 20];
+    }
+
+    const char* tz = datetime + pos;
+    size_t tz_len = dtstr_len - pos;
+    if (tz_len == 0) {
+        dt->tz = DT_TZ_LOCAL;
         return RET_SUCCESS;
     }
 
-    // Check for timezone offset +/-HH:MM
-    if (dtstr_len >= 25 && (datetime[19] == '+' || datetime[19] == '-')) {
-        // Check timezone format +/-HH:MM
-        if (!isdigit(datetime[20]) || !isdigit(datetime[21])) return DT_ERR_WRONG_TZ_HOUR;
-        if (datetime[22] != ':') return DT_ERR_WRONG_SEPARATOR;
-        if (!isdigit(datetime[23]) || !isdigit(datetime[24])) return DT_ERR_WRONG_TZ_MINUTE;
-        
-        int8_t tz_hour = (datetime[20] - '0') * 10 + (datetime[21] - '0');
-        int8_t tz_minute = (datetime[23] - '0') * 10 + (datetime[24] - '0');
-        
-        if (tz_hour > 14) return DT_ERR_WRONG_TZ_HOUR;
-        if (tz_minute > 59) return DT_ERR_WRONG_TZ_MINUTE;
+    // Check for Z (UTC) 
+    if (tz_len == 1 && (tz[0] == 'Z' || tz[0] == 'z')) {
+        dt->tz = DT_TZ_UTC;
         return RET_SUCCESS;
     }
 
-    return DT_ERR_WRONG_TZ;
+    if (tz[0] != '+' && tz[0] != '-') return DT_ERR_WRONG_TZ;
+
+    // Check timezone format +/-HH:MM, or +/-HHMM made of four digits
+    int minute_at;
+    if (tz_len >= 6) {
+        if (!IS_DIGIT(tz[1]) || !IS_DIGIT(tz[2])) return DT_ERR_WRONG_TZ_HOUR;
+        if (tz[3] != ':') return DT_ERR_WRONG_SEPARATOR;
+        if (!IS_DIGIT(tz[4]) || !IS_DIGIT(tz[5])) return DT_ERR_WRONG_TZ_MINUTE;
+        minute_at = 4;
+    } else if (tz_len == 5 && IS_DIGIT(tz[1]) && IS_DIGIT(tz[2]) &&
+               IS_DIGIT(tz[3]) && IS_DIGIT(tz[4])) {
+        minute_at = 3;
+    } else {
+        return DT_ERR_WRONG_TZ;
+    }
+
+    int8_t tz_hour = (tz[1] - '0') * 10 + (tz[2] - '0');
+    int8_t tz_minute = (tz[minute_at] - '0') * 10 + (tz[minute_at + 1] - '0');
+
+    if (tz_hour > 14) return DT_ERR_WRONG_TZ_HOUR;
+    if (tz_minute > 59) return DT_ERR_WRONG_TZ_MINUTE;
+
+    dt->tz = DT_TZ_OFFSET;
+    dt->tz_offset = tz_hour * 60 + tz_minute;
+    if (tz[0] == '-') dt->tz_offset = -dt->tz_offset;
+    return RET_SUCCESS;
 }
 
-/* Fucntion to validate and normalize date time value
-    For local date-time, copy directly.
-    All other time converts to GMT by adjusting the time based on the timezone offset
+/* Byte-by-byte parser, checks each field in order and reports the
+    first problem found. Only reached when the fast prefix kernel rejects
+    the input, so its speed does not matter but its error codes do.
 */
-FunctionStatus normalize_iso8601(const char* datetime, char datetime_utc[25])
+static FunctionStatus parse_iso8601_slow(const char* datetime, size_t dtstr_len, dt_fields* dt)
 {
-    datetime_utc[0] = '\0';
-
     // check string length
-    size_t dtstr_len = strlen(datetime);
     if (dtstr_len < 19) return DT_ERR_TOO_SHORT;
     
     // Check YYYY (year)
     for (int i = 0; i < 4; i++) {
-        if (!isdigit(datetime[i])) return DT_ERR_WRONG_YEAR;
+        if (!IS_DIGIT(datetime[i])) return DT_ERR_WRONG_YEAR;
     }
-    int16_t year =  (datetime[0] - '0') * 1000 + 
+    dt->year =  (datetime[0] - '0') * 1000 + 
                 (datetime[1] - '0') * 100 + 
                 (datetime[2] - '0') * 10 + 
                 (datetime[3] - '0');
@@ -119,128 +136,396 @@ FunctionStatus normalize_iso8601(const char* datetime, char datetime_utc[25])
     if (datetime[4] != '-') return DT_ERR_WRONG_SEPARATOR;
     
     // Check MM (month)
-    if (!isdigit(datetime[5]) || !isdigit(datetime[6])) return DT_ERR_WRONG_MONTH;
-    int8_t month = (datetime[5] - '0') * 10 + (datetime[6] - '0');
-    if (month < 1 || month > 12) return DT_ERR_WRONG_MONTH;
+    if (!IS_DIGIT(datetime[5]) || !IS_DIGIT(datetime[6])) return DT_ERR_WRONG_MONTH;
+    dt->month = (datetime[5] - '0') * 10 + (datetime[6] - '0');
+    if (dt->month < 1 || dt->month > 12) return DT_ERR_WRONG_MONTH;
     
     // Check second dash
     if (datetime[7] != '-') return DT_ERR_WRONG_SEPARATOR;
     
     // Check DD (day)
-    if (!isdigit(datetime[8]) || !isdigit(datetime[9])) return DT_ERR_WRONG_DAY;
-    int8_t day = (datetime[8] - '0') * 10 + (datetime[9] - '0');
-    if (day < 1 || day > 31) return DT_ERR_WRONG_DAY;
+    if (!IS_DIGIT(datetime[8]) || !IS_DIGIT(datetime[9])) return DT_ERR_WRONG_DAY;
+    dt->day = (datetime[8] - '0') * 10 + (datetime[9] - '0');
+    if (dt->day < 1 || dt->day > dt_month_days[dt_is_leap(dt->year)][dt->month]) {
+        return DT_ERR_WRONG_DAY;
+    }
     
-    // Check T separator
-    if (datetime[10] != 'T') return DT_ERR_WRONG_SEPARATOR;
+    // Check T separator, or a space in its place
+    if (datetime[10] != 'T' && datetime[10] != ' ') return DT_ERR_WRONG_SEPARATOR;
     
     // Check hh (hour)
-    if (!isdigit(datetime[11]) || !isdigit(datetime[12])) return DT_ERR_WRONG_HOUR;
-    int8_t hour = (datetime[11] - '0') * 10 + (datetime[12] - '0');
-    if (hour < 0 || hour > 23) return DT_ERR_WRONG_HOUR;
+    if (!IS_DIGIT(datetime[11]) || !IS_DIGIT(datetime[12])) return DT_ERR_WRONG_HOUR;
+    dt->hour = (datetime[11] - '0') * 10 + (datetime[12] - '0');
+    if (dt->hour > 23) return DT_ERR_WRONG_HOUR;
     
     // Check first colon
     if (datetime[13] != ':') return DT_ERR_WRONG_SEPARATOR;
     
     // Check mm (minute)
-    if (!isdigit(datetime[14]) || !isdigit(datetime[15])) return DT_ERR_WRONG_MINUTE;
-    int8_t minute = (datetime[14] - '0') * 10 + (datetime[15] - '0');
-    if (minute < 0 || minute > 59) return DT_ERR_WRONG_MINUTE;
+    if (!IS_DIGIT(datetime[14]) || !IS_DIGIT(datetime[15])) return DT_ERR_WRONG_MINUTE;
+    dt->minute = (datetime[14] - '0') * 10 + (datetime[15] - '0');
+    if (dt->minute > 59) return DT_ERR_WRONG_MINUTE;
     
     // Check second colon
     if (datetime[16] != ':') return DT_ERR_WRONG_SEPARATOR;
     
     // Check ss (second)
-    if (!isdigit(datetime[17]) || !isdigit(datetime[18])) return DT_ERR_WRONG_SECOND;
-    int8_t second = (datetime[17] - '0') * 10 + (datetime[18] - '0');
-    if (second < 0 || second > 59) return DT_ERR_WRONG_SECOND;
+    if (!IS_DIGIT(datetime[17]) || !IS_DIGIT(datetime[18])) return DT_ERR_WRONG_SECOND;
+    dt->second = (datetime[17] - '0') * 10 + (datetime[18] - '0');
+    if (dt->second > 59) return DT_ERR_WRONG_SECOND;
     
     // Check timezone designator (TZD)
-    if (dtstr_len == 19) {
-        // No timezone specified - local time
-        strncpy(datetime_utc, datetime, 19);
-        datetime_utc[19] = '\0';
+    return parse_iso8601_tz(datetime, dtstr_len, dt);
+}
+
+/* Parse and validate a datetime string into its fields.
+    Shared by the validator, the normalizer and the packed key encoder,
+    so all of them report the same FunctionStatus for the same input.
+    Only the first dtstr_len bytes are read, datetime need not be
+    NUL-terminated. readable (>= dtstr_len) tells the prefix kernel how
+    far it may load past the string.
+*/
+static inline FunctionStatus parse_iso8601(const char* datetime, size_t dtstr_len,
+                                           size_t readable, dt_fields* dt)
+{
+    if (dtstr_len >= 19 && dt_parse_prefix(datetime, readable, dt)) {
+        // the kernel only bounds the day by 31; the slow parser checks the
+        // month length at the same point, before the timezone
+        if (dt->day > dt_month_days[dt_is_leap(dt->year)][dt->month]) return DT_ERR_WRONG_DAY;
+        return parse_iso8601_tz(datetime, dtstr_len, dt);
+    }
+    return parse_iso8601_slow(datetime, dtstr_len, dt);
+}
+
+FunctionStatus validate_iso8601(const char* datetime)
+{
+    size_t len = strlen(datetime);
+    dt_fields dt;
+    return parse_iso8601(datetime, len, len, &dt);
+}
+
+static inline int64_t dt_fields_to_seconds(const dt_fields* dt);
+static inline int dt_format_iso8601(int64_t seconds, int32_t nanosecond, int utc, char* p);
+
+/* Fucntion to validate and normalize date time value
+    For local date-time, copy directly.
+    All other time converts to GMT by adjusting the time based on the timezone offset
+*/
+FunctionStatus normalize_iso8601(const char* datetime, char datetime_utc[DT_ISO8601_SIZE])
+{
+    return normalize_iso8601_n(datetime, strlen(datetime), datetime_utc);
+}
+
+// Length-aware normalize_iso8601 for views that are not NUL-terminated
+FunctionStatus normalize_iso8601_n(const char* datetime, size_t len, char datetime_utc[DT_ISO8601_SIZE])
+{
+    datetime_utc[0] = '\0';
+
+    dt_fields dt;
+    FunctionStatus rstat = parse_iso8601(datetime, len, len, &dt);
+    if (rstat != RET_SUCCESS) return rstat;
+
+    // The bulk of the input is "...ssZ" and already in normal form
+    if (len == 20 && dt.tz == DT_TZ_UTC && datetime[10] == 'T' && datetime[19] == 'Z') {
+        memcpy(datetime_utc, datetime, 20);
+        datetime_utc[20] = '\0';
         return RET_SUCCESS;
     }
-    
-    // Check for Z (UTC)
-    if (dtstr_len == 20 && datetime[19] == 'Z') {
+
+    if (len == 19 && datetime[10] == 'T') {
         // No timezone specified - local time
-        strncpy(datetime_utc, datetime, 20);
-        datetime_utc[20] = '\0';
+        memcpy(datetime_utc, datetime, 19);
+        datetime_utc[19] = '\0';
         return RET_SUCCESS;
     }
 
-    // Check for timezone offset +/-HH:MM
-    if (dtstr_len >= 25 && (datetime[19] == '+' || datetime[19] == '-')) {
-        // Check timezone format +/-HH:MM
-        if (!isdigit(datetime[20]) || !isdigit(datetime[21])) return DT_ERR_WRONG_TZ_HOUR;
-        if (datetime[22] != ':') return DT_ERR_WRONG_SEPARATOR;
-        if (!isdigit(datetime[23]) || !isdigit(datetime[24])) return DT_ERR_WRONG_TZ_MINUTE;
-        
-        int8_t tz_hour = (datetime[20] - '0') * 10 + (datetime[21] - '0');
-        int8_t tz_minute = (datetime[23] - '0') * 10 + (datetime[24] - '0');
-        
-        if (tz_hour > 14) return DT_ERR_WRONG_TZ_HOUR;
-        if (tz_minute > 59) return DT_ERR_WRONG_TZ_MINUTE;
-        
-        // Adjust time to GMT
-        if (datetime[19] == '+') {
-            hour -= tz_hour;
-            minute -= tz_minute;
-        } else {
-            hour += tz_hour;
-            minute += tz_minute;
+    // Everything else is rebuilt from the fields: offsets go to UTC
+    // through the day count, so crossing midnight lands on the right day
+    // of the right month and year; the T, the Z and the fraction are
+    // written in one canonical form
+    int64_t seconds = dt_fields_to_seconds(&dt);
+    if (seconds < 0 || seconds > DT_KEY_MAX_SECONDS) return DT_ERR_WRONG_YEAR;
+
+    int n = dt_format_iso8601(seconds, dt.nanosecond, dt.tz != DT_TZ_LOCAL, datetime_utc);
+    datetime_utc[n] = '\0';
+    return RET_SUCCESS;
+}
+
+/* Days since 0000-01-01 for a proleptic Gregorian date, years 0000..9999.
+    Whole years before this one (0000 is a leap year, hence the rounding
+    up), then the month table, then one more day past February of a leap
+    year.
+*/
+static inline int64_t days_from_civil(int32_t year, int32_t month, int32_t day)
+{
+    return (int64_t)year * 365 + (year + 3) / 4 - (year + 99) / 100 + (year + 399) / 400
+         + dt_days_before_month[month] + (month > 2 && dt_is_leap(year)) + day - 1;
+}
+
+/* Inverse of days_from_civil
+    (Howard Hinnant's civil_from_days, shifted to a year-0 epoch)
+*/
+static void civil_from_days(int64_t days, int32_t* year, int32_t* month, int32_t* day)
+{
+    days -= 60;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const uint32_t doe = (uint32_t)(days - era * 146097);
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp = (5 * doy + 2) / 153;
+    *day = (int32_t)(doy - (153 * mp + 2) / 5 + 1);
+    *month = (int32_t)(mp < 10 ? mp + 3 : mp - 9);
+    *year = (int32_t)(yoe + era * 400) + (*month <= 2);
+}
+
+/* Function to validate a date time value and pack it into a dt_key.
+    Offset inputs are converted to UTC the same way normalize_iso8601 does,
+    so equal instants map to equal keys.
+*/
+FunctionStatus normalize_iso8601_key(const char* datetime, dt_key* key)
+{
+    return normalize_iso8601_key_n(datetime, strlen(datetime), key);
+}
+
+// Seconds since 0000-01-01 of parsed fields, offsets converted to UTC
+static inline int64_t dt_fields_to_seconds(const dt_fields* dt)
+{
+    int64_t seconds = days_from_civil(dt->year, dt->month, dt->day) * 86400
+                    + dt->hour * 3600 + dt->minute * 60 + dt->second;
+    if (dt->tz == DT_TZ_OFFSET) seconds -= dt->tz_offset * 60;
+    return seconds;
+}
+
+// Pack parsed fields into a dt_key, converting offsets to UTC
+static inline FunctionStatus dt_fields_to_key(const dt_fields* dt, dt_key* key)
+{
+    int64_t seconds = dt_fields_to_seconds(dt);
+    // Year under/over-flow, not supported
+    if (seconds < 0 || seconds > DT_KEY_MAX_SECONDS) return DT_ERR_WRONG_YEAR;
+
+    *key = DT_KEY_MAKE(seconds, dt->nanosecond / 1000,
+                       dt->tz == DT_TZ_LOCAL ? DT_KEY_LOCAL : DT_KEY_UTC);
+    return RET_SUCCESS;
+}
+
+// Length-aware normalize_iso8601_key for views that are not NUL-terminated
+FunctionStatus normalize_iso8601_key_n(const char* datetime, size_t len, dt_key* key)
+{
+    *key = 0;
+
+    dt_fields dt;
+    FunctionStatus rstat = parse_iso8601(datetime, len, len, &dt);
+    if (rstat != RET_SUCCESS) return rstat;
+
+    return dt_fields_to_key(&dt, key);
+}
+
+/* Function to parse a whole buffer of newline-separated datetime values
+    in one call. Each line is reduced to its first whitespace-delimited
+    token (see dt_line_token) and blank lines are skipped. For every other
+    line keys[i] and status[i] receive the packed key (0 on error) and
+    the same FunctionStatus normalize_iso8601_key would return.
+    Stops after max_count values or at the end of the buffer; a last line
+    without a newline counts as a line.
+    return the number of values parsed, *consumed the bytes used
+*/
+size_t normalize_iso8601_key_batch(const char* buffer, size_t len, dt_key* keys,
+                                   FunctionStatus* status, size_t max_count, size_t* consumed)
+{
+    const char* end = buffer + len;
+    const char* pos = buffer;
+    size_t count = 0;
+
+    while (pos < end && count < max_count) {
+        const char* newline = memchr(pos, '\n', (size_t)(end - pos));
+        const char* line_end = newline ? newline : end;
+        const char* line = pos;
+        pos = newline ? newline + 1 : end;
+
+        // trim both ends; usually no byte moves, unlike a full token scan
+        while (line < line_end && IS_SPACE(*line)) line++;
+        while (line_end > line && IS_SPACE(line_end[-1])) line_end--;
+        if (line == line_end) continue; // blank line
+
+        // the rest of the buffer is readable, so wide kernels load in place
+        dt_fields dt;
+        size_t line_len = (size_t)(line_end - line);
+        FunctionStatus rstat = parse_iso8601(line, line_len, (size_t)(end - line), &dt);
+        if (rstat != RET_SUCCESS) {
+            // A line that parses has no whitespace in the bytes the parser
+            // reads, so it equals its first token. Failures are re-parsed
+            // as the token alone to report the same error as the single
+            // value API.
+            size_t token_len;
+            dt_line_token(line, line_len, &token_len);
+            rstat = parse_iso8601(line, token_len, (size_t)(end - line), &dt);
         }
 
-        if (minute < 0) {
-            minute += 60;
-            hour -= 1;
-        } else if (minute >= 60) {
-            minute -= 60;
-            hour += 1;
+        keys[count] = 0;
+        if (rstat == RET_SUCCESS) {
+            rstat = dt_fields_to_key(&dt, &keys[count]);
         }
+        status[count] = rstat;
+        count++;
+    }
+
+    if (consumed) *consumed = (size_t)(pos - buffer);
+    return count;
+}
+
+// Narrow a line down to its first whitespace-delimited token,
+// the view equivalent of sscanf("%s"). A 10-byte token followed by one
+// space and a digit is a date with a space for the T, and takes the
+// time after it along.
+const char* dt_line_token(const char* line, size_t len, size_t* token_len)
+{
+    const char* end = line + len;
+    while (line < end && IS_SPACE(*line)) line++;
+
+    const char* token_end = line;
+    while (token_end < end && !IS_SPACE(*token_end)) token_end++;
+
+    if (token_end - line == 10 && end - token_end >= 2 &&
+        token_end[0] == ' ' && IS_DIGIT(token_end[1])) {
+        token_end += 2;
+        while (token_end < end && !IS_SPACE(*token_end)) token_end++;
+    }
+
+    *token_len = (size_t)(token_end - line);
+    return line;
+}
+
+// "00" to "99", two bytes per entry, so each field is one 2-byte copy
+static const char dt_digits2[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+#define DT_PUT2(p, value)   memcpy((p), &dt_digits2[(value) * 2], 2)
+
+// Write "YYYY-MM-DDT" for a day count since 0000-01-01
+static inline void dt_format_date(int64_t days, char* p)
+{
+    int32_t year, month, day;
+    civil_from_days(days, &year, &month, &day);
+    DT_PUT2(p, year / 100);
+    DT_PUT2(p + 2, year % 100);
+    p[4] = '-';
+    DT_PUT2(p + 5, month);
+    p[7] = '-';
+    DT_PUT2(p + 8, day);
+    p[10] = 'T';
+}
 
-        if (hour < 0) {
-            hour += 24;
-            day -= 1;
-            // Note: This does not handle month/year underflow for simplicity
-        } else if (hour >= 24) {
-            hour -= 24;
-            day += 1;
-            // Note: This does not handle month/year overflow for simplicity
-        } 
-
-        // =========================================
-        //  !!!  No semantic checking for dates  !!!
-        // =========================================
-        if (day <= 0) {
-            day += 31;
-            month -= 1;
-        } else if (day > 31) {
-            day -= 31;
-            month += 1;
+// Write "hh:mm:ss", the fraction without trailing zeros and the zone
+// designator after a date, return the length of the whole value (no
+// terminator is written)
+static inline int dt_format_time(int32_t sec_of_day, int32_t nanosecond, int utc, char* p)
+{
+    int32_t minutes = sec_of_day / 60;
+    DT_PUT2(p + 11, minutes / 60);
+    p[13] = ':';
+    DT_PUT2(p + 14, minutes % 60);
+    p[16] = ':';
+    DT_PUT2(p + 17, sec_of_day - minutes * 60);
+
+    int len = 19;
+    if (nanosecond) {
+        int digits = 9;
+        while (nanosecond % 10 == 0) {
+            nanosecond /= 10;
+            digits--;
         }
+        p[19] = '.';
+        for (int i = digits; i > 0; i--) {
+            p[19 + i] = (char)('0' + nanosecond % 10);
+            nanosecond /= 10;
+        }
+        len = 20 + digits;
+    }
+
+    if (utc) p[len++] = 'Z';
+    return len;
+}
+
+// Write a normalized value, return its length (no terminator is written)
+static inline int dt_format_iso8601(int64_t seconds, int32_t nanosecond, int utc, char* p)
+{
+    int64_t days = seconds / 86400;
+    dt_format_date(days, p);
+    return dt_format_time((int32_t)(seconds - days * 86400), nanosecond, utc, p);
+}
+
+/* Function to turn a dt_key back into the string normalize_iso8601 produces
+    return the length of the string written to datetime_utc
+*/
+int dt_key_to_iso8601(dt_key key, char datetime_utc[DT_ISO8601_SIZE])
+{
+    int len = dt_format_iso8601((int64_t)DT_KEY_SECONDS(key), (int32_t)DT_KEY_MICROS(key) * 1000,
+                                DT_KEY_ZONE(key) == DT_KEY_UTC, datetime_utc);
+    datetime_utc[len] = '\0';
+    return len;
+}
+
+/* Function to format many keys into one buffer, each as a line of the
+    form dt_key_to_iso8601 produces followed by '\n'. Stops before a value
+    that might not fit, so buffer_len should leave room for at least
+    DT_ISO8601_LINE_MAX bytes. Consecutive keys on the same day, common in
+    sorted output, reuse the date already written.
+    return the number of keys formatted, *written the bytes used
+*/
+size_t dt_key_format_batch(const dt_key* keys, size_t count, char* buffer, size_t buffer_len,
+                           size_t* written)
+{
+    char* p = buffer;
+    char* end = buffer + buffer_len;
+    int64_t last_day = -1;
+    const char* last_date = NULL;
+    size_t i = 0;
 
-        if (month <= 0) {
-            month += 12;
-            year -= 1;
-        } else if (month > 12) {
-            month -= 12;
-            year += 1;
+    for (; i < count && end - p >= DT_ISO8601_LINE_MAX; i++) {
+        int64_t seconds = (int64_t)DT_KEY_SECONDS(keys[i]);
+        int64_t days = seconds / 86400;
+        if (days == last_day) {
+            memcpy(p, last_date, 11);
+        } else {
+            dt_format_date(days, p);
+            last_day = days;
         }
+        last_date = p;
+        int len = dt_format_time((int32_t)(seconds - days * 86400),
+                                 (int32_t)DT_KEY_MICROS(keys[i]) * 1000,
+                                 DT_KEY_ZONE(keys[i]) == DT_KEY_UTC, p);
+        p[len] = '\n';
+        p += len + 1;
+    }
 
-        if (year < 0 || year > 9999) return DT_ERR_WRONG_YEAR; // Year under/over-flow, not supported
+    if (written) *written = (size_t)(p - buffer);
+    return i;
+}
 
-        sprintf(datetime_utc, "%04d-%02d-%02dT%02d:%02d:%02dZ", 
-                year, month, day, hour, minute, second);
-        return RET_SUCCESS;
+/* Function to end a "value,count" output line: writes ',', the count in
+    decimal and '\n', without a NUL, so lines can be built in a buffer
+    return the number of bytes written
+*/
+int dt_format_count_suffix(uint64_t count, char out[DT_COUNT_SUFFIX_MAX])
+{
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + count % 10);
+        count /= 10;
+    } while (count);
+
+    out[0] = ',';
+    for (int i = 0; i < n; i++) {
+        out[1 + i] = digits[n - 1 - i];
     }
-    
-    return DT_ERR_WRONG_TZ;
+    out[n + 1] = '\n';
+    return n + 2;
 }
 
-void test_validator()
+int test_validator()
 {
     struct test_data_struct
     {
@@ -262,6 +547,12 @@ void test_validator()
         {"2023-10-05T14:30:00+02:60",   DT_ERR_WRONG_TZ_MINUTE},
         {"2023-13-05T14:30:00",         DT_ERR_WRONG_MONTH}, 
         {"2023-10-32T14:30:00",         DT_ERR_WRONG_DAY}, 
+        {"2023-02-29T14:30:00",         DT_ERR_WRONG_DAY}, 
+        {"2024-02-29T14:30:00",         RET_SUCCESS}, 
+        {"1900-02-29T14:30:00Z",        DT_ERR_WRONG_DAY}, 
+        {"2000-02-29T14:30:00Z",        RET_SUCCESS}, 
+        {"2023-04-31T14:30:00+02:00",   DT_ERR_WRONG_DAY}, 
+        {"2023-04-31T14:30:00+15:00",   DT_ERR_WRONG_DAY}, 
         {"2023-10-05T24:30:00",         DT_ERR_WRONG_HOUR}, 
         {"2023-10-05T14:60:00",         DT_ERR_WRONG_MINUTE}, 
         {"2023-10-05T14:30:60",         DT_ERR_WRONG_SECOND},
@@ -269,7 +560,17 @@ void test_validator()
         {"2023-10-05T14:30:00-14:00",   RET_SUCCESS}, 
         {"2023-10-05T14:30:00+00:00",   RET_SUCCESS}, 
         {"2023-10-05T14:30:00-00:00",   RET_SUCCESS}, 
-        {"2023-10-05 14:30:00Z",        DT_ERR_WRONG_SEPARATOR},
+        {"2023-10-05 14:30:00Z",        RET_SUCCESS},
+        {"2023-10-05T14:30:00z",        RET_SUCCESS},
+        {"2023-10-05T14:30:00.123456Z", RET_SUCCESS},
+        {"2023-10-05T14:30:00,5",       RET_SUCCESS},
+        {"2023-10-05T14:30:00.123456789+05:30", RET_SUCCESS},
+        {"2023-10-05T14:30:00.1234567891Z",     DT_ERR_WRONG_SECOND},
+        {"2023-10-05T14:30:00.Z",       DT_ERR_WRONG_SECOND},
+        {"2023-10-05T14:30:00+0530",    RET_SUCCESS},
+        {"2023-10-05T14:30:00-1500",    DT_ERR_WRONG_TZ_HOUR},
+        {"2023-10-05T14:30:00+05",      DT_ERR_WRONG_TZ},
+        {"2023-10-05T14:30:00zz",       DT_ERR_WRONG_TZ},
         {"InvalidString",               DT_ERR_TOO_SHORT}
     };
 
@@ -286,15 +587,15 @@ void test_validator()
         }
     }
     printf("%d/%d validation tests passed.\n", passed, num_tests);
-
+    return num_tests - passed;
 }
 
-void test_normalizer()
+int test_normalizer()
 {
     struct test_data_struct
     {
         const char* datetime;
-        char expected[25]; 
+        char expected[DT_ISO8601_SIZE]; 
         FunctionStatus ret_status;
     };
 
@@ -304,10 +605,18 @@ void test_normalizer()
         {"2023-10-05T14:30:00+02:00",   "2023-10-05T12:30:00Z",      RET_SUCCESS},
         {"2023-10-05T14:30:00-05:00",   "2023-10-05T19:30:00Z",      RET_SUCCESS},
         {"2023-01-01T01:30:00+02:00",   "2022-12-31T23:30:00Z",      RET_SUCCESS},
+        {"2023-03-01T01:00:00+02:00",   "2023-02-28T23:00:00Z",      RET_SUCCESS},
+        {"2024-03-01T01:00:00+02:00",   "2024-02-29T23:00:00Z",      RET_SUCCESS},
+        {"2023-04-30T23:30:00-01:00",   "2023-05-01T00:30:00Z",      RET_SUCCESS},
+        {"9999-12-31T23:30:00-01:00",   "",                          DT_ERR_WRONG_YEAR},
+        {"2023-10-05 14:30:00z",        "2023-10-05T14:30:00Z",      RET_SUCCESS},
+        {"2023-10-05T14:30:00.000",     "2023-10-05T14:30:00",       RET_SUCCESS},
+        {"2023-10-05T14:30:00,250Z",    "2023-10-05T14:30:00.25Z",   RET_SUCCESS},
+        {"2023-10-05T00:10:00.123456789+0530", "2023-10-04T18:40:00.123456789Z", RET_SUCCESS},
         {"InvalidString",               "",                          DT_ERR_TOO_SHORT}
     };
 
-    char datetime_utc[25];
+    char datetime_utc[DT_ISO8601_SIZE];
 
     int num_tests = sizeof(test_cases) / sizeof(test_cases[0]);
     int passed = 0;
@@ -323,7 +632,139 @@ void test_normalizer()
         }
     }
     printf("%d/%d normalization tests passed.\n", passed, num_tests);
+    return num_tests - passed;
+}
 
+int test_packed_key()
+{
+    struct test_data_struct
+    {
+        const char* datetime;
+        char expected[DT_ISO8601_SIZE]; 
+        FunctionStatus ret_status;
+    };
+
+    struct test_data_struct  test_cases[] = {
+        {"2023-10-05T14:30:00",         "2023-10-05T14:30:00",       RET_SUCCESS},
+        {"2023-10-05T14:30:00Z",        "2023-10-05T14:30:00Z",      RET_SUCCESS},
+        {"2023-10-05T14:30:00+02:00",   "2023-10-05T12:30:00Z",      RET_SUCCESS},
+        {"2023-10-05T14:30:00-05:00",   "2023-10-05T19:30:00Z",      RET_SUCCESS},
+        {"2023-01-01T01:30:00+02:00",   "2022-12-31T23:30:00Z",      RET_SUCCESS},
+        {"2023-03-01T01:00:00+02:00",   "2023-02-28T23:00:00Z",      RET_SUCCESS},
+        {"2024-02-29T23:30:00-01:00",   "2024-03-01T00:30:00Z",      RET_SUCCESS},
+        {"0000-01-01T00:00:00",         "0000-01-01T00:00:00",       RET_SUCCESS},
+        {"9999-12-31T23:59:59Z",        "9999-12-31T23:59:59Z",      RET_SUCCESS},
+        {"0000-01-01T00:30:00+01:00",   "",                          DT_ERR_WRONG_YEAR},
+        {"2023-10-05 14:30:00.5z",      "2023-10-05T14:30:00.5Z",    RET_SUCCESS},
+        {"2023-10-05T14:30:00.123456789-0100", "2023-10-05T15:30:00.123456Z", RET_SUCCESS},
+        {"9999-12-31T23:59:59.999999Z", "9999-12-31T23:59:59.999999Z", RET_SUCCESS},
+        {"9999-12-31T23:30:00+01:00",   "9999-12-31T22:30:00Z",      RET_SUCCESS},
+        {"InvalidString",               "",                          DT_ERR_TOO_SHORT}
+    };
+
+    char datetime_utc[DT_ISO8601_SIZE];
+
+    int num_tests = sizeof(test_cases) / sizeof(test_cases[0]);
+    int passed = 0;
+    for (int i = 0; i < num_tests; i++) {
+        dt_key key;
+        datetime_utc[0] = '\0';
+        FunctionStatus result = normalize_iso8601_key(test_cases[i].datetime, &key);
+        if (result == RET_SUCCESS) dt_key_to_iso8601(key, datetime_utc);
+        if (result == test_cases[i].ret_status &&
+            strcmp(datetime_utc, test_cases[i].expected) == 0) {
+            printf("Test %d passed: %s\n", i + 1, test_cases[i].datetime);
+            passed++;
+        } else {
+            printf("Test %d failed: %s (expected %d, got %d)\n", 
+                   i + 1, test_cases[i].datetime, test_cases[i].ret_status, result);
+        }
+    }
+    printf("%d/%d packed key tests passed.\n", passed, num_tests);
+    return num_tests - passed;
+}
+
+int test_key_batch()
+{
+    struct test_data_struct
+    {
+        const char* line;
+    };
+
+    // one buffer of these lines, the last one without a newline
+    struct test_data_struct  test_cases[] = {
+        {"2023-10-05T14:30:00Z"},
+        {""},
+        {"2023-10-05T14:30:00+02:00"},
+        {"   "},
+        {"  2023-10-05T14:30:00-05:00  "},
+        {"2023-10-05 14:30:00.5z"},
+        {"2023-10-05 14:30:00Z trailing junk"},
+        {"2023-10-05T14:30:00Z\tjunk"},
+        {"2023-10-05T14:30:00Zjunk"},
+        {"2023-10-05T14:30:00\r"},
+        {"2023-10-05 junk"},
+        {"2023-10-05T14:30:00.123456789-0100"},
+        {"0000-01-01T00:30:00+01:00"},
+        {"2023-02-29T10:00:00Z"},
+        {"InvalidString"},
+        {"9999-12-31T23:59:59.999999Z"}
+    };
+
+    int num_tests = sizeof(test_cases) / sizeof(test_cases[0]);
+    char buffer[1024];
+    size_t len = 0;
+    for (int i = 0; i < num_tests; i++) {
+        size_t line_len = strlen(test_cases[i].line);
+        memcpy(buffer + len, test_cases[i].line, line_len);
+        len += line_len;
+        if (i + 1 < num_tests) buffer[len++] = '\n';
+    }
+
+    // parse a few values per call, so each call resumes where the last stopped
+    dt_key keys[sizeof(test_cases) / sizeof(test_cases[0])];
+    FunctionStatus status[sizeof(test_cases) / sizeof(test_cases[0])];
+    size_t count = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t consumed;
+        size_t n = normalize_iso8601_key_batch(buffer + pos, len - pos, keys + count,
+                                               status + count, 3, &consumed);
+        count += n;
+        pos += consumed;
+        if (n == 0) break;
+    }
+
+    int passed = 0;
+    size_t value = 0;
+    for (int i = 0; i < num_tests; i++) {
+        size_t dt_len;
+        const char* dt_str = dt_line_token(test_cases[i].line, strlen(test_cases[i].line), &dt_len);
+        if (dt_len == 0) {
+            printf("Test %d passed: blank line skipped\n", i + 1);
+            passed++;
+            continue;
+        }
+
+        dt_key key;
+        FunctionStatus result = normalize_iso8601_key_n(dt_str, dt_len, &key);
+        if (value < count && status[value] == result && keys[value] == key) {
+            printf("Test %d passed: %s\n", i + 1, test_cases[i].line);
+            passed++;
+        } else if (value < count) {
+            printf("Test %d failed: %s (expected %d, got %d)\n",
+                   i + 1, test_cases[i].line, result, status[value]);
+        } else {
+            printf("Test %d failed: %s (no value parsed)\n", i + 1, test_cases[i].line);
+        }
+        value++;
+    }
+    if (count != value) {
+        printf("Batch parsed %zu values, expected %zu\n", count, value);
+        passed = 0;
+    }
+    printf("%d/%d key batch tests passed.\n", passed, num_tests);
+    return num_tests - passed;
 }
 
 // int main()
@@ -333,6 +774,12 @@ void test_normalizer()
     
 //     printf("\nRunning ISO 8601 Normalizer Tests:\n");
 //     test_normalizer();
+
+//     printf("\nRunning ISO 8601 Packed Key Tests:\n");
+//     test_packed_key();
+
+//     printf("\nRunning ISO 8601 Key Batch Tests:\n");
+//     test_key_batch();
     
 //     return 0;
 // }
\ No newline at end of file
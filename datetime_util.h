@@ -4,13 +4,62 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "func_status.h"
 
+/* Packed datetime key
+    A normalized datetime packed into 64 bits, so it can be deduplicated
+    as an integer instead of a heap-allocated string:
+        bits 63..22  seconds since 0000-01-01T00:00:00 (proleptic Gregorian)
+        bits 21..2   microseconds, 0..999999
+        bits  1..0   zone flag, DT_KEY_LOCAL or DT_KEY_UTC
+    Offset inputs (+hh:mm / -hh:mm) are converted to UTC and carry the
+    DT_KEY_UTC flag, exactly as normalize_iso8601 turns them into "...Z".
+    Fractions finer than a microsecond are truncated, so values differing
+    only below that are one key (normalize_iso8601 keeps nanoseconds).
+    Keys order by instant, then by zone flag.
+    The zone flag is never 0, so 0 is never a valid key.
+*/
+typedef uint64_t dt_key;
+
+#define DT_KEY_LOCAL            1
+#define DT_KEY_UTC              2
+
+#define DT_KEY_ZONE_BITS        2
+#define DT_KEY_MICROS_BITS      20
+#define DT_KEY_SECONDS_SHIFT    22
+#define DT_KEY_MAX_SECONDS      315569519999LL  // 9999-12-31T23:59:59
+
+// Normalized strings: "YYYY-MM-DDThh:mm:ss[.fffffffff][Z]", the fraction
+// without trailing zeros and left out when zero
+#define DT_ISO8601_SIZE         32      // buffer for any normalized value and its NUL
+#define DT_ISO8601_LINE_MAX     28      // longest formatted key ("...ss.ffffffZ") plus '\n'
+#define DT_COUNT_SUFFIX_MAX     22      // ",count\n" for any 64-bit count
+
+#define DT_KEY_MAKE(seconds, micros, zone) \
+    (((dt_key)(seconds) << DT_KEY_SECONDS_SHIFT) | ((dt_key)(micros) << DT_KEY_ZONE_BITS) | (dt_key)(zone))
+#define DT_KEY_SECONDS(key)         ((key) >> DT_KEY_SECONDS_SHIFT)
+#define DT_KEY_MICROS(key)          (((key) >> DT_KEY_ZONE_BITS) & ((1u << DT_KEY_MICROS_BITS) - 1))
+#define DT_KEY_ZONE(key)            ((key) & ((1u << DT_KEY_ZONE_BITS) - 1))
+
 FunctionStatus validate_iso8601(const char* datetime);
-FunctionStatus normalize_iso8601(const char* datetime, char datetime_utc[25]);
+FunctionStatus normalize_iso8601(const char* datetime, char datetime_utc[DT_ISO8601_SIZE]);
+FunctionStatus normalize_iso8601_n(const char* datetime, size_t len, char datetime_utc[DT_ISO8601_SIZE]);
+FunctionStatus normalize_iso8601_key(const char* datetime, dt_key* key);
+FunctionStatus normalize_iso8601_key_n(const char* datetime, size_t len, dt_key* key);
+size_t normalize_iso8601_key_batch(const char* buffer, size_t len, dt_key* keys,
+                                   FunctionStatus* status, size_t max_count, size_t* consumed);
+int dt_key_to_iso8601(dt_key key, char datetime_utc[DT_ISO8601_SIZE]);
+size_t dt_key_format_batch(const dt_key* keys, size_t count, char* buffer, size_t buffer_len,
+                           size_t* written);
+int dt_format_count_suffix(uint64_t count, char out[DT_COUNT_SUFFIX_MAX]);
+const char* dt_line_token(const char* line, size_t len, size_t* token_len);
 
-void test_validator();
-void test_normalizer();
+// Self tests, run by datetime_bench -t; each returns its number of failures
+int test_validator();
+int test_normalizer();
+int test_packed_key();
+int test_key_batch();
 
 #endif // __datetime_util_h__
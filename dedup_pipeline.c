@@ -0,0 +1,499 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "dedup_pipeline.h"
+#include "datetime_util.h"
+
+// A valid value on its way to a shard; seq orders values by first
+// appearance: chunk number in the high half, line within chunk below.
+// Strings carry their length and hash_set hash from the parse phase, so
+// neither the shard insert nor the final replay hashes them again.
+typedef struct pipeline_item_struct {
+    uint64_t seq;
+    uint32_t len;
+    uint32_t hash;
+    union {
+        dt_key key;
+        char str[DT_ISO8601_SIZE];
+    } value;
+} pipeline_item;
+
+// An invalid line, printed once the round is over
+typedef struct pipeline_invalid_struct {
+    const char *token;
+    size_t len;
+    FunctionStatus status;
+} pipeline_invalid;
+
+// Growable array of fixed-size elements
+typedef struct pipeline_vec_struct {
+    void *data;
+    size_t count;
+    size_t capacity;
+} pipeline_vec;
+
+typedef struct pipeline_chunk_struct {
+    const char *start;
+    size_t len;
+    uint64_t id;
+    pipeline_vec *outbox;   // one vector of pipeline_item per shard
+    pipeline_vec invalid;   // pipeline_invalid, in line order
+} pipeline_chunk;
+
+typedef struct pipeline_shard_struct {
+    hash_set *hset;
+    key_set *kset;
+    pipeline_vec uniques;   // pipeline_item of each distinct value, in seq order
+    uint32_t *counts;       // occurrences of each of uniques, kept when counting
+    FunctionStatus status;
+} pipeline_shard;
+
+// Reusable barrier; unlike pthread_barrier_t the number of parties can be
+// lowered when fewer worker threads than requested could be started
+typedef struct pipeline_barrier_struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned parties;
+    unsigned waiting;
+    unsigned long generation;
+} pipeline_barrier;
+
+typedef struct pipeline_struct {
+    int packed;
+    int counting;           // carry the occurrences of values into the result
+    int num_threads;
+    pipeline_chunk *chunks;
+    size_t max_chunks;
+    size_t chunk_count;     // chunks in the current round
+    size_t next_chunk;      // next chunk to parse, claimed atomically
+    pipeline_shard *shards;
+    pipeline_barrier round_start;
+    pipeline_barrier parsed;
+    pipeline_barrier round_end;
+    int done;
+    FunctionStatus parse_status;    // set by any parse thread on failure
+} pipeline;
+
+typedef struct pipeline_worker_struct {
+    pipeline *pipe;
+    int id;
+} pipeline_worker;
+
+static void pipeline_barrier_init(pipeline_barrier *barrier, unsigned parties) {
+    pthread_mutex_init(&barrier->mutex, NULL);
+    pthread_cond_init(&barrier->cond, NULL);
+    barrier->parties = parties;
+    barrier->waiting = 0;
+    barrier->generation = 0;
+}
+
+static void pipeline_barrier_destroy(pipeline_barrier *barrier) {
+    pthread_mutex_destroy(&barrier->mutex);
+    pthread_cond_destroy(&barrier->cond);
+}
+
+static void pipeline_barrier_wait(pipeline_barrier *barrier) {
+    pthread_mutex_lock(&barrier->mutex);
+    unsigned long generation = barrier->generation;
+    if (++barrier->waiting >= barrier->parties) {
+        barrier->waiting = 0;
+        barrier->generation++;
+        pthread_cond_broadcast(&barrier->cond);
+    } else {
+        while (generation == barrier->generation) {
+            pthread_cond_wait(&barrier->cond, &barrier->mutex);
+        }
+    }
+    pthread_mutex_unlock(&barrier->mutex);
+}
+
+// Lower the number of parties, releasing the waiters if that completes it
+static void pipeline_barrier_set_parties(pipeline_barrier *barrier, unsigned parties) {
+    pthread_mutex_lock(&barrier->mutex);
+    barrier->parties = parties;
+    if (barrier->waiting >= parties) {
+        barrier->waiting = 0;
+        barrier->generation++;
+        pthread_cond_broadcast(&barrier->cond);
+    }
+    pthread_mutex_unlock(&barrier->mutex);
+}
+
+// Append one element to a vector, doubling its capacity when full
+static void* pipeline_vec_push(pipeline_vec *vec, size_t elem_size) {
+    if (vec->count == vec->capacity) {
+        size_t capacity = vec->capacity ? vec->capacity * 2 : 256;
+        void *data = realloc(vec->data, capacity * elem_size);
+        if (!data) return NULL;
+        vec->data = data;
+        vec->capacity = capacity;
+    }
+    return (char *)vec->data + elem_size * vec->count++;
+}
+
+// Fibonacci hashing of packed keys; the top bits pick the shard, so the
+// routing is independent from the low bits key_set uses for its slots
+static uint64_t pipeline_hash_key(dt_key key) {
+    return (key * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+// Parse one chunk, sorting its values into per-shard outboxes
+static void pipeline_parse_chunk(pipeline *pipe, pipeline_chunk *chunk) {
+    const char *pos = chunk->start;
+    const char *end = chunk->start + chunk->len;
+    uint64_t line_no = 0;
+
+    for (int s = 0; s < pipe->num_threads; s++) chunk->outbox[s].count = 0;
+    chunk->invalid.count = 0;
+
+    while (pos < end) {
+        const char *newline = memchr(pos, '\n', (size_t)(end - pos));
+        const char *line_end = newline ? newline : end;
+        size_t dt_len;
+        const char *dt_str = dt_line_token(pos, (size_t)(line_end - pos), &dt_len);
+        pos = newline ? newline + 1 : end;
+        if (dt_len == 0) continue; // blank line
+
+        pipeline_item item;
+        item.seq = (chunk->id << 32) | line_no++;
+        FunctionStatus rstat;
+        if (pipe->packed) {
+            rstat = normalize_iso8601_key_n(dt_str, dt_len, &item.value.key);
+        } else {
+            rstat = normalize_iso8601_n(dt_str, dt_len, item.value.str);
+        }
+
+        if (rstat != RET_SUCCESS) {
+            pipeline_invalid *bad = pipeline_vec_push(&chunk->invalid, sizeof(pipeline_invalid));
+            if (!bad) {
+                __atomic_store_n(&pipe->parse_status, MEMORY_ALLOCATION_ERR, __ATOMIC_RELAXED);
+                continue;
+            }
+            bad->token = dt_str;
+            bad->len = dt_len;
+            bad->status = rstat;
+            continue;
+        }
+
+        uint64_t route;
+        if (pipe->packed) {
+            item.len = 0;
+            item.hash = 0;
+            route = pipeline_hash_key(item.value.key);
+        } else {
+            item.len = (uint32_t)strlen(item.value.str);
+            uint64_t hash = hash_set_hash(item.value.str, item.len);
+            item.hash = (uint32_t)hash;
+            // the sets index buckets with the low half, route by the high one
+            route = hash >> 32;
+        }
+
+        pipeline_item *slot = pipeline_vec_push(&chunk->outbox[route % (uint64_t)pipe->num_threads],
+                                                sizeof(pipeline_item));
+        if (!slot) {
+            __atomic_store_n(&pipe->parse_status, MEMORY_ALLOCATION_ERR, __ATOMIC_RELAXED);
+            continue;
+        }
+        *slot = item;
+    }
+}
+
+// Insert a chunk's outbox into the shard owned by the calling thread
+static void pipeline_insert_outbox(pipeline *pipe, pipeline_shard *shard, pipeline_vec *outbox) {
+    pipeline_item *items = outbox->data;
+    for (size_t i = 0; i < outbox->count; i++) {
+        FunctionStatus rstat = pipe->packed
+            ? key_set_insert(shard->kset, items[i].value.key)
+            : hash_set_insert_hashed(shard->hset, items[i].value.str, items[i].len, items[i].hash);
+        if (rstat == TRUE_STATUS) {
+            pipeline_item *unique = pipeline_vec_push(&shard->uniques, sizeof(pipeline_item));
+            if (!unique) {
+                shard->status = MEMORY_ALLOCATION_ERR;
+                continue;
+            }
+            *unique = items[i];
+        } else if (rstat != FALSE_STATUS) {
+            shard->status = rstat;
+        }
+    }
+}
+
+static void* pipeline_worker_main(void *arg) {
+    pipeline_worker *worker = arg;
+    pipeline *pipe = worker->pipe;
+    pipeline_shard *shard = &pipe->shards[worker->id];
+
+    for (;;) {
+        pipeline_barrier_wait(&pipe->round_start);
+        if (pipe->done) break;
+
+        // parse phase: chunks are claimed dynamically to balance the load
+        size_t c;
+        while ((c = __atomic_fetch_add(&pipe->next_chunk, 1, __ATOMIC_RELAXED)) < pipe->chunk_count) {
+            pipeline_parse_chunk(pipe, &pipe->chunks[c]);
+        }
+        pipeline_barrier_wait(&pipe->parsed);
+
+        // insert phase: this thread alone touches its shard, in chunk order
+        for (c = 0; c < pipe->chunk_count; c++) {
+            pipeline_insert_outbox(pipe, shard, &pipe->chunks[c].outbox[worker->id]);
+        }
+        pipeline_barrier_wait(&pipe->round_end);
+    }
+
+    return NULL;
+}
+
+// Cut a block of whole lines into chunks of about PIPELINE_CHUNK_SIZE bytes
+static void pipeline_split_block(pipeline *pipe, const char *block, size_t len, uint64_t *next_id) {
+    const char *end = block + len;
+    pipe->chunk_count = 0;
+
+    while (block < end && pipe->chunk_count < pipe->max_chunks) {
+        const char *chunk_end = end;
+        if ((size_t)(end - block) > PIPELINE_CHUNK_SIZE &&
+            pipe->chunk_count + 1 < pipe->max_chunks) {
+            const char *newline = memchr(block + PIPELINE_CHUNK_SIZE, '\n',
+                                         (size_t)(end - block) - PIPELINE_CHUNK_SIZE);
+            if (newline) chunk_end = newline + 1;
+        }
+
+        pipeline_chunk *chunk = &pipe->chunks[pipe->chunk_count++];
+        chunk->start = block;
+        chunk->len = (size_t)(chunk_end - block);
+        chunk->id = (*next_id)++;
+        block = chunk_end;
+    }
+    pipe->next_chunk = 0;
+}
+
+// Hand the invalid lines of the round to errors in input order and count
+// the round's lines into stats
+static void pipeline_report_invalid(pipeline *pipe, dedup_stats *stats, error_sink *errors) {
+    for (size_t c = 0; c < pipe->chunk_count; c++) {
+        pipeline_invalid *bad = pipe->chunks[c].invalid.data;
+        for (size_t i = 0; i < pipe->chunks[c].invalid.count; i++) {
+            error_sink_add(errors, bad[i].token, bad[i].len, bad[i].status);
+        }
+        if (!stats) continue;
+        stats->lines += pipe->chunks[c].invalid.count;
+        for (int s = 0; s < pipe->num_threads; s++) {
+            stats->lines += pipe->chunks[c].outbox[s].count;
+        }
+    }
+}
+
+// Merge the shards' distinct values by seq and replay them, in that
+// order, into the set the single-threaded loop would have filled
+static FunctionStatus pipeline_merge(pipeline *pipe, hash_set *hset, key_set *kset) {
+    int n = pipe->num_threads;
+    size_t *heads = calloc((size_t)n, sizeof(size_t));
+    int *heap = malloc((size_t)n * sizeof(int));
+    if (!heads || !heap) {
+        free(heads);
+        free(heap);
+        return MEMORY_ALLOCATION_ERR;
+    }
+
+#define SHARD_SEQ(s) (((pipeline_item *)pipe->shards[s].uniques.data)[heads[s]].seq)
+
+    // binary min-heap of shard numbers keyed by the seq of their head item
+    int heap_len = 0;
+    for (int s = 0; s < n; s++) {
+        if (pipe->shards[s].uniques.count == 0) continue;
+        int i = heap_len++;
+        while (i > 0 && SHARD_SEQ(heap[(i - 1) / 2]) > SHARD_SEQ(s)) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = s;
+    }
+
+    FunctionStatus rstat = RET_SUCCESS;
+    while (heap_len > 0) {
+        int s = heap[0];
+        uint32_t occurrences = pipe->shards[s].counts ? pipe->shards[s].counts[heads[s]] : 1;
+        pipeline_item *item = &((pipeline_item *)pipe->shards[s].uniques.data)[heads[s]++];
+        FunctionStatus istat = pipe->packed
+            ? key_set_insert_counted(kset, item->value.key, occurrences)
+            : hash_set_insert_counted(hset, item->value.str, item->len, item->hash, occurrences);
+        if (istat < 0) rstat = istat;
+
+        // drop the shard once drained, then sift the new root down
+        if (heads[s] == pipe->shards[s].uniques.count) s = heap[--heap_len];
+        int i = 0;
+        for (;;) {
+            int child = 2 * i + 1;
+            if (child >= heap_len) break;
+            if (child + 1 < heap_len && SHARD_SEQ(heap[child + 1]) < SHARD_SEQ(heap[child])) child++;
+            if (SHARD_SEQ(heap[child]) >= SHARD_SEQ(s)) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        if (heap_len > 0) heap[i] = s;
+    }
+
+#undef SHARD_SEQ
+
+    free(heads);
+    free(heap);
+    return rstat;
+}
+
+static void pipeline_free(pipeline *pipe) {
+    if (pipe->chunks) {
+        for (size_t c = 0; c < pipe->max_chunks; c++) {
+            if (pipe->chunks[c].outbox) {
+                for (int s = 0; s < pipe->num_threads; s++) free(pipe->chunks[c].outbox[s].data);
+            }
+            free(pipe->chunks[c].outbox);
+            free(pipe->chunks[c].invalid.data);
+        }
+    }
+    if (pipe->shards) {
+        for (int s = 0; s < pipe->num_threads; s++) {
+            hash_set_destroy(pipe->shards[s].hset);
+            key_set_destroy(pipe->shards[s].kset);
+            free(pipe->shards[s].uniques.data);
+            free(pipe->shards[s].counts);
+        }
+    }
+    free(pipe->chunks);
+    free(pipe->shards);
+}
+
+static FunctionStatus pipeline_init(pipeline *pipe, int packed, int counting, int num_threads) {
+    memset(pipe, 0, sizeof(pipeline));
+    pipe->packed = packed;
+    pipe->counting = counting;
+    pipe->num_threads = num_threads;
+    pipe->max_chunks = (size_t)num_threads * PIPELINE_CHUNKS_PER_THREAD;
+
+    pipe->chunks = calloc(pipe->max_chunks, sizeof(pipeline_chunk));
+    pipe->shards = calloc((size_t)num_threads, sizeof(pipeline_shard));
+    if (!pipe->chunks || !pipe->shards) return MEMORY_ALLOCATION_ERR;
+
+    for (size_t c = 0; c < pipe->max_chunks; c++) {
+        pipe->chunks[c].outbox = calloc((size_t)num_threads, sizeof(pipeline_vec));
+        if (!pipe->chunks[c].outbox) return MEMORY_ALLOCATION_ERR;
+    }
+    for (int s = 0; s < num_threads; s++) {
+        if (packed) {
+            pipe->shards[s].kset = key_set_create();
+            if (pipe->shards[s].kset && counting &&
+                key_set_count_occurrences(pipe->shards[s].kset) != RET_SUCCESS) {
+                return MEMORY_ALLOCATION_ERR;
+            }
+        } else {
+            pipe->shards[s].hset = hash_set_create();
+        }
+        if (!pipe->shards[s].hset && !pipe->shards[s].kset) return MEMORY_ALLOCATION_ERR;
+    }
+    return RET_SUCCESS;
+}
+
+FunctionStatus dedup_pipeline_run(line_reader *reader, int packed, int num_threads,
+                                  hash_set **hset, key_set **kset, dedup_stats *stats,
+                                  error_sink *errors) {
+    if (!reader || !hset || !kset) return NULL_INPUT_POINTER;
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > PIPELINE_MAX_THREADS) num_threads = PIPELINE_MAX_THREADS;
+
+    // hash sets always count, a key set only when asked to
+    int counting = packed ? *kset && (*kset)->counts : 1;
+    pipeline pipe;
+    FunctionStatus rstat = pipeline_init(&pipe, packed, counting, num_threads);
+    if (rstat != RET_SUCCESS) {
+        pipeline_free(&pipe);
+        return rstat;
+    }
+
+    // the calling thread coordinates the rounds and joins every barrier
+    pipeline_barrier_init(&pipe.round_start, (unsigned)num_threads + 1);
+    pipeline_barrier_init(&pipe.parsed, (unsigned)num_threads + 1);
+    pipeline_barrier_init(&pipe.round_end, (unsigned)num_threads + 1);
+
+    pthread_t *threads = malloc((size_t)num_threads * sizeof(pthread_t));
+    pipeline_worker *workers = malloc((size_t)num_threads * sizeof(pipeline_worker));
+    int started = 0;
+    if (threads && workers) {
+        for (; started < num_threads; started++) {
+            workers[started].pipe = &pipe;
+            workers[started].id = started;
+            if (pthread_create(&threads[started], NULL, pipeline_worker_main, &workers[started]) != 0) break;
+        }
+    }
+
+    if (started == num_threads) {
+        const char *block;
+        size_t len;
+        uint64_t next_id = 0;
+        size_t round_bytes = pipe.max_chunks * PIPELINE_CHUNK_SIZE;
+        double mark = dedup_stats_mark(stats);
+        while ((rstat = line_reader_next_block(reader, &block, &len, round_bytes)) == TRUE_STATUS) {
+            pipeline_split_block(&pipe, block, len, &next_id);
+            dedup_stats_lap(stats, DEDUP_STAGE_READ, &mark);
+            pipeline_barrier_wait(&pipe.round_start);
+            pipeline_barrier_wait(&pipe.parsed);
+            dedup_stats_lap(stats, DEDUP_STAGE_PARSE, &mark);
+            pipeline_barrier_wait(&pipe.round_end);
+            dedup_stats_lap(stats, DEDUP_STAGE_INSERT, &mark);
+            pipeline_report_invalid(&pipe, stats, errors);
+            dedup_stats_lap(stats, DEDUP_STAGE_PARSE, &mark);
+        }
+        if (rstat == FALSE_STATUS) rstat = RET_SUCCESS;
+    } else {
+        rstat = MEMORY_ALLOCATION_ERR;
+    }
+
+    // release the workers: with done set they leave at the next round,
+    // which only needs the threads that actually started
+    pipe.done = 1;
+    pipeline_barrier_set_parties(&pipe.round_start, (unsigned)started + 1);
+    pipeline_barrier_wait(&pipe.round_start);
+    for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+
+    pipeline_barrier_destroy(&pipe.round_start);
+    pipeline_barrier_destroy(&pipe.parsed);
+    pipeline_barrier_destroy(&pipe.round_end);
+    free(threads);
+    free(workers);
+
+    if (rstat == RET_SUCCESS) rstat = pipe.parse_status;
+    for (int s = 0; s < num_threads && rstat == RET_SUCCESS; s++) {
+        if (pipe.shards[s].status != RET_SUCCESS) rstat = pipe.shards[s].status;
+    }
+
+    if (rstat == RET_SUCCESS) {
+        // the shard sets are no longer needed, free them before the replay;
+        // their counts follow the uniques, which are in shard insertion order
+        for (int s = 0; s < num_threads && counting; s++) {
+            pipeline_shard *shard = &pipe.shards[s];
+            shard->counts = malloc((shard->uniques.count ? shard->uniques.count : 1) * sizeof(uint32_t));
+            if (!shard->counts) {
+                rstat = MEMORY_ALLOCATION_ERR;
+                break;
+            }
+            for (size_t i = 0; i < shard->uniques.count; i++) {
+                shard->counts[i] = packed ? key_set_get_count(shard->kset, i)
+                                          : hash_set_get_count(shard->hset, i);
+            }
+        }
+        for (int s = 0; s < num_threads; s++) {
+            hash_set_destroy(pipe.shards[s].hset);
+            key_set_destroy(pipe.shards[s].kset);
+            pipe.shards[s].hset = NULL;
+            pipe.shards[s].kset = NULL;
+        }
+    }
+    if (rstat == RET_SUCCESS) {
+        double mark = dedup_stats_mark(stats);
+        rstat = pipeline_merge(&pipe, *hset, *kset);
+        dedup_stats_lap(stats, DEDUP_STAGE_INSERT, &mark);
+    }
+
+    pipeline_free(&pipe);
+    return rstat;
+}
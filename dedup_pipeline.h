@@ -0,0 +1,39 @@
+#ifndef __dedup_pipeline_h__
+#define __dedup_pipeline_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "func_status.h"
+#include "hash_set.h"
+#include "key_set.h"
+#include "line_reader.h"
+#include "dedup_stats.h"
+#include "error_sink.h"
+
+#define PIPELINE_MAX_THREADS        256
+#define PIPELINE_CHUNK_SIZE         (1 << 20)   // input bytes per parse task
+#define PIPELINE_CHUNKS_PER_THREAD  4           // parse tasks per thread per round
+
+/* Multi-threaded dedup of everything left in reader.
+    Input is taken in rounds of newline-aligned chunks. In each round the
+    worker threads first parse and normalize chunks, routing every value
+    by hash to one of num_threads shards; then each thread inserts the
+    values of its own shard, chunk by chunk, so no set is ever shared and
+    no lock is taken. Invalid lines go to errors in input order at the end
+    of each round, as in the single-threaded loop.
+    The shards' distinct values are merged back into first-seen order and
+    appended to *hset (or *kset when packed), which therefore ends up
+    holding the same keys in the same order as after a single-threaded run.
+    The occurrence counts come out the same too: each value's count in
+    its shard is carried into the set, which for *kset happens only when
+    it was set counting with key_set_count_occurrences beforehand.
+    With stats, the coordinating thread times the phases of every round
+    (the merge counts as inserting) and counts the lines of each round.
+*/
+FunctionStatus dedup_pipeline_run(line_reader *reader, int packed, int num_threads,
+                                  hash_set **hset, key_set **kset, dedup_stats *stats,
+                                  error_sink *errors);
+
+#endif // __dedup_pipeline_h__
@@ -0,0 +1,115 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+#include <sys/resource.h>
+
+#include "dedup_stats.h"
+
+static const char* const dedup_stage_names[DEDUP_STAGE_COUNT] = {
+    "read", "parse", "insert", "sort", "write"
+};
+
+// Monotonic clock in seconds
+double dedup_stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Reset every counter and start the run clock
+void dedup_stats_init(dedup_stats *stats, int packed, int num_threads) {
+    if (!stats) return;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->packed = packed;
+    stats->num_threads = num_threads;
+    stats->start = dedup_stats_now();
+}
+
+// Write text as the body of a JSON string
+static void dedup_stats_print_string(FILE *ofile, const char *text, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            fprintf(ofile, "\\%c", c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            fprintf(ofile, "\\u%04x", c);
+        } else {
+            fputc(c, ofile);
+        }
+    }
+}
+
+// Print the report as one JSON object; the set that was used describes
+// its own shape, the other one may be NULL, and the invalid lines come
+// from the error sink
+void dedup_stats_print(FILE *ofile, const dedup_stats *stats, const error_sink *errors,
+                       hash_set *hset, key_set *kset) {
+    if (!ofile || !stats) return;
+
+    double total = dedup_stats_now() - stats->start;
+    uint64_t invalid = errors ? errors->total : 0;
+    size_t unique = stats->packed ? key_set_get_size(kset) : hash_set_get_size(hset);
+
+    fprintf(ofile, "{\n");
+    fprintf(ofile, "  \"mode\": \"%s\",\n", stats->packed ? "packed" : "string");
+    fprintf(ofile, "  \"threads\": %d,\n", stats->num_threads);
+    fprintf(ofile, "  \"lines\": %llu,\n", (unsigned long long)stats->lines);
+    fprintf(ofile, "  \"valid\": %llu,\n", (unsigned long long)(stats->lines - invalid));
+    fprintf(ofile, "  \"unique\": %zu,\n", unique);
+    fprintf(ofile, "  \"invalid\": %llu,\n", (unsigned long long)invalid);
+
+    fprintf(ofile, "  \"invalid_by_code\": {");
+    const char *sep = "";
+    for (int code = 1; code < ERROR_SINK_MAX_CODE && errors; code++) {
+        if (!errors->counts[code]) continue;
+        fprintf(ofile, "%s\"%d\": %llu", sep, -code, (unsigned long long)errors->counts[code]);
+        sep = ", ";
+    }
+    // statuses outside the counted range
+    if (errors && errors->counts[0]) {
+        fprintf(ofile, "%s\"other\": %llu", sep, (unsigned long long)errors->counts[0]);
+    }
+    fprintf(ofile, "},\n");
+
+    fprintf(ofile, "  \"invalid_sample\": [");
+    for (size_t i = 0; errors && i < errors->sample_count; i++) {
+        fprintf(ofile, "%s{\"line\": \"", i ? ", " : "");
+        dedup_stats_print_string(ofile, errors->samples[i].text, errors->samples[i].len);
+        fprintf(ofile, "\", \"code\": %d}", errors->samples[i].status);
+    }
+    fprintf(ofile, "],\n");
+
+    fprintf(ofile, "  \"seconds\": {");
+    for (int stage = 0; stage < DEDUP_STAGE_COUNT; stage++) {
+        fprintf(ofile, "\"%s\": %.3f, ", dedup_stage_names[stage], stats->stage_seconds[stage]);
+    }
+    fprintf(ofile, "\"total\": %.3f},\n", total);
+    fprintf(ofile, "  \"lines_per_sec\": %.0f,\n", total > 0 ? (double)stats->lines / total : 0.0);
+
+    if (stats->packed && kset) {
+        fprintf(ofile, "  \"key_set\": {\"slots\": %zu, \"load_factor\": %.3f, "
+                "\"longest_cluster\": %zu, \"memory_bytes\": %zu},\n",
+                kset->capacity, (double)kset->count / (double)kset->capacity,
+                key_set_longest_cluster(kset), key_set_memory_usage(kset));
+    } else if (!stats->packed && hset) {
+        hash_set_chain_stats chains;
+        hash_set_get_chain_stats(hset, &chains);
+        fprintf(ofile, "  \"hash_set\": {\"buckets\": %zu, \"load_factor\": %.3f, "
+                "\"used_buckets\": %zu, \"bucket_occupancy\": %.3f, \"longest_chain\": %zu, ",
+                chains.buckets, chains.buckets ? (double)hset->count / (double)chains.buckets : 0.0,
+                chains.used_buckets,
+                chains.buckets ? (double)chains.used_buckets / (double)chains.buckets : 0.0,
+                chains.longest_chain);
+        fprintf(ofile, "\"chain_lengths\": [");
+        for (int len = 0; len < HASH_SET_CHAIN_HISTOGRAM; len++) {
+            fprintf(ofile, "%s%zu", len ? ", " : "", chains.chain_lengths[len]);
+        }
+        fprintf(ofile, "], \"memory_bytes\": %zu},\n", hash_set_memory_usage(hset));
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(ofile, "  \"peak_rss_kb\": %ld\n", usage.ru_maxrss);
+    fprintf(ofile, "}\n");
+}
@@ -0,0 +1,55 @@
+#ifndef __dedup_stats_h__
+#define __dedup_stats_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+#include "hash_set.h"
+#include "key_set.h"
+#include "error_sink.h"
+
+typedef enum {
+    DEDUP_STAGE_READ,
+    DEDUP_STAGE_PARSE,
+    DEDUP_STAGE_INSERT,
+    DEDUP_STAGE_SORT,
+    DEDUP_STAGE_WRITE,
+    DEDUP_STAGE_COUNT
+} dedup_stage;
+
+/* Counters and stage timers of one run, reported by --stats.
+    The loops take a clock reading per batch of lines rather than per
+    line, and a NULL stats pointer turns every hook into a test of that
+    pointer, so the instrumentation costs nothing when it is off.
+*/
+typedef struct dedup_stats_struct {
+    double start;                               // monotonic seconds at init
+    double stage_seconds[DEDUP_STAGE_COUNT];
+    uint64_t lines;                             // non-blank lines
+    int packed;
+    int num_threads;
+} dedup_stats;
+
+// Function declarations
+void dedup_stats_init(dedup_stats *stats, int packed, int num_threads);
+double dedup_stats_now(void);
+void dedup_stats_print(FILE *ofile, const dedup_stats *stats, const error_sink *errors,
+                       hash_set *hset, key_set *kset);
+
+// Start a lap: the current time, or 0 without stats
+static inline double dedup_stats_mark(const dedup_stats *stats) {
+    return stats ? dedup_stats_now() : 0;
+}
+
+// Add the time since *mark to a stage and move *mark to now
+static inline void dedup_stats_lap(dedup_stats *stats, dedup_stage stage, double *mark) {
+    if (!stats) return;
+    double now = dedup_stats_now();
+    stats->stage_seconds[stage] += now - *mark;
+    *mark = now;
+}
+
+#endif // __dedup_stats_h__
@@ -0,0 +1,111 @@
+#include "error_sink.h"
+
+// Write the buffered rejects out
+static void error_sink_flush(error_sink *sink) {
+    if (sink->used && fwrite(sink->buffer, 1, sink->used, sink->rejects) != sink->used &&
+        sink->status == RET_SUCCESS) {
+        sink->status = FILE_IO_ERR;
+    }
+    sink->used = 0;
+}
+
+// Append one line to the rejects buffer
+static void error_sink_write_reject(error_sink *sink, const char *line, size_t len) {
+    if (sink->used + len + 1 > ERROR_SINK_BUFFER_SIZE) {
+        error_sink_flush(sink);
+        // a line longer than the whole buffer goes straight out
+        if (len + 1 > ERROR_SINK_BUFFER_SIZE) {
+            if ((fwrite(line, 1, len, sink->rejects) != len || fputc('\n', sink->rejects) == EOF) &&
+                sink->status == RET_SUCCESS) {
+                sink->status = FILE_IO_ERR;
+            }
+            return;
+        }
+    }
+    memcpy(sink->buffer + sink->used, line, len);
+    sink->used += len;
+    sink->buffer[sink->used++] = '\n';
+}
+
+// Create a sink printing up to max_warnings invalid lines to warn_out and,
+// with a rejects_path, writing every invalid line to that file
+// return the sink, or NULL if it or the rejects file cannot be created
+error_sink* error_sink_create(FILE *warn_out, size_t max_warnings, const char *rejects_path) {
+    error_sink *sink = calloc(1, sizeof(error_sink));
+    if (!sink) return NULL;
+
+    sink->warn_out = warn_out;
+    sink->max_warnings = max_warnings;
+    size_t num_samples = max_warnings < ERROR_SINK_MAX_SAMPLES ? max_warnings : ERROR_SINK_MAX_SAMPLES;
+    if (num_samples) {
+        sink->samples = malloc(num_samples * sizeof(error_sample));
+        if (!sink->samples) {
+            error_sink_destroy(sink);
+            return NULL;
+        }
+    }
+    if (rejects_path) {
+        sink->rejects = fopen(rejects_path, "w");
+        sink->buffer = malloc(ERROR_SINK_BUFFER_SIZE);
+        if (!sink->rejects || !sink->buffer) {
+            error_sink_destroy(sink);
+            return NULL;
+        }
+    }
+    return sink;
+}
+
+// Flush and close the rejects file and free the sink
+// return RET_SUCCESS, or FILE_IO_ERR if the rejects file was not fully written
+FunctionStatus error_sink_destroy(error_sink *sink) {
+    if (!sink) return RET_SUCCESS;
+
+    FunctionStatus rstat = RET_SUCCESS;
+    if (sink->rejects) {
+        if (sink->buffer) error_sink_flush(sink);
+        if (fclose(sink->rejects) != 0 && sink->status == RET_SUCCESS) sink->status = FILE_IO_ERR;
+        rstat = sink->status;
+    }
+    free(sink->samples);
+    free(sink->buffer);
+    free(sink);
+    return rstat;
+}
+
+// Record an invalid line: count it, print and sample it while under the
+// warning limit, and append it to the rejects file if there is one
+void error_sink_add(error_sink *sink, const char *line, size_t len, FunctionStatus status) {
+    if (!sink) return;
+
+    int code = -(int)status;
+    sink->counts[code > 0 && code < ERROR_SINK_MAX_CODE ? code : 0]++;
+    if (sink->total++ < sink->max_warnings) {
+        fprintf(sink->warn_out, "Warning: Invalid datetime format '%.*s' (error code: %d)\n",
+                (int)len, line, status);
+        if (sink->sample_count < ERROR_SINK_MAX_SAMPLES) {
+            error_sample *sample = &sink->samples[sink->sample_count++];
+            sample->len = len < ERROR_SINK_SAMPLE_LEN ? len : ERROR_SINK_SAMPLE_LEN;
+            memcpy(sample->text, line, sample->len);
+            sample->status = status;
+        }
+    }
+    if (sink->rejects) error_sink_write_reject(sink, line, len);
+}
+
+// Report the invalid lines that were counted but not printed
+void error_sink_summary(error_sink *sink) {
+    if (!sink || sink->total <= sink->max_warnings) return;
+
+    fprintf(sink->warn_out, "Warning: %llu invalid lines, %llu not shown (",
+            (unsigned long long)sink->total, (unsigned long long)(sink->total - sink->max_warnings));
+    const char *sep = "";
+    for (int code = 1; code < ERROR_SINK_MAX_CODE; code++) {
+        if (!sink->counts[code]) continue;
+        fprintf(sink->warn_out, "%serror code %d: %llu", sep, -code, (unsigned long long)sink->counts[code]);
+        sep = ", ";
+    }
+    if (sink->counts[0]) {
+        fprintf(sink->warn_out, "%sother: %llu", sep, (unsigned long long)sink->counts[0]);
+    }
+    fprintf(sink->warn_out, ")\n");
+}
@@ -0,0 +1,54 @@
+#ifndef __error_sink_h__
+#define __error_sink_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+
+#define ERROR_SINK_MAX_CODE         32          // counted codes -1 .. -31, others as "other"
+#define ERROR_SINK_DEFAULT_WARNINGS 10          // invalid lines printed when no limit is given
+#define ERROR_SINK_MAX_SAMPLES      100         // printed lines also kept for --stats
+#define ERROR_SINK_SAMPLE_LEN       64          // bytes kept of each sampled line
+#define ERROR_SINK_BUFFER_SIZE      (1 << 20)   // rejects file bytes per write
+
+// A sampled invalid line
+typedef struct error_sample_struct {
+    char text[ERROR_SINK_SAMPLE_LEN];
+    size_t len;             // bytes in text, the line may have been longer
+    FunctionStatus status;
+} error_sample;
+
+/* Collects the invalid lines of a run.
+    Each line is counted under its status code. The first max_warnings
+    lines are printed to warn_out as they arrive, and up to
+    ERROR_SINK_MAX_SAMPLES of them are kept as a sample for --stats; the
+    rest are only counted, and error_sink_summary reports how many
+    were not shown. With a rejects file every invalid line is appended to
+    a large buffer that is written out when full, so even an input made
+    mostly of garbage costs a memcpy per bad line rather than a printf.
+    A sink is used by one thread; the -j pipeline feeds it from the
+    coordinating thread.
+*/
+typedef struct error_sink_struct {
+    FILE *warn_out;
+    size_t max_warnings;
+    uint64_t counts[ERROR_SINK_MAX_CODE];   // by -status, other codes in [0]
+    uint64_t total;
+    error_sample *samples;                  // the first printed lines
+    size_t sample_count;
+    FILE *rejects;                          // NULL without a rejects file
+    char *buffer;
+    size_t used;
+    FunctionStatus status;                  // first rejects write error
+} error_sink;
+
+// Function declarations
+error_sink* error_sink_create(FILE *warn_out, size_t max_warnings, const char *rejects_path);
+FunctionStatus error_sink_destroy(error_sink *sink);
+void error_sink_add(error_sink *sink, const char *line, size_t len, FunctionStatus status);
+void error_sink_summary(error_sink *sink);
+
+#endif // __error_sink_h__
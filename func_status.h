@@ -32,6 +32,7 @@ typedef enum  {
 
     NULL_INPUT_POINTER    = -20,
     MEMORY_ALLOCATION_ERR = -21,
+    FILE_IO_ERR           = -22,
 
 } FunctionStatus;
 
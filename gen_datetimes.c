@@ -0,0 +1,206 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+
+/* Synthetic input generator for benchmarks.
+    Writes one datetime per line until a line count or a byte size is
+    reached, so inputs of tens of GB can be produced without holding
+    them anywhere. The mix is controlled by
+        -d  share of lines repeating an earlier value
+        -z  weights of local, UTC ("Z") and +hh:mm offset values
+        -i  share of invalid lines
+    Output is deterministic for a given seed.
+*/
+
+#define GEN_POOL_SIZE       (1 << 16)   // earlier values duplicates are drawn from
+#define GEN_BUFFER_SIZE     (1 << 20)
+#define GEN_MIN_SECONDS     62167219200LL   // 1970-01-01 since 0000-01-01
+#define GEN_SPAN_SECONDS    4102444800LL    // up to 2100-01-01
+
+typedef struct gen_options_struct {
+    unsigned long long lines;   // 0 when bounded by size
+    unsigned long long size;    // 0 when bounded by lines
+    double dup_ratio;
+    double invalid_ratio;
+    unsigned tz_weight[3];      // local, UTC, offset
+    uint64_t seed;
+} gen_options;
+
+static const char* const gen_offsets[] = {
+    "+01:00", "+02:00", "-05:00", "-08:00", "+05:30", "+09:00",
+    "+05:45", "-03:30", "+14:00", "-12:00", "+00:00", "-00:30"
+};
+
+static const char* const gen_invalid[] = {
+    "not-a-date", "2023-13-25T10:30:45Z", "2023-12-32T10:30:45Z",
+    "2023-12-25T25:30:45Z", "2023-12-25T10:65:45Z", "2023-12-25T10:30:65Z",
+    "2023-12-25", "2023/12/25T10:30:45Z", "2023-12-25T10:30:45+15:00",
+    "2023-12-25T10:30:45+05:75", "2023-12-25T10:30:45X", "abc123"
+};
+
+#define GEN_COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+// splitmix64, small and good enough for test data
+static uint64_t gen_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// uniform double in [0, 1)
+static double gen_unit(uint64_t *state) {
+    return (double)(gen_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Civil date of a day count since 0000-01-01, so every value is a real date
+static void gen_civil(long long days, int *year, int *month, int *day) {
+    days -= 60; // shift to 0000-03-01, leap day at the end of the era
+    long long era = (days >= 0 ? days : days - 146096) / 146097;
+    long long doe = days - era * 146097;
+    long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long long mp = (5 * doy + 2) / 153;
+    *day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *year = (int)(yoe + era * 400 + (*month <= 2));
+}
+
+static char* gen_put2(char *out, int value) {
+    out[0] = (char)('0' + value / 10);
+    out[1] = (char)('0' + value % 10);
+    return out + 2;
+}
+
+// Format a fresh valid value into out
+// return its length
+static int gen_valid(uint64_t *state, const gen_options *opt, char *out) {
+    long long seconds = GEN_MIN_SECONDS + (long long)(gen_next(state) % GEN_SPAN_SECONDS);
+    int year, month, day;
+    gen_civil(seconds / 86400, &year, &month, &day);
+    int rem = (int)(seconds % 86400);
+
+    // sprintf would dominate the run time of multi-GB inputs
+    char *p = gen_put2(out, year / 100 % 100);
+    p = gen_put2(p, year % 100);
+    *p++ = '-';
+    p = gen_put2(p, month);
+    *p++ = '-';
+    p = gen_put2(p, day);
+    *p++ = 'T';
+    p = gen_put2(p, rem / 3600);
+    *p++ = ':';
+    p = gen_put2(p, rem / 60 % 60);
+    *p++ = ':';
+    p = gen_put2(p, rem % 60);
+    int n = (int)(p - out);
+
+    unsigned total = opt->tz_weight[0] + opt->tz_weight[1] + opt->tz_weight[2];
+    unsigned pick = total ? (unsigned)(gen_next(state) % total) : 0;
+    if (pick < opt->tz_weight[0]) return n;
+    if (pick < opt->tz_weight[0] + opt->tz_weight[1]) {
+        out[n] = 'Z';
+        return n + 1;
+    }
+    const char *offset = gen_offsets[gen_next(state) % GEN_COUNT(gen_offsets)];
+    memcpy(out + n, offset, 6);
+    return n + 6;
+}
+
+// Parse a count with an optional K, M or G suffix
+static unsigned long long gen_parse_size(const char *text) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+    default: break;
+    }
+    return *end == '\0' ? value : 0;
+}
+
+static void gen_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] > input.txt\n", prog);
+    fprintf(stderr, "  -n LINES     number of lines (K, M, G suffixes)\n");
+    fprintf(stderr, "  -s BYTES     stop once this much was written instead (K, M, G suffixes)\n");
+    fprintf(stderr, "  -d RATIO     share of lines repeating an earlier value (default 0.5)\n");
+    fprintf(stderr, "  -z L,U,O     weights of local, UTC and offset values (default 40,40,20)\n");
+    fprintf(stderr, "  -i RATIO     share of invalid lines (default 0.01)\n");
+    fprintf(stderr, "  -r SEED      random seed (default 1)\n");
+}
+
+int main(int argc, char *argv[]) {
+    gen_options opt = { 0, 0, 0.5, 0.01, { 40, 40, 20 }, 1 };
+
+    int c;
+    while ((c = getopt(argc, argv, "n:s:d:z:i:r:")) != -1) {
+        switch (c) {
+        case 'n': opt.lines = gen_parse_size(optarg); break;
+        case 's': opt.size = gen_parse_size(optarg); break;
+        case 'd': opt.dup_ratio = atof(optarg); break;
+        case 'i': opt.invalid_ratio = atof(optarg); break;
+        case 'r': opt.seed = strtoull(optarg, NULL, 10); break;
+        case 'z':
+            if (sscanf(optarg, "%u,%u,%u", &opt.tz_weight[0], &opt.tz_weight[1],
+                       &opt.tz_weight[2]) != 3) {
+                gen_usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            gen_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!opt.lines && !opt.size) opt.lines = 1000000;
+
+    char (*pool)[32] = calloc(GEN_POOL_SIZE, sizeof(*pool));
+    char *buffer = malloc(GEN_BUFFER_SIZE);
+    if (!pool || !buffer) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 1;
+    }
+
+    uint64_t state = opt.seed;
+    size_t pool_count = 0;
+    size_t used = 0;
+    unsigned long long written = 0;
+    for (unsigned long long line = 0; opt.lines ? line < opt.lines : written < opt.size; line++) {
+        char *out = buffer + used;
+        int n;
+        double roll = gen_unit(&state);
+        if (roll < opt.invalid_ratio) {
+            const char *bad = gen_invalid[gen_next(&state) % GEN_COUNT(gen_invalid)];
+            n = (int)strlen(bad);
+            memcpy(out, bad, (size_t)n);
+        } else if (pool_count && roll < opt.invalid_ratio + opt.dup_ratio) {
+            const char *old = pool[gen_next(&state) % pool_count];
+            n = (int)strlen(old);
+            memcpy(out, old, (size_t)n);
+        } else {
+            n = gen_valid(&state, &opt, out);
+            out[n] = '\0';
+            // fill the pool first, then replace values at random
+            size_t slot = pool_count < GEN_POOL_SIZE ? pool_count++ : gen_next(&state) % GEN_POOL_SIZE;
+            memcpy(pool[slot], out, (size_t)n + 1);
+        }
+        out[n] = '\n';
+        used += (size_t)n + 1;
+        written += (unsigned long long)n + 1;
+
+        if (used > GEN_BUFFER_SIZE - 64) {
+            if (fwrite(buffer, 1, used, stdout) != used) return 1;
+            used = 0;
+        }
+    }
+    if (fwrite(buffer, 1, used, stdout) != used) return 1;
+
+    free(pool);
+    free(buffer);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
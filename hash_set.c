@@ -1,30 +1,204 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "hash_set.h"
+#include "datetime_util.h"
 
-// Simple hash function using djb2 algorithm
-static unsigned int hash_function_djb2(const char *key, size_t size) {
-    unsigned int hash = 5381;
-    int c;
-    
-    while ((c = *key++)) {
-        hash = ((hash << 5) + hash) + c; // hash * 33 + c
+#define HASH_K0 0xa0761d6478bd642fULL
+#define HASH_K1 0xe7037ed1a0b428dbULL
+#define HASH_K2 0x8ebc6af09c88c6e3ULL
+
+static uint64_t hash_seed_value;    // 0 until the first hash is taken
+
+// Fold the 128-bit product of a and b into 64 bits
+static inline uint64_t hash_mum(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t hash_load64(const char *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static inline uint64_t hash_load32(const char *p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Random seed for the process, from /dev/urandom or else from the clock
+// and the address space layout
+static uint64_t hash_random_seed(void) {
+    uint64_t seed = 0;
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd >= 0) {
+        if (read(fd, &seed, sizeof(seed)) != (ssize_t)sizeof(seed)) seed = 0;
+        close(fd);
     }
-    
-    return hash % size;
+    if (!seed) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        seed = hash_mum((uint64_t)ts.tv_nsec ^ HASH_K0, (uint64_t)(uintptr_t)&ts ^ (uint64_t)getpid());
+    }
+    return seed | 1;
+}
+
+// The process seed; threads racing to set it agree on the first one stored
+static inline uint64_t hash_seed(void) {
+    uint64_t seed = __atomic_load_n(&hash_seed_value, __ATOMIC_ACQUIRE);
+    if (seed) return seed;
+
+    uint64_t expected = 0;
+    seed = hash_random_seed();
+    if (!__atomic_compare_exchange_n(&hash_seed_value, &expected, seed, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        seed = expected;
+    }
+    return seed;
+}
+
+// Seeded hash of a string, read 8 bytes at a time.
+// Normalized datetimes are 19 to 30 bytes: one 16-byte round, then two
+// overlapping loads cover the tail without a byte loop.
+// Anything kept across processes, such as a saved sketch, needs a fixed
+// seed; the sets use the random per-process one through hash_set_hash.
+uint64_t hash_set_hash_seeded(const char *key, size_t len, uint64_t seed) {
+    uint64_t h = seed ^ ((uint64_t)len * HASH_K0);
+    const char *p = key;
+    size_t n = len;
+    while (n > 16) {
+        h = hash_mum(hash_load64(p) ^ HASH_K1, hash_load64(p + 8) ^ h);
+        p += 16;
+        n -= 16;
+    }
+
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (n > 8) {
+        a = hash_load64(p);
+        b = hash_load64(p + n - 8);
+    } else if (n >= 4) {
+        a = hash_load32(p);
+        b = hash_load32(p + n - 4);
+    } else if (n > 0) {
+        a = ((uint64_t)(unsigned char)p[0] << 16) | ((uint64_t)(unsigned char)p[n >> 1] << 8) |
+            (unsigned char)p[n - 1];
+    }
+    h = hash_mum(a ^ HASH_K1, b ^ h);
+    return hash_mum(h ^ HASH_K2, (uint64_t)len ^ HASH_K1);
+}
+
+uint64_t hash_set_hash(const char *key, size_t len) {
+    return hash_set_hash_seeded(key, len, hash_seed());
+}
+
+// Node of index (0-based) i
+static inline hash_node* hash_set_node(hash_set *set, size_t i) {
+    return &set->node_blocks[i >> HASH_SET_NODE_BLOCK_SHIFT][i & (HASH_SET_NODE_BLOCK - 1)];
+}
+
+// Look for a key in one bucket chain
+// return the node index + 1, or 0 if absent; the chain length walked
+// is stored in *chain_len when not NULL
+static uint32_t hash_chain_find(hash_set *set, uint32_t current, const char *key, size_t len,
+                                uint32_t hash, size_t *chain_len) {
+    size_t walked = 0;
+    while (current) {
+        hash_node *node = hash_set_node(set, current - 1);
+        // the stored hash rules out nearly every other key without
+        // touching the key arena
+        if (node->hash == hash && node->key_len == len && memcmp(node->key, key, len) == 0) {
+            return current;
+        }
+        current = node->next;
+        walked++;
+    }
+    if (chain_len) *chain_len = walked;
+    return 0;
+}
+
+// Move up to HASH_SET_REHASH_STEP old buckets into the new table
+static void hash_set_rehash_step(hash_set *set) {
+    if (!set->old_buckets) return;
+
+    size_t end = set->rehash_index + HASH_SET_REHASH_STEP;
+    if (end > set->old_size) end = set->old_size;
+
+    for (; set->rehash_index < end; set->rehash_index++) {
+        uint32_t current = set->old_buckets[set->rehash_index];
+        while (current) {
+            hash_node *node = hash_set_node(set, current - 1);
+            uint32_t next = node->next;
+            size_t index = node->hash & (set->size - 1);
+            node->next = set->buckets[index];
+            set->buckets[index] = current;
+            current = next;
+        }
+        set->old_buckets[set->rehash_index] = 0;
+    }
+
+    // all old buckets drained
+    if (set->rehash_index == set->old_size) {
+        free(set->old_buckets);
+        set->old_buckets = NULL;
+        set->old_size = 0;
+        set->rehash_index = 0;
+    }
+}
+
+// Start growing into a table twice the size
+// the old table is drained by hash_set_rehash_step on later inserts
+static void hash_set_start_rehash(hash_set *set) {
+    if (set->old_buckets) return; // already growing
+
+    uint32_t *new_buckets = calloc(set->size * 2, sizeof(uint32_t));
+    // keep working with longer chains if the table cannot grow
+    if (!new_buckets) return;
+
+    set->old_buckets = set->buckets;
+    set->old_size = set->size;
+    set->rehash_index = 0;
+    set->buckets = new_buckets;
+    set->size *= 2;
+}
+
+// Carve the next node, starting a new node block when needed
+static hash_node* hash_set_new_node(hash_set *set) {
+    size_t block = set->count >> HASH_SET_NODE_BLOCK_SHIFT;
+    if (block == set->node_block_count) {
+        // the block table is tiny, one pointer per 16K keys
+        hash_node **blocks = realloc(set->node_blocks, (block + 1) * sizeof(hash_node*));
+        if (!blocks) return NULL;
+        set->node_blocks = blocks;
+
+        blocks[block] = arena_alloc(&set->node_arena, HASH_SET_NODE_BLOCK * sizeof(hash_node),
+                                    sizeof(void*));
+        if (!blocks[block]) return NULL;
+        set->node_block_count++;
+    }
+    return hash_set_node(set, set->count);
 }
 
 // Create a new hash set
 // return a pointer to the created hash set, or NULL on failure
 hash_set* hash_set_create(void) {
-    hash_set *set = malloc(sizeof(hash_set));
+    hash_set *set = calloc(1, sizeof(hash_set));
     if (!set) return NULL;
     
     // create buckets
-    set->size = HASH_SET_SIZE;
-    set->buckets = calloc(set->size, sizeof(hash_node*));
+    set->size = HASH_SET_INITIAL_SIZE;
+    set->buckets = calloc(set->size, sizeof(uint32_t));
+    arena_init(&set->node_arena, HASH_SET_NODE_BLOCK * sizeof(hash_node));
+    arena_init(&set->key_arena, HASH_SET_KEY_BLOCK_SIZE);
     
     // fail check
     if (!set->buckets) {
-        free(set);
+        hash_set_destroy(set);
         return NULL;
     }
     
@@ -35,57 +209,87 @@ hash_set* hash_set_create(void) {
 void hash_set_destroy(hash_set *set) {
     if (!set) return;
     
-    for (size_t i = 0; i < set->size; i++) {
-        hash_node *current = set->buckets[i];
-        // destroy the linked list node by node
-        while (current) {
-            hash_node *temp = current;
-            current = current->next;
-            free(temp->key);
-            free(temp);
-        }
-    }
-    
+    free(set->old_buckets);
     free(set->buckets);
+    free(set->node_blocks);
+    arena_destroy(&set->node_arena);
+    arena_destroy(&set->key_arena);
     free(set);
 }
 
 // Insert a string into the hash set
-// return: RET_C: successfully inserted
-//         0: already exists 
-//        -1: error 
+// return: TRUE_STATUS: successfully inserted
+//         FALSE_STATUS: already exists 
+//         negative: error 
 FunctionStatus  hash_set_insert(hash_set *set, const char *key) {
     if (!set || !key) return NULL_INPUT_POINTER;
-    
-    // compute hash value
-    unsigned int hash_value = hash_function_djb2(key, set->size);
 
-    // locate the bucket
-    hash_node *current = set->buckets[hash_value];
+    size_t len = strlen(key);
+    return hash_set_insert_hashed(set, key, len, hash_set_hash(key, len));
+}
 
-    // check for appearance
-    while (current) {
-        if (strcmp(current->key, key) == 0) {
-            return FALSE_STATUS; // already has the key, do not insert
-        }
-        current = current->next;
+// Add occurrences to the count of node i, saturating at UINT32_MAX
+static inline void hash_set_count_node(hash_set *set, uint32_t i, uint32_t occurrences) {
+    hash_node *node = hash_set_node(set, i);
+    node->count = node->count > UINT32_MAX - occurrences ? UINT32_MAX : node->count + occurrences;
+}
+
+// Insert a key of len bytes whose hash_set_hash is already known
+// return: as hash_set_insert
+FunctionStatus  hash_set_insert_hashed(hash_set *set, const char *key, size_t len, uint64_t hash) {
+    return hash_set_insert_counted(set, key, len, hash, 1);
+}
+
+// Insert a key seen occurrences times, as hash_set_insert_hashed would
+// that many times; merging sets uses it to carry their counts over
+// return: as hash_set_insert
+FunctionStatus  hash_set_insert_counted(hash_set *set, const char *key, size_t len, uint64_t hash,
+                                        uint32_t occurrences) {
+    if (!set || !key) return NULL_INPUT_POINTER;
+
+    // check for appearance in the table being drained
+    uint32_t hash32 = (uint32_t)hash;
+    uint32_t found;
+    if (set->old_buckets &&
+        (found = hash_chain_find(set, set->old_buckets[hash32 & (set->old_size - 1)], key, len, hash32, NULL))) {
+        hash_set_count_node(set, found - 1, occurrences);
+        return FALSE_STATUS; // already has the key, do not insert
     }
 
-    // Create new node
-    hash_node *new_node = malloc(sizeof(hash_node));
-    if (!new_node) return MEMORY_ALLOCATION_ERR;
-    
-    new_node->key = malloc(strlen(key) + 1);
-    if (!new_node->key) {
-        free(new_node);
-        return MEMORY_ALLOCATION_ERR;
+    // locate the bucket
+    size_t index = hash32 & (set->size - 1);
+    size_t chain_len;
+    if ((found = hash_chain_find(set, set->buckets[index], key, len, hash32, &chain_len))) {
+        hash_set_count_node(set, found - 1, occurrences);
+        return FALSE_STATUS; // already has the key, do not insert
     }
 
-    strcpy(new_node->key, key);
+    // buckets hold 32-bit node numbers
+    if (set->count >= UINT32_MAX) return MEMORY_ALLOCATION_ERR;
+    hash_node *new_node = hash_set_new_node(set);
+    char *record = arena_alloc(&set->key_arena, len + 1, 1);
+    if (!new_node || !record) return MEMORY_ALLOCATION_ERR;
+
+    // Only new keys move the rehash along, so the table layout depends
+    // on the sequence of distinct keys alone and not on the duplicates
+    hash_set_rehash_step(set);
+
+    // Append the key record to the arena
+    memcpy(record, key, len);
+    record[len] = '\n';
+    new_node->key = record;
+    new_node->key_len = (uint32_t)len;
+    new_node->hash = hash32;
+    new_node->count = occurrences;
     
     // Insert at the beginning of the chain
-    new_node->next = set->buckets[hash_value];
-    set->buckets[hash_value] = new_node;
+    new_node->next = set->buckets[index];
+    set->buckets[index] = (uint32_t)(++set->count);
+
+    // grow by load factor, or early when one chain gets too long
+    if (set->count > set->size * LOAD_FACTOR_THRESHOLD || chain_len >= NUM_COLID_KEY) {
+        hash_set_start_rehash(set);
+    }
     
     return TRUE_STATUS;
 }
@@ -96,73 +300,232 @@ FunctionStatus  hash_set_insert(hash_set *set, const char *key) {
 FunctionStatus  hash_set_contains(hash_set *set, const char *key) {
     if (!set || !key) return NULL_INPUT_POINTER;
 
-    unsigned int index = hash_function_djb2(key, set->size);
-    hash_node *current = set->buckets[index];
+    size_t len = strlen(key);
+    return hash_set_contains_hashed(set, key, len, hash_set_hash(key, len));
+}
 
-    // Traverse the linked list at this bucket
-    while (current) {
-        if (strcmp(current->key, key) == 0) {
-            return TRUE_STATUS;
-        }
-        current = current->next;
+// Check for a key of len bytes whose hash_set_hash is already known
+// return: as hash_set_contains
+FunctionStatus  hash_set_contains_hashed(hash_set *set, const char *key, size_t len, uint64_t hash) {
+    if (!set || !key) return NULL_INPUT_POINTER;
+
+    uint32_t hash32 = (uint32_t)hash;
+    if (set->old_buckets &&
+        hash_chain_find(set, set->old_buckets[hash32 & (set->old_size - 1)], key, len, hash32, NULL)) {
+        return TRUE_STATUS;
+    }
+
+    if (hash_chain_find(set, set->buckets[hash32 & (set->size - 1)], key, len, hash32, NULL)) {
+        return TRUE_STATUS;
     }
     
     return FALSE_STATUS;
 }
 
-// Print all elements in the hash set
+// Prefetch the bucket of a hash, and while growing its old bucket too
+static inline void hash_set_prefetch_bucket(const hash_set *set, uint32_t hash) {
+    __builtin_prefetch(&set->buckets[hash & (set->size - 1)]);
+    if (set->old_buckets) __builtin_prefetch(&set->old_buckets[hash & (set->old_size - 1)]);
+}
+
+// Prefetch the node heading the bucket of a hash, once the bucket is cached
+static inline void hash_set_prefetch_node(hash_set *set, uint32_t hash) {
+    uint32_t head = set->buckets[hash & (set->size - 1)];
+    if (head) __builtin_prefetch(hash_set_node(set, head - 1));
+}
+
+// Insert or look up count keys, HASH_SET_BATCH at a time: the slice is
+// hashed first, then walked with the bucket of key i +
+// HASH_SET_PREFETCH_DISTANCE and the head node of key i +
+// HASH_SET_PREFETCH_DISTANCE / 2 already on their way, so the cache
+// misses of the slice overlap. lens may be NULL for NUL-terminated keys.
+// An insert stops at the first key that fails.
+static FunctionStatus hash_set_batch(hash_set *set, const char *const *keys, const size_t *lens,
+                                     size_t count, FunctionStatus *results, int insert) {
+    if (!set || (!keys && count)) return NULL_INPUT_POINTER;
+
+    uint64_t hashes[HASH_SET_BATCH];
+    size_t key_lens[HASH_SET_BATCH];
+    const size_t far = HASH_SET_PREFETCH_DISTANCE;
+    const size_t near = HASH_SET_PREFETCH_DISTANCE / 2;
+    for (size_t base = 0; base < count; base += HASH_SET_BATCH) {
+        size_t n = count - base < HASH_SET_BATCH ? count - base : HASH_SET_BATCH;
+        for (size_t i = 0; i < n; i++) {
+            if (!keys[base + i]) return NULL_INPUT_POINTER;
+            key_lens[i] = lens ? lens[base + i] : strlen(keys[base + i]);
+            hashes[i] = hash_set_hash(keys[base + i], key_lens[i]);
+            if (i < far) hash_set_prefetch_bucket(set, (uint32_t)hashes[i]);
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            if (i + far < n) hash_set_prefetch_bucket(set, (uint32_t)hashes[i + far]);
+            if (i + near < n) hash_set_prefetch_node(set, (uint32_t)hashes[i + near]);
+
+            const char *key = keys[base + i];
+            FunctionStatus rstat = insert
+                ? hash_set_insert_hashed(set, key, key_lens[i], hashes[i])
+                : hash_set_contains_hashed(set, key, key_lens[i], hashes[i]);
+            if (results) results[base + i] = rstat;
+            if (rstat < 0) return rstat;
+        }
+    }
+    return RET_SUCCESS;
+}
+
+// Insert count keys of the given lengths (NULL lens: NUL-terminated keys)
+// with the bucket fetches of the batch overlapped. results, when not
+// NULL, receives the status of each key as returned by hash_set_insert.
+// return RET_SUCCESS, or the error of the first key that failed; the
+// keys after it are not inserted and their results not written
+FunctionStatus  hash_set_insert_batch(hash_set *set, const char *const *keys, const size_t *lens,
+                                      size_t count, FunctionStatus *results) {
+    return hash_set_batch(set, keys, lens, count, results, 1);
+}
+
+// Look up count keys like hash_set_insert_batch; results[i] is set as
+// hash_set_contains would return for keys[i]
+// return RET_SUCCESS, or a negative status on failure
+FunctionStatus  hash_set_contains_batch(hash_set *set, const char *const *keys, const size_t *lens,
+                                        size_t count, FunctionStatus *results) {
+    if (!results) return NULL_INPUT_POINTER;
+    return hash_set_batch(set, keys, lens, count, results, 0);
+}
+
+// Print all elements in the hash set, in the order they were first inserted
 void hash_set_print(FILE *ofile, hash_set *set) {
     if (!set) return;
     
     if (ofile == NULL) {
-        printf("Hash Set Contents (%zu elements):\n", set->size);
-        for (size_t i = 0; i < set->size; i++) {
-            hash_node *current = set->buckets[i];
-            while (current) {
-                printf("  \"%s\"\n", current->key);
-                current = current->next;
-            }
+        printf("Hash Set Contents (%zu elements):\n", set->count);
+        for (size_t i = 0; i < set->count; i++) {
+            hash_node *node = hash_set_node(set, i);
+            printf("  \"%.*s\"\n", (int)node->key_len, node->key);
         }
     } else {
-        // fprintf(ofile, "Hash Set Contents (%zu elements):\n", set->size);
-        for (size_t i = 0; i < set->size; i++) {
-            hash_node *current = set->buckets[i];
-            while (current) {
-                fprintf(ofile, "%s\n", current->key);
-                current = current->next;
-            }
+        // the key arena already holds the output, newlines included
+        for (arena_block *block = set->key_arena.head; block; block = block->next) {
+            fwrite(block->data, 1, block->used, ofile);
+        }
+    }
+}
+
+// Write every key as a "key,count" line, where count is the number of
+// times it was inserted; the keys follow insertion order, or the node
+// order given in order when it is not NULL
+void hash_set_print_counts(FILE *ofile, hash_set *set, const uint32_t *order) {
+    if (!set || !ofile) return;
+
+    // build the lines in a buffer, one fwrite per buffer full; a key too
+    // long for the buffer is written on its own
+    char buffer[HASH_SET_PRINT_BUFFER];
+    size_t used = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        hash_node *node = hash_set_node(set, order ? order[i] : i);
+        size_t line_max = node->key_len + DT_COUNT_SUFFIX_MAX;
+        if (sizeof(buffer) - used < line_max) {
+            fwrite(buffer, 1, used, ofile);
+            used = 0;
+        }
+        if (line_max > sizeof(buffer)) {
+            fwrite(node->key, 1, node->key_len, ofile);
+        } else {
+            memcpy(buffer + used, node->key, node->key_len);
+            used += node->key_len;
         }
+        used += (size_t)dt_format_count_suffix(node->count, buffer + used);
     }
+    fwrite(buffer, 1, used, ofile);
 }
 
-// Get the size of the hash set
+// Number of times the i-th distinct key was inserted, 0 past the last key
+uint32_t hash_set_get_count(hash_set *set, size_t i) {
+    return set && i < set->count ? hash_set_node(set, i)->count : 0;
+}
+
+// Get the number of keys in the hash set
 size_t hash_set_get_size(hash_set *set) {
-    return set ? set->size : 0;
+    return set ? set->count : 0;
 }
 
-// Convert hash set to array of strings
+// Bytes held by the set: tables, node blocks and key blocks
+size_t hash_set_memory_usage(hash_set *set) {
+    if (!set) return 0;
+
+    return sizeof(hash_set)
+         + (set->size + (set->old_buckets ? set->old_size : 0)) * sizeof(uint32_t)
+         + set->node_block_count * sizeof(hash_node*)
+         + set->node_arena.reserved
+         + set->key_arena.reserved;
+}
+
+// Convert hash set to array of strings, in insertion order
 char** hash_set_to_array(hash_set *set, size_t *count) {
     if (!set || !count) return NULL;
     
-    *count = set->size;
-    if (set->size == 0) return NULL;
+    *count = set->count;
+    if (set->count == 0) return NULL;
     
-    char **array = malloc(set->size * sizeof(char*));
+    char **array = malloc(set->count * sizeof(char*));
     if (!array) return NULL;
     
     size_t index = 0;
-    for (size_t i = 0; i < set->size; i++) {
-        hash_node *current = set->buckets[i];
-        while (current) {
-            array[index] = malloc(strlen(current->key) + 1);
-            if (array[index]) {
-                strcpy(array[index], current->key);
-                index++;
-            }
-            current = current->next;
+    for (size_t i = 0; i < set->count; i++) {
+        hash_node *node = hash_set_node(set, i);
+        array[index] = malloc(node->key_len + 1);
+        if (array[index]) {
+            memcpy(array[index], node->key, node->key_len);
+            array[index][node->key_len] = '\0';
+            index++;
         }
     }
+    *count = index;
     
     return array;
 }
 
+// List the keys as views into the key arena, in insertion order
+// only the returned array is allocated, the caller frees it
+hash_set_view* hash_set_to_views(hash_set *set, size_t *count) {
+    if (!set || !count) return NULL;
+
+    *count = set->count;
+    if (set->count == 0) return NULL;
+
+    hash_set_view *views = malloc(set->count * sizeof(hash_set_view));
+    if (!views) return NULL;
+
+    for (size_t i = 0; i < set->count; i++) {
+        hash_node *node = hash_set_node(set, i);
+        views[i].key = node->key;
+        views[i].len = node->key_len;
+    }
+
+    return views;
+}
+
+// Add the chains of buckets [begin, end) of a table to stats
+static void hash_set_count_chains(hash_set *set, const uint32_t *buckets, size_t begin, size_t end,
+                                  hash_set_chain_stats *stats) {
+    for (size_t b = begin; b < end; b++) {
+        size_t len = 0;
+        for (uint32_t current = buckets[b]; current; current = hash_set_node(set, current - 1)->next) {
+            len++;
+        }
+        stats->buckets++;
+        if (len) stats->used_buckets++;
+        if (len > stats->longest_chain) stats->longest_chain = len;
+        stats->chain_lengths[len < HASH_SET_CHAIN_HISTOGRAM ? len : HASH_SET_CHAIN_HISTOGRAM - 1]++;
+    }
+}
+
+// Walk every chain and describe how the keys spread over the buckets
+void hash_set_get_chain_stats(hash_set *set, hash_set_chain_stats *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!set) return;
+
+    hash_set_count_chains(set, set->buckets, 0, set->size, stats);
+    if (set->old_buckets) {
+        hash_set_count_chains(set, set->old_buckets, set->rehash_index, set->old_size, stats);
+    }
+}
@@ -4,33 +4,100 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "func_status.h"
+#include "arena.h"
 
-#define HASH_SET_SIZE           10000000
-#define LOAD_FACTOR_THRESHOLD   0.75
-#define NUM_COLID_KEY           100
+#define HASH_SET_INITIAL_SIZE   1024    // initial number of buckets, a power of two
+#define LOAD_FACTOR_THRESHOLD   0.75    // grow once count > size * threshold
+#define NUM_COLID_KEY           100     // grow early once a chain gets this long
+#define HASH_SET_REHASH_STEP    64      // old buckets migrated per new key while growing
+#define HASH_SET_KEY_BLOCK_SIZE (1 << 20)   // bytes per key arena block
+#define HASH_SET_NODE_BLOCK_SHIFT 14        // 16K nodes per node arena block
+#define HASH_SET_NODE_BLOCK     (1u << HASH_SET_NODE_BLOCK_SHIFT)
+#define HASH_SET_CHAIN_HISTOGRAM 8          // chain lengths 0 .. 6, then 7 or more
+#define HASH_SET_BATCH          64          // keys hashed ahead by the batch calls
+#define HASH_SET_PRINT_BUFFER   (1 << 16)   // bytes of "key,count" lines per write
+#define HASH_SET_PREFETCH_DISTANCE 8        // batch keys whose bucket is fetched ahead
 
 // Hash set node structure
+// Node i describes the i-th distinct key. Nodes are carved from the node
+// arena in blocks of HASH_SET_NODE_BLOCK and found through node_blocks.
+// Chains link nodes by index + 1, 0 ends a chain. The low 32 bits of the
+// key's hash are kept so chain walks and rehashing never hash a key again
+// and compare key bytes only when the hashes match. The count of
+// inserts of the key fills what would otherwise be padding.
 typedef struct hash_node_struct {
-    char * key;
-    struct hash_node_struct *next;
+    const char *key;    // the key record in the key arena
+    uint32_t key_len;
+    uint32_t next;
+    uint32_t hash;
+    uint32_t count;     // times inserted, saturating at UINT32_MAX
 } hash_node;
 
+// Read-only view of a key inside the set, valid until the set is destroyed
+typedef struct hash_set_view_struct {
+    const char *key;    // not NUL-terminated
+    size_t len;
+} hash_set_view;
+
 // Hash set structure
+// Keys are appended to the key arena as "key\n" records in the order they
+// are first inserted, so printing the set is one sequential write per
+// arena block. Nothing is allocated per key and nothing ever moves, so
+// destroying the set frees a handful of blocks and views stay valid.
+// Buckets hold only node indices + 1 (0 for an empty bucket), and a key
+// goes to bucket hash & (size - 1); the hash is seeded randomly once per
+// process, so crafted inputs cannot aim for one chain, and every set of
+// the process agrees on it, so a caller may hash once for several sets.
+// While growing, keys live in both old_buckets and buckets: every insert
+// of a new key moves HASH_SET_REHASH_STEP old buckets over, so the rehash
+// cost is spread over many inserts instead of one long pause.
 typedef struct hash_set_struct {
-    hash_node **buckets;
-    size_t size;
-    // size_t size;
+    uint32_t *buckets;
+    size_t size;            // number of buckets, a power of two
+    size_t count;           // number of keys
+    uint32_t *old_buckets;  // table being drained, NULL when not growing
+    size_t old_size;
+    size_t rehash_index;    // next old bucket to migrate
+    hash_node **node_blocks;// node i is node_blocks[i >> SHIFT][i & (BLOCK - 1)]
+    size_t node_block_count;
+    arena node_arena;
+    arena key_arena;        // "key\n" records, in insertion order
 } hash_set;
 
+// Shape of the bucket chains, for reports.
+// While growing, the old buckets not yet migrated count as buckets too.
+typedef struct hash_set_chain_stats_struct {
+    size_t buckets;
+    size_t used_buckets;    // buckets with at least one key
+    size_t longest_chain;
+    size_t chain_lengths[HASH_SET_CHAIN_HISTOGRAM];    // number of buckets per chain length
+} hash_set_chain_stats;
+
 // Function declarations
 hash_set* hash_set_create(void);
 void hash_set_destroy(hash_set *hset);
 FunctionStatus  hash_set_insert(hash_set *hset, const char *key);
 FunctionStatus  hash_set_contains(hash_set *hset, const char *key);
+uint64_t hash_set_hash(const char *key, size_t len);
+uint64_t hash_set_hash_seeded(const char *key, size_t len, uint64_t seed);
+FunctionStatus  hash_set_insert_hashed(hash_set *hset, const char *key, size_t len, uint64_t hash);
+FunctionStatus  hash_set_insert_counted(hash_set *hset, const char *key, size_t len, uint64_t hash,
+                                        uint32_t occurrences);
+FunctionStatus  hash_set_contains_hashed(hash_set *hset, const char *key, size_t len, uint64_t hash);
+FunctionStatus  hash_set_insert_batch(hash_set *hset, const char *const *keys, const size_t *lens,
+                                      size_t count, FunctionStatus *results);
+FunctionStatus  hash_set_contains_batch(hash_set *hset, const char *const *keys, const size_t *lens,
+                                        size_t count, FunctionStatus *results);
 void hash_set_print(FILE *ofile, hash_set *hset);
+void hash_set_print_counts(FILE *ofile, hash_set *hset, const uint32_t *order);
+uint32_t hash_set_get_count(hash_set *hset, size_t i);
 size_t hash_set_get_size(hash_set *hset);
+size_t hash_set_memory_usage(hash_set *hset);
 char** hash_set_to_array(hash_set *hset, size_t *count);
+hash_set_view* hash_set_to_views(hash_set *hset, size_t *count);
+void hash_set_get_chain_stats(hash_set *hset, hash_set_chain_stats *stats);
 
 #endif // __hash_set_h__
@@ -0,0 +1,157 @@
+#include <math.h>
+
+#include "hll_sketch.h"
+#include "hash_set.h"
+
+// return a sketch with all registers 0, or NULL if the precision is out
+// of range or there is no memory
+hll_sketch* hll_sketch_create(int precision) {
+    if (precision < HLL_SKETCH_MIN_PRECISION || precision > HLL_SKETCH_MAX_PRECISION) return NULL;
+
+    hll_sketch *sketch = malloc(sizeof(hll_sketch));
+    if (!sketch) return NULL;
+
+    sketch->precision = precision;
+    sketch->count = (size_t)1 << precision;
+    sketch->registers = calloc(sketch->count, sizeof(uint8_t));
+
+    // fail check
+    if (!sketch->registers) {
+        hll_sketch_destroy(sketch);
+        return NULL;
+    }
+
+    return sketch;
+}
+
+void hll_sketch_destroy(hll_sketch *sketch) {
+    if (!sketch) return;
+
+    free(sketch->registers);
+    free(sketch);
+}
+
+// Smallest precision whose standard error is at most error, clamped to
+// the supported range
+int hll_sketch_precision_for_error(double error) {
+    int precision = HLL_SKETCH_MIN_PRECISION;
+    while (precision < HLL_SKETCH_MAX_PRECISION && 1.04 / sqrt((double)((size_t)1 << precision)) > error) {
+        precision++;
+    }
+    return precision;
+}
+
+// Record a value, such as a normalized datetime string
+void hll_sketch_add(hll_sketch *sketch, const char *value, size_t len) {
+    if (!sketch || !value) return;
+
+    hll_sketch_add_hash(sketch, hash_set_hash_seeded(value, len, HLL_SKETCH_HASH_SEED));
+}
+
+// Take the larger of each register of dst and src, with src at the same
+// or a higher precision. Register i of src covers the hashes whose top
+// bits are i; at the lower precision its last dropped bits move into the
+// counted part, so its rank is the position of their first 1 bit, or the
+// old rank past them if they are all 0.
+static void hll_sketch_fold(uint8_t *dst, int dst_precision, const uint8_t *src, int src_precision) {
+    int dropped = src_precision - dst_precision;
+    size_t src_count = (size_t)1 << src_precision;
+    for (size_t i = 0; i < src_count; i++) {
+        if (!src[i]) continue;
+        uint64_t low = dropped ? i & (((size_t)1 << dropped) - 1) : 0;
+        uint8_t rank = low ? (uint8_t)(__builtin_clzll(low << (64 - dropped)) + 1)
+                           : (uint8_t)(dropped + src[i]);
+        size_t index = i >> dropped;
+        if (rank > dst[index]) dst[index] = rank;
+    }
+}
+
+// Add the values recorded in other; the result has the lower precision
+// of the two
+// return RET_SUCCESS, or a negative status on failure
+FunctionStatus hll_sketch_merge(hll_sketch *sketch, const hll_sketch *other) {
+    if (!sketch || !other) return NULL_INPUT_POINTER;
+
+    if (other->precision < sketch->precision) {
+        // fold this sketch down first
+        size_t count = (size_t)1 << other->precision;
+        uint8_t *registers = calloc(count, sizeof(uint8_t));
+        if (!registers) return MEMORY_ALLOCATION_ERR;
+        hll_sketch_fold(registers, other->precision, sketch->registers, sketch->precision);
+        free(sketch->registers);
+        sketch->registers = registers;
+        sketch->precision = other->precision;
+        sketch->count = count;
+    }
+    hll_sketch_fold(sketch->registers, sketch->precision, other->registers, other->precision);
+    return RET_SUCCESS;
+}
+
+// Estimated number of distinct values: the harmonic mean of the
+// registers, or linear counting of the empty registers while the
+// estimate is small enough for that to be the better one
+uint64_t hll_sketch_estimate(const hll_sketch *sketch) {
+    if (!sketch) return 0;
+
+    double m = (double)sketch->count;
+    double alpha = sketch->count == 16 ? 0.673 : sketch->count == 32 ? 0.697
+                 : sketch->count == 64 ? 0.709 : 0.7213 / (1.0 + 1.079 / m);
+    double sum = 0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < sketch->count; i++) {
+        sum += ldexp(1.0, -sketch->registers[i]);
+        if (!sketch->registers[i]) zeros++;
+    }
+
+    double estimate = alpha * m * m / sum;
+    if (estimate <= 2.5 * m && zeros) estimate = m * log(m / (double)zeros);
+    return (uint64_t)(estimate + 0.5);
+}
+
+// Relative standard error of the estimate
+double hll_sketch_error(const hll_sketch *sketch) {
+    return sketch ? 1.04 / sqrt((double)sketch->count) : 0.0;
+}
+
+// return RET_SUCCESS, or FILE_IO_ERR if the file cannot be written
+FunctionStatus hll_sketch_save(const hll_sketch *sketch, const char *path) {
+    if (!sketch || !path) return NULL_INPUT_POINTER;
+
+    hll_sketch_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HLL_SKETCH_MAGIC, sizeof(header.magic));
+    header.version = HLL_SKETCH_VERSION;
+    header.precision = (uint32_t)sketch->precision;
+    header.hash_seed = HLL_SKETCH_HASH_SEED;
+
+    FILE *out = fopen(path, "wb");
+    if (!out) return FILE_IO_ERR;
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+             fwrite(sketch->registers, 1, sketch->count, out) == sketch->count;
+    ok = fclose(out) == 0 && ok;
+    return ok ? RET_SUCCESS : FILE_IO_ERR;
+}
+
+// return the sketch saved at path, or NULL if the file cannot be read or
+// is not a sketch hashed the way this build hashes
+hll_sketch* hll_sketch_load(const char *path) {
+    if (!path) return NULL;
+
+    FILE *in = fopen(path, "rb");
+    if (!in) return NULL;
+
+    hll_sketch_header header;
+    hll_sketch *sketch = NULL;
+    if (fread(&header, sizeof(header), 1, in) == 1 &&
+        memcmp(header.magic, HLL_SKETCH_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == HLL_SKETCH_VERSION && header.hash_seed == HLL_SKETCH_HASH_SEED) {
+        sketch = hll_sketch_create((int)header.precision);
+    }
+    // exactly the registers, nothing after them
+    if (sketch && (fread(sketch->registers, 1, sketch->count, in) != sketch->count || fgetc(in) != EOF)) {
+        hll_sketch_destroy(sketch);
+        sketch = NULL;
+    }
+    fclose(in);
+    return sketch;
+}
@@ -0,0 +1,61 @@
+#ifndef __hll_sketch_h__
+#define __hll_sketch_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+
+#define HLL_SKETCH_MIN_PRECISION    4
+#define HLL_SKETCH_MAX_PRECISION    18          // 256 KB of registers, 0.2% error
+#define HLL_SKETCH_DEFAULT_ERROR    0.01        // 16 KB of registers
+#define HLL_SKETCH_HASH_SEED        0x5d1a6f0c3b9e8247ULL   // fixed: saved sketches must agree
+#define HLL_SKETCH_MAGIC            "DTHLLSKT"  // 8 bytes, no NUL in the file
+#define HLL_SKETCH_VERSION          1
+
+/* HyperLogLog estimate of the number of distinct values.
+    Each value is hashed to 64 bits; the top precision bits pick one of
+    2^precision one-byte registers, which keeps the longest run of
+    leading zeros seen in the remaining bits. The estimate has a standard
+    error of about 1.04 / sqrt(2^precision) whatever the number of values,
+    and memory stays at the register array.
+    The hash has a fixed seed, so sketches built by different threads,
+    processes or days merge by taking the larger register of each pair;
+    merging a finer sketch into a coarser one folds it down first.
+    Saved sketches are the header below followed by the registers.
+*/
+typedef struct hll_sketch_struct {
+    int precision;
+    size_t count;           // 2^precision registers
+    uint8_t *registers;
+} hll_sketch;
+
+typedef struct hll_sketch_header_struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t precision;
+    uint64_t hash_seed;
+} hll_sketch_header;
+
+// Function declarations
+hll_sketch* hll_sketch_create(int precision);
+void hll_sketch_destroy(hll_sketch *sketch);
+int hll_sketch_precision_for_error(double error);
+void hll_sketch_add(hll_sketch *sketch, const char *value, size_t len);
+FunctionStatus hll_sketch_merge(hll_sketch *sketch, const hll_sketch *other);
+uint64_t hll_sketch_estimate(const hll_sketch *sketch);
+double hll_sketch_error(const hll_sketch *sketch);
+FunctionStatus hll_sketch_save(const hll_sketch *sketch, const char *path);
+hll_sketch* hll_sketch_load(const char *path);
+
+// Record a value by its 64-bit hash
+static inline void hll_sketch_add_hash(hll_sketch *sketch, uint64_t hash) {
+    size_t index = (size_t)(hash >> (64 - sketch->precision));
+    uint64_t rest = hash << sketch->precision;
+    uint8_t rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1) : (uint8_t)(64 - sketch->precision + 1);
+    if (rank > sketch->registers[index]) sketch->registers[index] = rank;
+}
+
+#endif // __hll_sketch_h__
@@ -0,0 +1,259 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "key_blocks.h"
+
+#define KEY_BLOCKS_LOW_MASK     (((dt_key)1 << DT_KEY_SECONDS_SHIFT) - 1)
+
+// Append value as an unsigned LEB128 varint
+// return the number of bytes written
+static inline size_t key_blocks_put_varint(uint8_t *out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// A key dt_key_to_iso8601 can format: a year up to 9999, fewer than a
+// million microseconds and one of the two zone flags
+static inline int key_blocks_valid_key(dt_key key) {
+    return DT_KEY_SECONDS(key) <= (dt_key)DT_KEY_MAX_SECONDS && DT_KEY_MICROS(key) < 1000000 &&
+           (DT_KEY_ZONE(key) == DT_KEY_LOCAL || DT_KEY_ZONE(key) == DT_KEY_UTC);
+}
+
+// Read a varint from [*pos, end)
+// return 1 and advance *pos, or 0 if the varint runs past end or 64 bits
+static inline int key_blocks_get_varint(const uint8_t **pos, const uint8_t *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; *pos < end && shift < 64; shift += 7) {
+        uint8_t byte = *(*pos)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Write count ascending, distinct keys as a key block file at path
+// return RET_SUCCESS, or a negative status on failure
+FunctionStatus key_blocks_write(const char *path, const dt_key *keys, size_t count) {
+    if (!path || (!keys && count)) return NULL_INPUT_POINTER;
+
+    size_t block_count = (count + KEY_BLOCKS_BLOCK_KEYS - 1) / KEY_BLOCKS_BLOCK_KEYS;
+    key_blocks_entry *index = malloc((block_count ? block_count : 1) * sizeof(key_blocks_entry));
+    uint8_t *buffer = malloc(sizeof(dt_key) + KEY_BLOCKS_BLOCK_KEYS * KEY_BLOCKS_MAX_KEY_BYTES);
+    if (!index || !buffer) {
+        free(index);
+        free(buffer);
+        return MEMORY_ALLOCATION_ERR;
+    }
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        free(index);
+        free(buffer);
+        return FILE_IO_ERR;
+    }
+
+    key_blocks_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KEY_BLOCKS_MAGIC, sizeof(header.magic));
+    header.version = KEY_BLOCKS_VERSION;
+    header.block_keys = KEY_BLOCKS_BLOCK_KEYS;
+    header.count = count;
+    header.block_count = block_count;
+
+    // the header is rewritten once the index offset is known
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    uint64_t offset = sizeof(header);
+    for (size_t b = 0; ok && b < block_count; b++) {
+        size_t first = b * KEY_BLOCKS_BLOCK_KEYS;
+        size_t last = first + KEY_BLOCKS_BLOCK_KEYS < count ? first + KEY_BLOCKS_BLOCK_KEYS : count;
+        index[b].first_key = keys[first];
+        index[b].offset = offset;
+
+        memcpy(buffer, &keys[first], sizeof(dt_key));
+        size_t used = sizeof(dt_key);
+        for (size_t i = first + 1; i < last; i++) {
+            int64_t low_delta = (int64_t)(keys[i] & KEY_BLOCKS_LOW_MASK) -
+                                (int64_t)(keys[i - 1] & KEY_BLOCKS_LOW_MASK);
+            used += key_blocks_put_varint(buffer + used,
+                                          DT_KEY_SECONDS(keys[i]) - DT_KEY_SECONDS(keys[i - 1]));
+            used += key_blocks_put_varint(buffer + used,
+                                          ((uint64_t)low_delta << 1) ^ (uint64_t)(low_delta >> 63));
+        }
+        ok = fwrite(buffer, 1, used, out) == used;
+        offset += used;
+    }
+
+    // the index starts 8-byte aligned, so the mapping can be read in place
+    static const uint8_t padding[sizeof(uint64_t)];
+    size_t pad = (size_t)(-offset & (sizeof(uint64_t) - 1));
+    ok = ok && fwrite(padding, 1, pad, out) == pad;
+    header.index_offset = offset + pad;
+    ok = ok && fwrite(index, sizeof(key_blocks_entry), block_count, out) == block_count &&
+         fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = fclose(out) == 0 && ok;
+
+    free(index);
+    free(buffer);
+    return ok ? RET_SUCCESS : FILE_IO_ERR;
+}
+
+// Open a key block file for reading. The file is mapped, not read; only
+// its header, size and index bounds are checked.
+// return the reader, or NULL if the file cannot be mapped or is not one
+key_blocks* key_blocks_open(const char *path) {
+    if (!path) return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(key_blocks_header)) {
+        close(fd);
+        return NULL;
+    }
+    key_blocks *blocks = calloc(1, sizeof(key_blocks));
+    if (!blocks) {
+        close(fd);
+        return NULL;
+    }
+    blocks->map_size = (size_t)st.st_size;
+    blocks->map = mmap(NULL, blocks->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping outlives the descriptor
+    if (blocks->map == MAP_FAILED) {
+        free(blocks);
+        return NULL;
+    }
+
+    const key_blocks_header *header = blocks->map;
+    int valid = memcmp(header->magic, KEY_BLOCKS_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == KEY_BLOCKS_VERSION &&
+                header->block_keys > 0 && header->block_keys <= KEY_BLOCKS_MAX_BLOCK_KEYS &&
+                header->index_offset >= sizeof(key_blocks_header) &&
+                header->index_offset % sizeof(uint64_t) == 0 &&
+                header->index_offset <= blocks->map_size &&
+                header->block_count == (blocks->map_size - header->index_offset) / sizeof(key_blocks_entry) &&
+                header->index_offset + header->block_count * sizeof(key_blocks_entry) == blocks->map_size &&
+                header->count <= header->block_count * header->block_keys &&
+                header->count + header->block_keys > header->block_count * header->block_keys;
+    if (!valid) {
+        key_blocks_close(blocks);
+        return NULL;
+    }
+
+    blocks->index = (const key_blocks_entry *)((const char *)blocks->map + header->index_offset);
+    blocks->count = header->count;
+    blocks->block_count = header->block_count;
+    blocks->block_keys = header->block_keys;
+    blocks->index_offset = header->index_offset;
+    return blocks;
+}
+
+void key_blocks_close(key_blocks *blocks) {
+    if (!blocks) return;
+
+    if (blocks->map && blocks->map != MAP_FAILED) munmap(blocks->map, blocks->map_size);
+    free(blocks);
+}
+
+size_t key_blocks_get_size(const key_blocks *blocks) {
+    return blocks ? blocks->count : 0;
+}
+
+// The block that holds key if the file does: the last one starting at or
+// before it, or block 0 for a key before them all
+size_t key_blocks_find(const key_blocks *blocks, dt_key key) {
+    if (!blocks || !blocks->block_count) return 0;
+
+    size_t lo = 0, hi = blocks->block_count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (blocks->index[mid].first_key <= key) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Decode block into keys, which must hold block_keys keys; *count
+// receives the number decoded
+// return RET_SUCCESS, NULL_INPUT_POINTER for a block past the end, or
+// FILE_IO_ERR if the block is damaged: its bytes do not decode, or give
+// a key that is not valid, not above the one before or, for the first,
+// not the one the index has
+FunctionStatus key_blocks_read_block(const key_blocks *blocks, size_t block, dt_key *keys,
+                                     size_t *count) {
+    if (!blocks || !keys || !count || block >= blocks->block_count) return NULL_INPUT_POINTER;
+
+    size_t expected = block + 1 < blocks->block_count ? blocks->block_keys
+                                                      : blocks->count - block * blocks->block_keys;
+    size_t start = blocks->index[block].offset;
+    // the last block may be followed by alignment padding
+    size_t end = block + 1 < blocks->block_count ? blocks->index[block + 1].offset : blocks->index_offset;
+    if (start < sizeof(key_blocks_header) || end > blocks->index_offset || start + sizeof(dt_key) > end) {
+        return FILE_IO_ERR;
+    }
+
+    const uint8_t *pos = (const uint8_t *)blocks->map + start;
+    const uint8_t *limit = (const uint8_t *)blocks->map + end;
+    dt_key key;
+    memcpy(&key, pos, sizeof(dt_key));
+    pos += sizeof(dt_key);
+    if (key != blocks->index[block].first_key || !key_blocks_valid_key(key)) return FILE_IO_ERR;
+    keys[0] = key;
+    for (size_t i = 1; i < expected; i++) {
+        uint64_t seconds_delta, low_zigzag;
+        if (!key_blocks_get_varint(&pos, limit, &seconds_delta) ||
+            !key_blocks_get_varint(&pos, limit, &low_zigzag)) {
+            return FILE_IO_ERR;
+        }
+        int64_t low_delta = (int64_t)(low_zigzag >> 1) ^ -(int64_t)(low_zigzag & 1);
+        dt_key low = (dt_key)((int64_t)(key & KEY_BLOCKS_LOW_MASK) + low_delta) & KEY_BLOCKS_LOW_MASK;
+        dt_key next = ((DT_KEY_SECONDS(key) + seconds_delta) << DT_KEY_SECONDS_SHIFT) | low;
+        // a seconds delta past the key range could wrap round to a larger key
+        if (next <= key || seconds_delta > (dt_key)DT_KEY_MAX_SECONDS || !key_blocks_valid_key(next)) {
+            return FILE_IO_ERR;
+        }
+        key = next;
+        keys[i] = key;
+    }
+    if (block + 1 < blocks->block_count ? pos != limit : (size_t)(limit - pos) >= sizeof(uint64_t)) {
+        return FILE_IO_ERR;
+    }
+
+    *count = expected;
+    return RET_SUCCESS;
+}
+
+// Look a packed key up, decoding the one block that may hold it
+// return TRUE_STATUS if the file holds the key, FALSE_STATUS if not, or
+// a negative status if the block cannot be decoded
+FunctionStatus key_blocks_contains(const key_blocks *blocks, dt_key key) {
+    if (!blocks) return NULL_INPUT_POINTER;
+    if (!blocks->count || key < blocks->index[0].first_key) return FALSE_STATUS;
+
+    dt_key *keys = malloc(blocks->block_keys * sizeof(dt_key));
+    if (!keys) return MEMORY_ALLOCATION_ERR;
+    size_t count;
+    FunctionStatus rstat = key_blocks_read_block(blocks, key_blocks_find(blocks, key), keys, &count);
+    if (rstat == RET_SUCCESS) {
+        rstat = FALSE_STATUS;
+        for (size_t i = 0; i < count && keys[i] <= key; i++) {
+            if (keys[i] == key) rstat = TRUE_STATUS;
+        }
+    }
+    free(keys);
+    return rstat;
+}
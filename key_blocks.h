@@ -0,0 +1,70 @@
+#ifndef __key_blocks_h__
+#define __key_blocks_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+#include "datetime_util.h"
+
+#define KEY_BLOCKS_MAGIC        "DTKEYBLK"  // 8 bytes, no NUL in the file
+#define KEY_BLOCKS_VERSION      1
+#define KEY_BLOCKS_BLOCK_KEYS   4096        // keys per block, the last may hold fewer
+#define KEY_BLOCKS_MAX_BLOCK_KEYS (1 << 20)    // largest block a reader accepts
+#define KEY_BLOCKS_MAX_KEY_BYTES 20         // two varints of at most 10 bytes
+
+/* Compact binary file of distinct packed keys, ascending.
+    File layout, native byte order for the fixed-size fields:
+        header
+        blocks  block_count blocks of up to block_keys keys, then 0 to 7
+                bytes of padding
+        index   block_count entries: first key and file offset of a block
+    A block holds its first key as 8 raw bytes, then for every next key
+    the change in seconds as an unsigned LEB128 varint and the change in
+    the low 22 bits (microseconds and zone) zigzag-encoded into another,
+    since that part goes down whenever the seconds go up. A set of whole
+    seconds a few seconds apart costs 2 bytes a value instead of the 21
+    of a text line.
+    Blocks decode independently: the index is binary searched for the
+    block that may hold a key, so a lookup or a range read decodes one
+    block to start with, and a reader maps the file and parses nothing
+    but the header up front.
+*/
+typedef struct key_blocks_header_struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_keys;
+    uint64_t count;
+    uint64_t block_count;
+    uint64_t index_offset;      // from the start of the file
+} key_blocks_header;
+
+typedef struct key_blocks_entry_struct {
+    dt_key first_key;
+    uint64_t offset;            // from the start of the file
+} key_blocks_entry;
+
+// A key block file opened for reading
+typedef struct key_blocks_struct {
+    void *map;                  // the whole file
+    size_t map_size;
+    const key_blocks_entry *index;
+    size_t count;
+    size_t block_count;
+    size_t block_keys;
+    size_t index_offset;
+} key_blocks;
+
+// Function declarations
+FunctionStatus key_blocks_write(const char *path, const dt_key *keys, size_t count);
+key_blocks* key_blocks_open(const char *path);
+void key_blocks_close(key_blocks *blocks);
+size_t key_blocks_get_size(const key_blocks *blocks);
+size_t key_blocks_find(const key_blocks *blocks, dt_key key);
+FunctionStatus key_blocks_read_block(const key_blocks *blocks, size_t block, dt_key *keys,
+                                     size_t *count);
+FunctionStatus key_blocks_contains(const key_blocks *blocks, dt_key key);
+
+#endif // __key_blocks_h__
@@ -0,0 +1,351 @@
+#include "key_set.h"
+#include "key_sort.h"
+
+// 64-bit finalizer from MurmurHash3, spreads the low-entropy
+// packed keys over the whole word before masking
+static size_t hash_function_key(dt_key key, size_t capacity) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+
+    return (size_t)key & (capacity - 1);
+}
+
+// Build a slot array of new_capacity slots for the keys in the dense array
+static FunctionStatus key_set_place(key_set *set, size_t new_capacity) {
+    uint32_t *new_slots = calloc(new_capacity, sizeof(uint32_t));
+    if (!new_slots) return MEMORY_ALLOCATION_ERR;
+
+    // walking the dense array avoids scanning empty slots
+    for (size_t i = 0; i < set->count; i++) {
+        if (i + KEY_SET_BATCH < set->count) {
+            __builtin_prefetch(&new_slots[hash_function_key(set->keys[i + KEY_SET_BATCH],
+                                                            new_capacity)], 1);
+        }
+        size_t index = hash_function_key(set->keys[i], new_capacity);
+        while (new_slots[index]) {
+            index = (index + 1) & (new_capacity - 1);
+        }
+        new_slots[index] = (uint32_t)(i + 1);
+    }
+
+    free(set->slots);
+    set->slots = new_slots;
+    set->capacity = new_capacity;
+    return RET_SUCCESS;
+}
+
+// Double the slot array and re-place every key
+static FunctionStatus key_set_grow(key_set *set) {
+    return key_set_place(set, set->capacity * 2);
+}
+
+// Create a new key set
+// return a pointer to the created key set, or NULL on failure
+key_set* key_set_create(void) {
+    key_set *set = malloc(sizeof(key_set));
+    if (!set) return NULL;
+
+    set->capacity = KEY_SET_INITIAL_CAPACITY;
+    set->count = 0;
+    set->slots = calloc(set->capacity, sizeof(uint32_t));
+    set->key_capacity = KEY_SET_INITIAL_CAPACITY;
+    set->keys = malloc(set->key_capacity * sizeof(dt_key));
+    set->counts = NULL;
+
+    // fail check
+    if (!set->slots || !set->keys) {
+        key_set_destroy(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+// Destroy key set and free memory
+void key_set_destroy(key_set *set) {
+    if (!set) return;
+
+    free(set->slots);
+    free(set->keys);
+    free(set->counts);
+    free(set);
+}
+
+// Insert a packed key into the key set
+// return: TRUE_STATUS: successfully inserted
+//         FALSE_STATUS: already exists
+//         negative: error
+FunctionStatus  key_set_insert(key_set *set, dt_key key) {
+    return key_set_insert_counted(set, key, 1);
+}
+
+// Insert a key seen occurrences times; when the set counts, its count
+// goes up by that much, as after as many calls to key_set_insert
+// return: as key_set_insert
+FunctionStatus  key_set_insert_counted(key_set *set, dt_key key, uint32_t occurrences) {
+    if (!set) return NULL_INPUT_POINTER;
+
+    size_t mask = set->capacity - 1;
+    size_t index = hash_function_key(key, set->capacity);
+
+    // linear probing until the key or an empty slot is found
+    while (set->slots[index]) {
+        uint32_t found = set->slots[index] - 1;
+        if (set->keys[found] == key) {
+            if (set->counts) {
+                uint32_t *count = &set->counts[found];
+                *count = *count > UINT32_MAX - occurrences ? UINT32_MAX : *count + occurrences;
+            }
+            return FALSE_STATUS; // already has the key, do not insert
+        }
+        index = (index + 1) & mask;
+    }
+
+    // slots hold 32-bit key numbers
+    if (set->count >= UINT32_MAX) return MEMORY_ALLOCATION_ERR;
+    if (set->count == set->key_capacity) {
+        dt_key *keys = realloc(set->keys, set->key_capacity * 2 * sizeof(dt_key));
+        if (!keys) return MEMORY_ALLOCATION_ERR;
+        set->keys = keys;
+        if (set->counts) {
+            uint32_t *counts = realloc(set->counts, set->key_capacity * 2 * sizeof(uint32_t));
+            if (!counts) return MEMORY_ALLOCATION_ERR;
+            set->counts = counts;
+        }
+        set->key_capacity *= 2;
+    }
+    if (set->counts) set->counts[set->count] = occurrences;
+    set->keys[set->count++] = key;
+
+    if (set->count * KEY_SET_MAX_LOAD_DEN > set->capacity * KEY_SET_MAX_LOAD_NUM) {
+        // re-places every key, the new one included
+        FunctionStatus rstat = key_set_grow(set);
+        if (rstat != RET_SUCCESS) {
+            set->count--;
+            return rstat;
+        }
+    } else {
+        set->slots[index] = (uint32_t)set->count;
+    }
+
+    return TRUE_STATUS;
+}
+
+// Check if a packed key exists in the key set
+// return: 1: exists
+//         0: does not exist
+FunctionStatus  key_set_contains(key_set *set, dt_key key) {
+    if (!set) return NULL_INPUT_POINTER;
+
+    size_t mask = set->capacity - 1;
+    size_t index = hash_function_key(key, set->capacity);
+
+    while (set->slots[index]) {
+        if (set->keys[set->slots[index] - 1] == key) {
+            return TRUE_STATUS;
+        }
+        index = (index + 1) & mask;
+    }
+
+    return FALSE_STATUS;
+}
+
+// Prefetch what looking up key will touch: its home slot, and once that
+// slot is likely cached, the key it points to. Most lookups end at the
+// home slot; following the probe run further costs more in branches than
+// it saves.
+static inline void key_set_prefetch_slot(const key_set *set, dt_key key) {
+    __builtin_prefetch(&set->slots[hash_function_key(key, set->capacity)]);
+}
+
+static inline void key_set_prefetch_key(const key_set *set, dt_key key) {
+    uint32_t slot = set->slots[hash_function_key(key, set->capacity)];
+    if (slot) __builtin_prefetch(&set->keys[slot - 1]);
+}
+
+// Insert count keys. They are taken KEY_SET_BATCH at a time: the home
+// slots of the whole slice are prefetched, then the keys stored in them,
+// and only then are the keys inserted, so the cache misses of a slice
+// overlap instead of following one another.
+// results, when not NULL, receives the status of each key as returned by
+// key_set_insert.
+// return RET_SUCCESS, or the error of the first key that failed; the
+// keys after it are not inserted and their results not written
+FunctionStatus  key_set_insert_batch(key_set *set, const dt_key *keys, size_t count,
+                                     FunctionStatus *results) {
+    if (!set || (!keys && count)) return NULL_INPUT_POINTER;
+
+    for (size_t base = 0; base < count; base += KEY_SET_BATCH) {
+        size_t n = count - base < KEY_SET_BATCH ? count - base : KEY_SET_BATCH;
+        for (size_t i = 0; i < n; i++) key_set_prefetch_slot(set, keys[base + i]);
+        for (size_t i = 0; i < n; i++) key_set_prefetch_key(set, keys[base + i]);
+        for (size_t i = 0; i < n; i++) {
+            FunctionStatus rstat = key_set_insert(set, keys[base + i]);
+            if (results) results[base + i] = rstat;
+            if (rstat < 0) return rstat;
+        }
+    }
+    return RET_SUCCESS;
+}
+
+// Look up count keys, with the same prefetching as key_set_insert_batch;
+// results[i] is set as key_set_contains would return for keys[i]
+// return RET_SUCCESS, or a negative status on failure
+FunctionStatus  key_set_contains_batch(key_set *set, const dt_key *keys, size_t count,
+                                       FunctionStatus *results) {
+    if (!set || !results || (!keys && count)) return NULL_INPUT_POINTER;
+
+    for (size_t base = 0; base < count; base += KEY_SET_BATCH) {
+        size_t n = count - base < KEY_SET_BATCH ? count - base : KEY_SET_BATCH;
+        for (size_t i = 0; i < n; i++) key_set_prefetch_slot(set, keys[base + i]);
+        for (size_t i = 0; i < n; i++) key_set_prefetch_key(set, keys[base + i]);
+        for (size_t i = 0; i < n; i++) results[base + i] = key_set_contains(set, keys[base + i]);
+    }
+    return RET_SUCCESS;
+}
+
+// Print all elements in the key set, formatted back to ISO 8601,
+// in the order they were first inserted
+void key_set_print(FILE *ofile, key_set *set) {
+    if (!set) return;
+
+    if (ofile == NULL) {
+        char datetime_utc[DT_ISO8601_SIZE];
+        printf("Key Set Contents (%zu elements):\n", set->count);
+        for (size_t i = 0; i < set->count; i++) {
+            dt_key_to_iso8601(set->keys[i], datetime_utc);
+            printf("  \"%s\"\n", datetime_utc);
+        }
+    } else {
+        // format a buffer full of lines at a time, one fwrite each
+        char buffer[KEY_SET_PRINT_BUFFER];
+        for (size_t i = 0; i < set->count;) {
+            size_t written;
+            i += dt_key_format_batch(set->keys + i, set->count - i, buffer, sizeof(buffer), &written);
+            fwrite(buffer, 1, written, ofile);
+        }
+    }
+}
+
+// Start counting how many times each key is inserted; the keys already
+// in the set count as inserted once
+// return RET_SUCCESS, or MEMORY_ALLOCATION_ERR
+FunctionStatus key_set_count_occurrences(key_set *set) {
+    if (!set) return NULL_INPUT_POINTER;
+    if (set->counts) return RET_SUCCESS;
+
+    set->counts = malloc(set->key_capacity * sizeof(uint32_t));
+    if (!set->counts) return MEMORY_ALLOCATION_ERR;
+    for (size_t i = 0; i < set->count; i++) set->counts[i] = 1;
+    return RET_SUCCESS;
+}
+
+// Write every key as a "key,count" line in the order of key_set_print;
+// without counting, every count is 1
+void key_set_print_counts(FILE *ofile, key_set *set) {
+    if (!set || !ofile) return;
+
+    // build the lines in a buffer, one fwrite per buffer full
+    char buffer[KEY_SET_PRINT_BUFFER];
+    size_t used = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        if (sizeof(buffer) - used < DT_ISO8601_SIZE + DT_COUNT_SUFFIX_MAX) {
+            fwrite(buffer, 1, used, ofile);
+            used = 0;
+        }
+        used += (size_t)dt_key_to_iso8601(set->keys[i], buffer + used);
+        used += (size_t)dt_format_count_suffix(set->counts ? set->counts[i] : 1, buffer + used);
+    }
+    fwrite(buffer, 1, used, ofile);
+}
+
+// Number of times the i-th key was inserted: 0 past the last key, and 1
+// for every key when the set does not count
+uint32_t key_set_get_count(key_set *set, size_t i) {
+    if (!set || i >= set->count) return 0;
+    return set->counts ? set->counts[i] : 1;
+}
+
+// Sort the dense key array into ascending, that is chronological, order
+// and re-place the keys so the set keeps working; printing and iterating
+// then follow that order instead of insertion order
+// return RET_SUCCESS, or a negative status on failure
+FunctionStatus key_set_sort(key_set *set, int num_threads) {
+    if (!set) return NULL_INPUT_POINTER;
+
+    // the counts ride along as the sort's payload
+    FunctionStatus rstat = key_sort(set->keys, set->counts, set->count, num_threads);
+    if (rstat != RET_SUCCESS) return rstat;
+    return key_set_place(set, set->capacity);
+}
+
+// Drop the keys for which keep returns 0; the others keep their order
+// return RET_SUCCESS, or a negative status on failure
+FunctionStatus key_set_filter(key_set *set, int (*keep)(dt_key key, void *arg), void *arg) {
+    if (!set || !keep) return NULL_INPUT_POINTER;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        if (!keep(set->keys[i], arg)) continue;
+        if (set->counts) set->counts[kept] = set->counts[i];
+        set->keys[kept++] = set->keys[i];
+    }
+    if (kept == set->count) return RET_SUCCESS;
+    set->count = kept;
+    return key_set_place(set, set->capacity);
+}
+
+// Get the number of keys in the key set
+size_t key_set_get_size(key_set *set) {
+    return set ? set->count : 0;
+}
+
+// Bytes held by the set: slots, the dense key array and any counts
+size_t key_set_memory_usage(key_set *set) {
+    if (!set) return 0;
+
+    return sizeof(key_set)
+         + set->capacity * sizeof(uint32_t)
+         + set->key_capacity * sizeof(dt_key)
+         + (set->counts ? set->key_capacity * sizeof(uint32_t) : 0);
+}
+
+// Longest run of occupied slots, which bounds the probes of a lookup
+size_t key_set_longest_cluster(key_set *set) {
+    if (!set) return 0;
+
+    // a cluster may wrap around the end of the slot array
+    size_t first = 0;
+    while (first < set->capacity && set->slots[first]) first++;
+    if (first == set->capacity) return set->capacity;
+
+    size_t longest = 0;
+    size_t run = 0;
+    for (size_t i = 1; i <= set->capacity; i++) {
+        if (set->slots[(first + i) & (set->capacity - 1)]) {
+            run++;
+            if (run > longest) longest = run;
+        } else {
+            run = 0;
+        }
+    }
+    return longest;
+}
+
+// Copy the keys of the key set into a newly allocated array,
+// in insertion order
+dt_key* key_set_to_array(key_set *set, size_t *count) {
+    if (!set || !count) return NULL;
+
+    *count = set->count;
+    if (set->count == 0) return NULL;
+
+    dt_key *array = malloc(set->count * sizeof(dt_key));
+    if (!array) return NULL;
+
+    memcpy(array, set->keys, set->count * sizeof(dt_key));
+    return array;
+}
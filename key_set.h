@@ -0,0 +1,57 @@
+#ifndef __key_set_h__
+#define __key_set_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+#include "datetime_util.h"
+
+#define KEY_SET_INITIAL_CAPACITY    1024    // must be a power of two
+#define KEY_SET_MAX_LOAD_NUM        3       // grow once count > capacity * 3/4
+#define KEY_SET_MAX_LOAD_DEN        4
+#define KEY_SET_PRINT_BUFFER        (1 << 16)   // bytes formatted per write
+#define KEY_SET_BATCH               32          // batch keys prefetched together
+
+// Open-addressing set of packed datetime keys.
+// Keys are appended to a dense array in the order they are first
+// inserted; the slots only hold 32-bit indices + 1 into it (0 marks an
+// empty slot). There is no per-key allocation, a key costs its 8 bytes
+// plus a few bytes of slots, and iterating the set follows insertion order
+// until key_set_sort puts the keys in ascending order.
+// After key_set_count_occurrences, counts runs parallel to keys with the
+// number of times each key was inserted; it costs 4 bytes a key, so it
+// is only kept on request.
+typedef struct key_set_struct {
+    uint32_t *slots;
+    size_t capacity;    // number of slots, a power of two
+    size_t count;       // number of keys stored
+    dt_key *keys;       // distinct keys, in insertion order
+    uint32_t *counts;   // times each key was inserted, NULL unless counting
+    size_t key_capacity;
+} key_set;
+
+// Function declarations
+key_set* key_set_create(void);
+void key_set_destroy(key_set *kset);
+FunctionStatus  key_set_insert(key_set *kset, dt_key key);
+FunctionStatus  key_set_insert_counted(key_set *kset, dt_key key, uint32_t occurrences);
+FunctionStatus  key_set_contains(key_set *kset, dt_key key);
+FunctionStatus  key_set_insert_batch(key_set *kset, const dt_key *keys, size_t count,
+                                     FunctionStatus *results);
+FunctionStatus  key_set_contains_batch(key_set *kset, const dt_key *keys, size_t count,
+                                       FunctionStatus *results);
+void key_set_print(FILE *ofile, key_set *kset);
+FunctionStatus  key_set_count_occurrences(key_set *kset);
+void key_set_print_counts(FILE *ofile, key_set *kset);
+uint32_t key_set_get_count(key_set *kset, size_t i);
+FunctionStatus  key_set_sort(key_set *kset, int num_threads);
+FunctionStatus  key_set_filter(key_set *kset, int (*keep)(dt_key key, void *arg), void *arg);
+size_t key_set_get_size(key_set *kset);
+size_t key_set_memory_usage(key_set *kset);
+size_t key_set_longest_cluster(key_set *kset);
+dt_key* key_set_to_array(key_set *kset, size_t *count);
+
+#endif // __key_set_h__
@@ -0,0 +1,248 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "key_snapshot.h"
+
+// Index size for about count keys: KEY_SNAPSHOT_BUCKET_KEYS keys a bucket
+static uint32_t key_snapshot_radix_bits(size_t count) {
+    uint32_t bits = 0;
+    while (bits < KEY_SNAPSHOT_MAX_RADIX_BITS && ((size_t)KEY_SNAPSHOT_BUCKET_KEYS << bits) < count) {
+        bits++;
+    }
+    return bits;
+}
+
+// Smallest shift that maps every key up to max_key into 1 << bits buckets
+static uint32_t key_snapshot_shift(dt_key min_key, dt_key max_key, uint32_t bits) {
+    uint32_t shift = 0;
+    while (shift < 63 && ((max_key - min_key) >> shift) >> bits) shift++;
+    return shift;
+}
+
+// Open a snapshot for lookups. The file is mapped, not read; only its
+// header, size, the ends of its index and its first key are checked. A snapshot that does not exist yet opens
+// as an empty one, so the first incremental run needs no setup.
+// return the snapshot, or NULL if the file cannot be mapped or is not one
+key_snapshot* key_snapshot_open(const char *path) {
+    if (!path) return NULL;
+
+    key_snapshot *snap = calloc(1, sizeof(key_snapshot));
+    if (!snap) return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) return snap;
+        free(snap);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(key_snapshot_header)) {
+        close(fd);
+        free(snap);
+        return NULL;
+    }
+    snap->map_size = (size_t)st.st_size;
+    snap->map = mmap(NULL, snap->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping outlives the descriptor
+    if (snap->map == MAP_FAILED) {
+        free(snap);
+        return NULL;
+    }
+
+    const key_snapshot_header *header = snap->map;
+    size_t index_size = 0;
+    int valid = memcmp(header->magic, KEY_SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == KEY_SNAPSHOT_VERSION &&
+                header->radix_bits <= KEY_SNAPSHOT_MAX_RADIX_BITS && header->shift < 64;
+    if (valid) {
+        index_size = (((size_t)1 << header->radix_bits) + 1) * sizeof(uint64_t);
+        valid = header->count <= (snap->map_size - sizeof(key_snapshot_header)) / sizeof(dt_key) &&
+                sizeof(key_snapshot_header) + index_size + header->count * sizeof(dt_key) == snap->map_size;
+    }
+    const uint64_t *index = (const uint64_t *)((const char *)snap->map + sizeof(key_snapshot_header));
+    const dt_key *keys = (const dt_key *)((const char *)index + index_size);
+    // the ends of the index and the first key, which the merge relies on
+    valid = valid && index[0] == 0 && index[(size_t)1 << header->radix_bits] == header->count &&
+            (header->count == 0 || keys[0] == header->min_key);
+    if (!valid) {
+        key_snapshot_close(snap);
+        return NULL;
+    }
+
+    snap->index = index;
+    snap->keys = keys;
+    snap->count = header->count;
+    snap->min_key = header->min_key;
+    snap->shift = header->shift;
+    snap->buckets = (size_t)1 << header->radix_bits;
+    return snap;
+}
+
+void key_snapshot_close(key_snapshot *snap) {
+    if (!snap) return;
+
+    if (snap->map && snap->map != MAP_FAILED) munmap(snap->map, snap->map_size);
+    free(snap);
+}
+
+// Look a packed key up in the mapped snapshot
+// return TRUE_STATUS if the snapshot holds the key, FALSE_STATUS if not
+FunctionStatus key_snapshot_contains(const key_snapshot *snap, dt_key key) {
+    if (!snap || !snap->count || key < snap->min_key) return FALSE_STATUS;
+
+    dt_key bucket = (key - snap->min_key) >> snap->shift;
+    if (bucket >= snap->buckets) return FALSE_STATUS;
+
+    size_t lo = snap->index[bucket];
+    size_t hi = snap->index[bucket + 1];
+    if (hi > snap->count || lo > hi) return FALSE_STATUS;    // damaged index
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (snap->keys[mid] < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < snap->count && snap->keys[lo] == key ? TRUE_STATUS : FALSE_STATUS;
+}
+
+size_t key_snapshot_get_size(const key_snapshot *snap) {
+    return snap ? snap->count : 0;
+}
+
+// Flush the directory holding path, so a rename into it survives a crash
+// return 1, or 0 on failure; file systems that cannot sync a directory
+// count as success
+static int key_snapshot_sync_dir(const char *path) {
+    const char *slash = strrchr(path, '/');
+    size_t dir_len = !slash ? 0 : slash == path ? 1 : (size_t)(slash - path);
+    char *dir = malloc(dir_len + 2);
+    if (!dir) return 0;
+    if (dir_len) {
+        memcpy(dir, path, dir_len);
+        dir[dir_len] = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    free(dir);
+    if (fd < 0) return 0;
+    int ok = fsync(fd) == 0 || errno == EINVAL;
+    close(fd);
+    return ok;
+}
+
+// Write the keys of base and keys, merged, as a snapshot at path.
+// keys must be ascending; a key in both is written once. The file is
+// written next to path, synced to disk and renamed over it, and the
+// rename is synced too, so base may be a mapping of path itself and
+// neither a reader nor a crash ever leaves half a snapshot at path.
+// return RET_SUCCESS, or a negative status on failure; FILE_IO_ERR also
+// when base turns out to be damaged, its keys out of order
+FunctionStatus key_snapshot_write(const char *path, const key_snapshot *base,
+                                  const dt_key *keys, size_t count) {
+    if (!path || (!keys && count)) return NULL_INPUT_POINTER;
+
+    const dt_key *old_keys = base ? base->keys : NULL;
+    size_t old_count = base ? base->count : 0;
+
+    key_snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KEY_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = KEY_SNAPSHOT_VERSION;
+    header.radix_bits = key_snapshot_radix_bits(old_count + count);
+    if (old_count || count) {
+        dt_key min_key = !old_count ? keys[0] : !count ? old_keys[0]
+                       : old_keys[0] < keys[0] ? old_keys[0] : keys[0];
+        dt_key max_key = !old_count ? keys[count - 1] : !count ? old_keys[old_count - 1]
+                       : old_keys[old_count - 1] > keys[count - 1] ? old_keys[old_count - 1] : keys[count - 1];
+        header.min_key = min_key;
+        header.shift = key_snapshot_shift(min_key, max_key, header.radix_bits);
+    }
+    size_t buckets = (size_t)1 << header.radix_bits;
+
+    size_t path_len = strlen(path);
+    char *tmp_path = malloc(path_len + sizeof(".tmp"));
+    uint64_t *index = calloc(buckets + 1, sizeof(uint64_t));
+    dt_key *buffer = malloc(KEY_SNAPSHOT_WRITE_KEYS * sizeof(dt_key));
+    if (!tmp_path || !index || !buffer) {
+        free(tmp_path);
+        free(index);
+        free(buffer);
+        return MEMORY_ALLOCATION_ERR;
+    }
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+    FILE *out = fopen(tmp_path, "wb");
+    if (!out) {
+        free(tmp_path);
+        free(index);
+        free(buffer);
+        return FILE_IO_ERR;
+    }
+
+    // the keys go after the header and index, which are known at the end
+    size_t keys_offset = sizeof(header) + (buckets + 1) * sizeof(uint64_t);
+    int ok = fseek(out, (long)keys_offset, SEEK_SET) == 0;
+    size_t i = 0, j = 0, used = 0, written = 0;
+    dt_key last = 0;    // 0 is never a key
+    while (ok && (i < old_count || j < count)) {
+        dt_key key;
+        if (j == count || (i < old_count && old_keys[i] <= keys[j])) {
+            key = old_keys[i++];
+        } else {
+            key = keys[j++];
+        }
+        if (key == last) continue;
+        // out of order keys come from a damaged base and would send the
+        // bucket number past the index
+        dt_key bucket = (key - header.min_key) >> header.shift;
+        if (key < last || bucket >= buckets) {
+            ok = 0;
+            break;
+        }
+        last = key;
+        index[bucket]++;
+        buffer[used++] = key;
+        if (used == KEY_SNAPSHOT_WRITE_KEYS) {
+            ok = fwrite(buffer, sizeof(dt_key), used, out) == used;
+            written += used;
+            used = 0;
+        }
+    }
+    if (ok && used) {
+        ok = fwrite(buffer, sizeof(dt_key), used, out) == used;
+        written += used;
+    }
+
+    // bucket sizes to start offsets, with the total at the end
+    uint64_t start = 0;
+    for (size_t b = 0; b <= buckets; b++) {
+        uint64_t size = index[b];
+        index[b] = start;
+        start += size;
+    }
+    header.count = written;
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 &&
+         fwrite(&header, sizeof(header), 1, out) == 1 &&
+         fwrite(index, sizeof(uint64_t), buckets + 1, out) == buckets + 1;
+    ok = ok && fflush(out) == 0 && fsync(fileno(out)) == 0;
+    ok = fclose(out) == 0 && ok;
+    ok = ok && rename(tmp_path, path) == 0;
+    if (!ok) remove(tmp_path);
+    ok = ok && key_snapshot_sync_dir(path);
+
+    free(tmp_path);
+    free(index);
+    free(buffer);
+    return ok ? RET_SUCCESS : FILE_IO_ERR;
+}
@@ -0,0 +1,59 @@
+#ifndef __key_snapshot_h__
+#define __key_snapshot_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+#include "datetime_util.h"
+
+#define KEY_SNAPSHOT_MAGIC          "DTKEYSNP"  // 8 bytes, no NUL in the file
+#define KEY_SNAPSHOT_VERSION        1
+#define KEY_SNAPSHOT_MAX_RADIX_BITS 20          // at most 8 MB of index
+#define KEY_SNAPSHOT_BUCKET_KEYS    8           // keys per index bucket aimed for
+#define KEY_SNAPSHOT_WRITE_KEYS     (1 << 16)   // keys per write
+
+/* File layout, native byte order, every field 8-byte aligned:
+    header
+    index   (1 << radix_bits) + 1 uint64 offsets into keys
+    keys    count packed keys, ascending and distinct
+    Bucket b of the index holds the keys whose (key - min_key) >> shift
+    is b, at keys[index[b]] up to keys[index[b + 1]]; the shift is the
+    smallest that puts max_key in the last bucket. A lookup is one index
+    read and a binary search over a handful of keys, straight from the
+    mapping, so opening a snapshot costs a mmap and a header check
+    whatever its size.
+*/
+typedef struct key_snapshot_header_struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t radix_bits;
+    uint64_t count;
+    dt_key min_key;
+    uint32_t shift;
+    uint32_t reserved;
+} key_snapshot_header;
+
+// A snapshot opened for lookups
+typedef struct key_snapshot_struct {
+    void *map;                  // the whole file, NULL for an empty snapshot
+    size_t map_size;
+    const uint64_t *index;
+    const dt_key *keys;
+    size_t count;
+    dt_key min_key;
+    uint32_t shift;
+    size_t buckets;             // index entries - 1
+} key_snapshot;
+
+// Function declarations
+key_snapshot* key_snapshot_open(const char *path);
+void key_snapshot_close(key_snapshot *snap);
+FunctionStatus key_snapshot_contains(const key_snapshot *snap, dt_key key);
+size_t key_snapshot_get_size(const key_snapshot *snap);
+FunctionStatus key_snapshot_write(const char *path, const key_snapshot *base,
+                                  const dt_key *keys, size_t count);
+
+#endif // __key_snapshot_h__
@@ -0,0 +1,285 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+
+#include "key_sort.h"
+
+// One slice of the array in one pass, or the whole array on one thread
+typedef struct key_sort_task_struct {
+    const dt_key *src;
+    dt_key *dst;
+    const uint32_t *src_order;  // NULL when no order is carried
+    uint32_t *dst_order;
+    size_t begin;
+    size_t end;
+    unsigned shift;             // bit offset of the digit of this pass
+    size_t counts[KEY_SORT_BUCKETS];    // digit counts, then write positions
+} key_sort_task;
+
+typedef void* (*key_sort_fn)(void *task);
+
+#define KEY_SORT_DIGIT(key, shift) ((size_t)((key) >> (shift)) & (KEY_SORT_BUCKETS - 1))
+
+// Count every digit of every key in one read of the array
+static void key_sort_count_all(const dt_key *keys, size_t count,
+                               size_t counts[KEY_SORT_PASSES][KEY_SORT_BUCKETS]) {
+    memset(counts, 0, KEY_SORT_PASSES * KEY_SORT_BUCKETS * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) {
+        dt_key key = keys[i];
+        for (unsigned pass = 0; pass < KEY_SORT_PASSES; pass++) {
+            counts[pass][KEY_SORT_DIGIT(key, pass * KEY_SORT_DIGIT_BITS)]++;
+        }
+    }
+}
+
+// Count the digit of this pass over the task's slice
+static void* key_sort_count_task(void *arg) {
+    key_sort_task *task = arg;
+    memset(task->counts, 0, sizeof(task->counts));
+    for (size_t i = task->begin; i < task->end; i++) {
+        task->counts[KEY_SORT_DIGIT(task->src[i], task->shift)]++;
+    }
+    return NULL;
+}
+
+// Move the task's slice to the write positions of its digits; the slice
+// is read in order, which keeps the sort stable
+static void* key_sort_scatter_task(void *arg) {
+    key_sort_task *task = arg;
+    if (task->src_order) {
+        for (size_t i = task->begin; i < task->end; i++) {
+            size_t pos = task->counts[KEY_SORT_DIGIT(task->src[i], task->shift)]++;
+            task->dst[pos] = task->src[i];
+            task->dst_order[pos] = task->src_order[i];
+        }
+    } else {
+        for (size_t i = task->begin; i < task->end; i++) {
+            task->dst[task->counts[KEY_SORT_DIGIT(task->src[i], task->shift)]++] = task->src[i];
+        }
+    }
+    return NULL;
+}
+
+// Run fn on every task, the first one on the calling thread.
+// A task whose thread cannot be started runs on the calling thread too.
+static void key_sort_parallel(key_sort_fn fn, key_sort_task *tasks, int num_tasks) {
+    pthread_t threads[KEY_SORT_MAX_THREADS];
+    int started[KEY_SORT_MAX_THREADS];
+    for (int t = 1; t < num_tasks; t++) {
+        started[t] = pthread_create(&threads[t], NULL, fn, &tasks[t]) == 0;
+    }
+    fn(&tasks[0]);
+    for (int t = 1; t < num_tasks; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        } else {
+            fn(&tasks[t]);
+        }
+    }
+}
+
+FunctionStatus key_sort(dt_key *keys, uint32_t *order, size_t count, int num_threads) {
+    if (count < 2) return RET_SUCCESS;
+    if (!keys) return NULL_INPUT_POINTER;
+    if (num_threads < 1 || count < KEY_SORT_PARALLEL_MIN) num_threads = 1;
+    if (num_threads > KEY_SORT_MAX_THREADS) num_threads = KEY_SORT_MAX_THREADS;
+
+    dt_key *scratch = malloc(count * sizeof(dt_key));
+    uint32_t *scratch_order = order ? malloc(count * sizeof(uint32_t)) : NULL;
+    key_sort_task *tasks = malloc((size_t)num_threads * sizeof(key_sort_task));
+    if (!scratch || (order && !scratch_order) || !tasks) {
+        free(scratch);
+        free(scratch_order);
+        free(tasks);
+        return MEMORY_ALLOCATION_ERR;
+    }
+
+    // a permutation leaves the digit counts of the whole array unchanged,
+    // so one thread counts all passes up front
+    size_t single_counts[KEY_SORT_PASSES][KEY_SORT_BUCKETS];
+    size_t (*all_counts)[KEY_SORT_BUCKETS] = NULL;
+    if (num_threads == 1) {
+        all_counts = single_counts;
+        key_sort_count_all(keys, count, all_counts);
+    }
+
+    dt_key *src = keys;
+    dt_key *dst = scratch;
+    uint32_t *src_order = order;
+    uint32_t *dst_order = scratch_order;
+    size_t slice = (count + (size_t)num_threads - 1) / (size_t)num_threads;
+    for (unsigned pass = 0; pass < KEY_SORT_PASSES; pass++) {
+        for (int t = 0; t < num_threads; t++) {
+            key_sort_task *task = &tasks[t];
+            task->src = src;
+            task->dst = dst;
+            task->src_order = src_order;
+            task->dst_order = dst_order;
+            task->begin = (size_t)t * slice < count ? (size_t)t * slice : count;
+            task->end = task->begin + slice < count ? task->begin + slice : count;
+            task->shift = pass * KEY_SORT_DIGIT_BITS;
+        }
+        if (all_counts) {
+            memcpy(tasks[0].counts, all_counts[pass], sizeof(tasks[0].counts));
+        } else {
+            key_sort_parallel(key_sort_count_task, tasks, num_threads);
+        }
+
+        // a digit every key shares would scatter the array onto itself
+        int skip = 0;
+        for (size_t b = 0; b < KEY_SORT_BUCKETS && !skip; b++) {
+            size_t total = 0;
+            for (int t = 0; t < num_threads; t++) total += tasks[t].counts[b];
+            skip = total == count;
+        }
+        if (skip) continue;
+
+        // bucket b of thread t starts after all smaller buckets and after
+        // bucket b of the threads before it
+        size_t pos = 0;
+        for (size_t b = 0; b < KEY_SORT_BUCKETS; b++) {
+            for (int t = 0; t < num_threads; t++) {
+                size_t n = tasks[t].counts[b];
+                tasks[t].counts[b] = pos;
+                pos += n;
+            }
+        }
+        key_sort_parallel(key_sort_scatter_task, tasks, num_threads);
+
+        dt_key *keys_tmp = src;
+        src = dst;
+        dst = keys_tmp;
+        uint32_t *order_tmp = src_order;
+        src_order = dst_order;
+        dst_order = order_tmp;
+    }
+
+    if (src != keys) {
+        memcpy(keys, src, count * sizeof(dt_key));
+        if (order) memcpy(order, src_order, count * sizeof(uint32_t));
+    }
+    free(scratch);
+    free(scratch_order);
+    free(tasks);
+    return RET_SUCCESS;
+}
+
+// Order two normalized values with the same packed key, which can only
+// differ in fraction digits past the microsecond. Trailing zeros are
+// trimmed by normalization, so comparing the digits as text orders them
+// and a value that is a prefix of the other is the smaller one.
+static int key_sort_view_compare(const hash_set_view *a, const hash_set_view *b) {
+    size_t a_len = a->len;
+    size_t b_len = b->len;
+    if (a_len && a->key[a_len - 1] == 'Z') a_len--;
+    if (b_len && b->key[b_len - 1] == 'Z') b_len--;
+
+    int cmp = memcmp(a->key, b->key, a_len < b_len ? a_len : b_len);
+    if (cmp) return cmp;
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+// Number of fraction digits of a normalized value, which are whatever
+// follows "YYYY-MM-DDTHH:MM:SS." apart from a 'Z'
+static size_t key_sort_fraction_digits(const hash_set_view *view) {
+    size_t len = view->len;
+    if (len && view->key[len - 1] == 'Z') len--;
+    return len > 20 ? len - 20 : 0;
+}
+
+// Write the views in the given order through one buffer
+static void key_sort_write_ordered(FILE *out, const hash_set_view *views, const uint32_t *order,
+                                   size_t count) {
+    char buffer[KEY_SORT_WRITE_BUFFER];
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        const hash_set_view *view = &views[order[i]];
+        if (used + view->len + 1 > sizeof(buffer)) {
+            fwrite(buffer, 1, used, out);
+            used = 0;
+        }
+        memcpy(buffer + used, view->key, view->len);
+        used += view->len;
+        buffer[used++] = '\n';
+    }
+    fwrite(buffer, 1, used, out);
+}
+
+// Order the runs of equal keys by their fraction digits; such runs are
+// rare and short, so insertion sort does
+static void key_sort_ties(const hash_set_view *views, const dt_key *keys, uint32_t *order,
+                          size_t count) {
+    for (size_t start = 0; start < count;) {
+        size_t end = start + 1;
+        while (end < count && keys[end] == keys[start]) end++;
+        for (size_t i = start + 1; i < end; i++) {
+            uint32_t index = order[i];
+            size_t j = i;
+            for (; j > start && key_sort_view_compare(&views[order[j - 1]], &views[index]) > 0; j--) {
+                order[j] = order[j - 1];
+            }
+            order[j] = index;
+        }
+        start = end;
+    }
+}
+
+FunctionStatus key_sort_write_views(FILE *out, const hash_set_view *views, size_t count,
+                                    int num_threads) {
+    if (!out || (!views && count)) return NULL_INPUT_POINTER;
+    if (count > UINT32_MAX) return MEMORY_ALLOCATION_ERR;
+
+    dt_key *keys = malloc((count ? count : 1) * sizeof(dt_key));
+    if (!keys) return MEMORY_ALLOCATION_ERR;
+    FunctionStatus rstat = RET_SUCCESS;
+    int exact = 1;
+    for (size_t i = 0; i < count && rstat == RET_SUCCESS; i++) {
+        rstat = normalize_iso8601_key_n(views[i].key, views[i].len, &keys[i]);
+        if (key_sort_fraction_digits(&views[i]) > 6) exact = 0;
+    }
+
+    uint32_t *order = NULL;
+    if (rstat == RET_SUCCESS && !exact) {
+        order = malloc(count * sizeof(uint32_t));
+        if (!order) rstat = MEMORY_ALLOCATION_ERR;
+        for (size_t i = 0; i < count && order; i++) order[i] = (uint32_t)i;
+    }
+    if (rstat == RET_SUCCESS) rstat = key_sort(keys, order, count, num_threads);
+
+    if (rstat == RET_SUCCESS && exact) {
+        char buffer[KEY_SORT_WRITE_BUFFER];
+        for (size_t i = 0; i < count;) {
+            size_t written;
+            i += dt_key_format_batch(keys + i, count - i, buffer, sizeof(buffer), &written);
+            fwrite(buffer, 1, written, out);
+        }
+    } else if (rstat == RET_SUCCESS) {
+        key_sort_ties(views, keys, order, count);
+        key_sort_write_ordered(out, views, order, count);
+    }
+
+    free(keys);
+    free(order);
+    return rstat;
+}
+
+// Fill order with the indices of the views in chronological order,
+// the order key_sort_write_views writes them in
+FunctionStatus key_sort_view_order(const hash_set_view *views, size_t count, int num_threads,
+                                   uint32_t *order) {
+    if ((!views || !order) && count) return NULL_INPUT_POINTER;
+    if (count > UINT32_MAX) return MEMORY_ALLOCATION_ERR;
+
+    dt_key *keys = malloc((count ? count : 1) * sizeof(dt_key));
+    if (!keys) return MEMORY_ALLOCATION_ERR;
+    FunctionStatus rstat = RET_SUCCESS;
+    for (size_t i = 0; i < count && rstat == RET_SUCCESS; i++) {
+        rstat = normalize_iso8601_key_n(views[i].key, views[i].len, &keys[i]);
+        order[i] = (uint32_t)i;
+    }
+    if (rstat == RET_SUCCESS) rstat = key_sort(keys, order, count, num_threads);
+    if (rstat == RET_SUCCESS) key_sort_ties(views, keys, order, count);
+
+    free(keys);
+    return rstat;
+}
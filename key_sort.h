@@ -0,0 +1,57 @@
+#ifndef __key_sort_h__
+#define __key_sort_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+#include "datetime_util.h"
+#include "hash_set.h"
+
+#define KEY_SORT_DIGIT_BITS     8
+#define KEY_SORT_BUCKETS        (1 << KEY_SORT_DIGIT_BITS)
+#define KEY_SORT_PASSES         (64 / KEY_SORT_DIGIT_BITS)
+#define KEY_SORT_PARALLEL_MIN   (1 << 20)   // fewer keys are sorted on one thread
+#define KEY_SORT_MAX_THREADS    64
+#define KEY_SORT_WRITE_BUFFER   (1 << 16)   // bytes of text per write
+
+/* LSD radix sort of packed keys into ascending order, which for dt_key
+    is chronological order, then zone.
+    The keys are sorted 8 bits at a time from the low end, each pass a
+    stable counting scatter between keys and a scratch array of the same
+    size. Passes over a digit that every key shares are skipped, so the
+    top bytes of keys spanning a few years and the microsecond bytes of
+    keys without a fraction cost nothing.
+    With num_threads > 1 and at least KEY_SORT_PARALLEL_MIN keys, every
+    thread counts and then scatters its own slice of the array; the
+    per-thread counts give each thread disjoint write positions in every
+    bucket, so the result is the same as on one thread.
+    When order is not NULL it is permuted along with the keys.
+    return RET_SUCCESS, or MEMORY_ALLOCATION_ERR if no scratch space
+*/
+FunctionStatus key_sort(dt_key *keys, uint32_t *order, size_t count, int num_threads);
+
+/* Write views of normalized datetime strings to out in chronological
+    order, one per line.
+    Each view is packed into a key and the keys are radix sorted. When no
+    value has fraction digits past the microsecond, the sorted keys format
+    back to exactly the text of the views and are written from the keys.
+    Otherwise the view index is carried through the sort, values with the
+    same key are ordered by their fraction digits, and the views are
+    copied out in that order.
+    return RET_SUCCESS, or a negative status on failure
+*/
+FunctionStatus key_sort_write_views(FILE *out, const hash_set_view *views, size_t count,
+                                    int num_threads);
+
+/* Fill order with the indices of count views in the order
+    key_sort_write_views would write them, for callers that write more
+    than the values, such as their counts.
+    return RET_SUCCESS, or a negative status on failure
+*/
+FunctionStatus key_sort_view_order(const hash_set_view *views, size_t count, int num_threads,
+                                   uint32_t *order);
+
+#endif // __key_sort_h__
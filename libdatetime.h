@@ -0,0 +1,55 @@
+#ifndef __libdatetime_h__
+#define __libdatetime_h__
+
+/* Public header of libdatetime, the parsing, packing and set code of
+    datetime_unique built as a library (make lib: libdatetime.a and
+    libdatetime.so).
+
+    Parsing:    normalize_iso8601[_n], normalize_iso8601_key[_n],
+                normalize_iso8601_key_batch, dt_key_to_iso8601,
+                dt_key_format_batch (datetime_util.h)
+    Sets:       hash_set for normalized strings, key_set for packed keys,
+                each with single and batch insert/contains calls
+                (hash_set.h, key_set.h)
+    Shared set: shared_key_set, one set of packed keys that any number of
+                threads insert into and query at once; insert and
+                contains take no locks, but while the table grows a
+                thread may wait for chunks another thread is moving
+                (shared_key_set.h)
+    Windows:    window_set, the values of the last stretch of event time
+                in a ring of per-interval sets (window_set.h)
+    Snapshots:  key_snapshot, a sorted set of packed keys on disk, mapped
+                and queried in place (key_snapshot.h); key_blocks, a
+                sorted, delta-encoded block file with a block index
+                (key_blocks.h)
+    Counting:   hll_sketch, a mergeable HyperLogLog distinct count
+                (hll_sketch.h); per-key occurrence counts in hash_set and,
+                on request, key_set; topk_sketch, Space-Saving heavy
+                hitters in fixed memory (topk_sketch.h)
+    Sorting:    key_sort, key_sort_write_views (key_sort.h)
+    Input:      line_reader (line_reader.h)
+
+    Every call works only on the objects passed to it, so separate sets
+    may be used from separate threads without locking; a hash_set or
+    key_set must not be used by two threads at once, a shared_key_set
+    may. The only process-wide state is the choice of SIMD parse kernel and the hash_set seed, each settled on
+    first use through atomics, so the first calls may come from any
+    number of threads and all of them see the same kernel and seed.
+    Errors are returned as FunctionStatus codes (func_status.h); only the
+    _print calls write output, and nothing exits.
+*/
+
+#include "func_status.h"
+#include "datetime_util.h"
+#include "hash_set.h"
+#include "key_set.h"
+#include "shared_key_set.h"
+#include "key_sort.h"
+#include "key_snapshot.h"
+#include "key_blocks.h"
+#include "window_set.h"
+#include "hll_sketch.h"
+#include "topk_sketch.h"
+#include "line_reader.h"
+
+#endif // __libdatetime_h__
@@ -0,0 +1,210 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "line_reader.h"
+
+// Map the whole file if it is a non-empty regular file
+// return 1 if mapped, 0 to fall back to read()
+static int line_reader_map(line_reader *reader) {
+    struct stat st;
+    if (fstat(reader->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        return 0;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+    if (data == MAP_FAILED) return 0;
+
+    // one front-to-back pass, let the kernel read ahead aggressively
+    posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    reader->data = data;
+    reader->size = (size_t)st.st_size;
+    reader->mapped = 1;
+    return 1;
+}
+
+// Open a file for reading lines, "-" reads from stdin
+// return a pointer to the created reader, or NULL on failure
+line_reader* line_reader_open(const char *path) {
+    if (!path) return NULL;
+
+    line_reader *reader = calloc(1, sizeof(line_reader));
+    if (!reader) return NULL;
+
+    if (strcmp(path, "-") == 0) {
+        reader->fd = STDIN_FILENO;
+    } else {
+        reader->fd = open(path, O_RDONLY);
+        reader->owns_fd = 1;
+    }
+    if (reader->fd < 0) {
+        free(reader);
+        return NULL;
+    }
+
+    if (!line_reader_map(reader)) {
+        reader->capacity = LINE_READER_BUFFER_SIZE;
+        reader->buffer = malloc(reader->capacity);
+        if (!reader->buffer) {
+            line_reader_close(reader);
+            return NULL;
+        }
+        reader->data = reader->buffer;
+    }
+
+    return reader;
+}
+
+// Close the reader and release the mapping or buffer
+void line_reader_close(line_reader *reader) {
+    if (!reader) return;
+
+    if (reader->mapped) {
+        munmap((void *)reader->data, reader->size);
+    }
+    free(reader->buffer);
+    if (reader->owns_fd) {
+        close(reader->fd);
+    }
+    free(reader);
+}
+
+// Flush stream whenever the reader is about to wait for more input, so
+// whatever was written for the lines so far reaches its reader first
+void line_reader_set_flush(line_reader *reader, FILE *stream) {
+    if (reader) reader->flush = stream;
+}
+
+// Refill the read() buffer, keeping the unfinished line at its front
+// return RET_SUCCESS, MEMORY_ALLOCATION_ERR if a line outgrew the buffer,
+// or FILE_IO_ERR if read() failed
+static FunctionStatus line_reader_fill(line_reader *reader) {
+    size_t remain = reader->size - reader->pos;
+    if (reader->pos > 0) {
+        memmove(reader->buffer, reader->buffer + reader->pos, remain);
+        reader->pos = 0;
+        reader->size = remain;
+    }
+
+    // the pending line fills the whole buffer, double it
+    if (reader->size == reader->capacity) {
+        char *bigger = realloc(reader->buffer, reader->capacity * 2);
+        if (!bigger) return MEMORY_ALLOCATION_ERR;
+        reader->buffer = bigger;
+        reader->data = bigger;
+        reader->capacity *= 2;
+    }
+
+    if (reader->flush) fflush(reader->flush);
+
+    while (reader->size < reader->capacity) {
+        ssize_t n = read(reader->fd, reader->buffer + reader->size,
+                         reader->capacity - reader->size);
+        if (n == 0) {
+            reader->eof = 1;
+            break;
+        }
+        if (n < 0) {
+            // a signal only interrupts the wait; anything else would cut
+            // the input short without a trace
+            if (errno == EINTR) continue;
+            return FILE_IO_ERR;
+        }
+        reader->size += (size_t)n;
+        // hand out what we have as soon as it holds a full line
+        if (memchr(reader->buffer + reader->size - n, '\n', (size_t)n)) break;
+    }
+
+    return RET_SUCCESS;
+}
+
+// Get the next line without its trailing newline
+// return: TRUE_STATUS: *line / *len describe the next line
+//         FALSE_STATUS: no more lines
+//         negative: error
+FunctionStatus line_reader_next(line_reader *reader, const char **line, size_t *len) {
+    if (!reader || !line || !len) return NULL_INPUT_POINTER;
+
+    for (;;) {
+        const char *start = reader->data + reader->pos;
+        size_t avail = reader->size - reader->pos;
+        const char *newline = avail ? memchr(start, '\n', avail) : NULL;
+
+        if (newline) {
+            *line = start;
+            *len = (size_t)(newline - start);
+            reader->pos += *len + 1;
+            return TRUE_STATUS;
+        }
+
+        // last line without a trailing newline
+        if (reader->mapped || reader->eof) {
+            if (avail == 0) return FALSE_STATUS;
+            *line = start;
+            *len = avail;
+            reader->pos = reader->size;
+            return TRUE_STATUS;
+        }
+
+        FunctionStatus rstat = line_reader_fill(reader);
+        if (rstat != RET_SUCCESS) return rstat;
+    }
+}
+
+// Find the end of the last full line within [start, start + max_len),
+// or of the first line if it is longer than that
+// return a pointer just past its newline, or NULL if there is no newline
+static const char* line_reader_block_end(const char *start, size_t avail, size_t max_len) {
+    size_t limit = avail < max_len ? avail : max_len;
+    for (size_t i = limit; i > 0; i--) {
+        if (start[i - 1] == '\n') return start + i;
+    }
+    const char *newline = memchr(start + limit, '\n', avail - limit);
+    return newline ? newline + 1 : NULL;
+}
+
+// Get the next block of whole lines, about max_len bytes long (longer
+// only when a single line is). The block ends right after a newline,
+// except for a last line that has none.
+// return: TRUE_STATUS: *block / *len describe the next block
+//         FALSE_STATUS: no more input
+//         negative: error
+FunctionStatus line_reader_next_block(line_reader *reader, const char **block, size_t *len,
+                                      size_t max_len) {
+    if (!reader || !block || !len) return NULL_INPUT_POINTER;
+    if (max_len == 0) max_len = 1;
+
+    // make room for a whole block in the read() buffer
+    if (!reader->mapped && reader->capacity < max_len) {
+        char *bigger = realloc(reader->buffer, max_len);
+        if (!bigger) return MEMORY_ALLOCATION_ERR;
+        reader->buffer = bigger;
+        reader->data = bigger;
+        reader->capacity = max_len;
+    }
+
+    for (;;) {
+        const char *start = reader->data + reader->pos;
+        size_t avail = reader->size - reader->pos;
+
+        if (reader->mapped || reader->eof || avail >= max_len) {
+            const char *end = line_reader_block_end(start, avail, max_len);
+            if (end || reader->mapped || reader->eof) {
+                if (!end) end = start + avail; // last line without a newline
+                if (end == start) return FALSE_STATUS;
+                *block = start;
+                *len = (size_t)(end - start);
+                reader->pos += *len;
+                return TRUE_STATUS;
+            }
+        }
+
+        FunctionStatus rstat = line_reader_fill(reader);
+        if (rstat != RET_SUCCESS) return rstat;
+    }
+}
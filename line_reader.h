@@ -0,0 +1,38 @@
+#ifndef __line_reader_h__
+#define __line_reader_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "func_status.h"
+
+#define LINE_READER_BUFFER_SIZE (1 << 20)  // read() chunk for pipes and stdin
+
+// Line reader handing out (pointer, length) views of each line.
+// Regular files are memory-mapped and lines point straight into the
+// mapping; pipes and stdin fall back to large read() calls into one
+// buffer. Either way there is no per-line copy and no stdio locking.
+// A view stays valid until the next call to line_reader_next.
+typedef struct line_reader_struct {
+    int fd;
+    int owns_fd;        // close fd in line_reader_close
+    const char *data;   // mapped file or read buffer
+    size_t size;        // bytes available in data
+    size_t pos;         // start of the next line
+    int mapped;         // data is an mmap of the whole file
+    char *buffer;       // read() buffer when not mapped
+    size_t capacity;
+    int eof;
+    FILE *flush;        // flushed before each read() that may block, or NULL
+} line_reader;
+
+// Function declarations
+line_reader* line_reader_open(const char *path);
+void line_reader_close(line_reader *reader);
+void line_reader_set_flush(line_reader *reader, FILE *stream);
+FunctionStatus line_reader_next(line_reader *reader, const char **line, size_t *len);
+FunctionStatus line_reader_next_block(line_reader *reader, const char **block, size_t *len,
+                                      size_t max_len);
+
+#endif // __line_reader_h__
@@ -1,58 +1,952 @@
+#include <getopt.h>
+#include <unistd.h>
+
 #include "hash_set.h"
+#include "key_set.h"
+#include "line_reader.h"
+#include "dedup_pipeline.h"
+#include "stream_dedup.h"
+#include "spill_dedup.h"
+#include "key_sort.h"
+#include "dedup_stats.h"
+#include "error_sink.h"
+#include "key_snapshot.h"
+#include "hll_sketch.h"
+#include "topk_sketch.h"
+#include "window_set.h"
+#include "key_blocks.h"
+#include "multi_dedup.h"
 #include "datetime_util.h"
 
-#define MAX_LINE_LENGTH 256
+#define TOP_PRINT_BUFFER    (1 << 16)   // bytes of --top output lines per write
 
-int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        printf("Usage: %s <input_file> <output_stream>\n", argv[0]);
+// Parse a byte count with an optional K, M or G suffix
+// return the count, or 0 if the text is not a valid size
+static size_t parse_size(const char* text) {
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) return 0;
+
+    switch (*end) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+    default: break;
+    }
+    if (*end != '\0') return 0;
+    return (size_t)value;
+}
+
+// Parse a duration in seconds with an optional s, m, h or d suffix
+// return the seconds, or 0 if the text is not a valid duration
+static uint64_t parse_duration(const char* text) {
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) return 0;
+
+    switch (*end) {
+    case 's': end++; break;
+    case 'm': value *= 60; end++; break;
+    case 'h': value *= 3600; end++; break;
+    case 'd': value *= 86400; end++; break;
+    default: break;
+    }
+    if (*end != '\0') return 0;
+    return (uint64_t)value;
+}
+
+// Write the set's values in chronological order instead of first-seen order,
+// as "value,count" lines with counts
+// return RET_SUCCESS, or a negative status on failure
+static FunctionStatus print_sorted(FILE* output_stream, int packed, int counts, hash_set* dt_hset,
+                                   key_set* dt_kset, int num_threads, dedup_stats* stats) {
+    double mark = dedup_stats_mark(stats);
+    if (packed) {
+        FunctionStatus rstat = key_set_sort(dt_kset, num_threads);
+        dedup_stats_lap(stats, DEDUP_STAGE_SORT, &mark);
+        if (rstat == RET_SUCCESS && counts) {
+            key_set_print_counts(output_stream, dt_kset);
+        } else if (rstat == RET_SUCCESS) {
+            key_set_print(output_stream, dt_kset);
+        }
+        dedup_stats_lap(stats, DEDUP_STAGE_WRITE, &mark);
+        return rstat;
+    }
+
+    size_t count;
+    hash_set_view* views = hash_set_to_views(dt_hset, &count);
+    if (!views && count) return MEMORY_ALLOCATION_ERR;
+    FunctionStatus rstat;
+    if (counts) {
+        uint32_t* order = malloc((count ? count : 1) * sizeof(uint32_t));
+        rstat = order ? key_sort_view_order(views, count, num_threads, order) : MEMORY_ALLOCATION_ERR;
+        dedup_stats_lap(stats, DEDUP_STAGE_SORT, &mark);
+        if (rstat == RET_SUCCESS) hash_set_print_counts(output_stream, dt_hset, order);
+        dedup_stats_lap(stats, DEDUP_STAGE_WRITE, &mark);
+        free(order);
+    } else {
+        // string values are formatted while they are written, all of it counts as sorting
+        rstat = key_sort_write_views(output_stream, views, count, num_threads);
+        dedup_stats_lap(stats, DEDUP_STAGE_SORT, &mark);
+    }
+    free(views);
+    return rstat;
+}
+
+// Write the set's keys sorted as a key block file
+// return RET_SUCCESS, or a negative status on failure
+static FunctionStatus write_key_blocks(const char* output_path, key_set* dt_kset, int num_threads,
+                                       dedup_stats* stats) {
+    double mark = dedup_stats_mark(stats);
+    FunctionStatus rstat = key_set_sort(dt_kset, num_threads);
+    dedup_stats_lap(stats, DEDUP_STAGE_SORT, &mark);
+    if (rstat == RET_SUCCESS) rstat = key_blocks_write(output_path, dt_kset->keys, key_set_get_size(dt_kset));
+    dedup_stats_lap(stats, DEDUP_STAGE_WRITE, &mark);
+    return rstat;
+}
+
+// Gather the inputs of a run: the given paths, with glob patterns
+// expanded, then the paths listed in list_path if there is one
+// return the list, or NULL after reporting the problem
+static input_list* collect_inputs(char* const* paths, int path_count, const char* list_path) {
+    input_list* inputs = input_list_create();
+    if (!inputs) {
+        printf("Error: Memory allocation failed\n");
+        return NULL;
+    }
+    for (int i = 0; i < path_count; i++) {
+        FunctionStatus rstat = input_list_add(inputs, paths[i]);
+        if (rstat == TRUE_STATUS) continue;
+        if (rstat == FALSE_STATUS) {
+            printf("Error: No input file matches '%s'\n", paths[i]);
+        } else {
+            printf("Error: Cannot expand input '%s' (error code: %d)\n", paths[i], rstat);
+        }
+        input_list_destroy(inputs);
+        return NULL;
+    }
+    if (list_path) {
+        FunctionStatus rstat = input_list_add_file(inputs, list_path);
+        if (rstat != RET_SUCCESS) {
+            printf("Error: Cannot read input list '%s' (error code: %d)\n", list_path, rstat);
+            input_list_destroy(inputs);
+            return NULL;
+        }
+    }
+    if (inputs->count == 0) {
+        printf("Error: No input files\n");
+        input_list_destroy(inputs);
+        return NULL;
+    }
+    return inputs;
+}
+
+// Write the per-input statistics of a run as CSV
+// return RET_SUCCESS, or FILE_IO_ERR if the file cannot be written
+static FunctionStatus write_file_stats(const char* path, const input_list* inputs,
+                                       const multi_file_stats* files) {
+    FILE* ofile = fopen(path, "w");
+    if (!ofile) return FILE_IO_ERR;
+    multi_dedup_print_file_stats(ofile, inputs, files);
+    return fclose(ofile) == 0 ? RET_SUCCESS : FILE_IO_ERR;
+}
+
+// key_set_filter test: keep the values the snapshot does not hold yet
+static int snapshot_lacks(dt_key key, void* snapshot) {
+    return key_snapshot_contains(snapshot, key) != TRUE_STATUS;
+}
+
+// Rewrite the snapshot with the values of this run added to it
+// return RET_SUCCESS, or a negative status on failure
+static FunctionStatus update_snapshot(const char* snapshot_path, const key_snapshot* snapshot,
+                                      key_set* dt_kset, int num_threads) {
+    size_t count = key_set_get_size(dt_kset);
+    dt_key* keys = malloc((count ? count : 1) * sizeof(dt_key));
+    if (!keys) return MEMORY_ALLOCATION_ERR;
+
+    memcpy(keys, dt_kset->keys, count * sizeof(dt_key));
+    FunctionStatus rstat = key_sort(keys, NULL, count, num_threads);
+    if (rstat == RET_SUCCESS) rstat = key_snapshot_write(snapshot_path, snapshot, keys, count);
+    free(keys);
+    return rstat;
+}
+
+// Online mode: values go to the output as soon as they are first seen
+static int run_stream(const char* input_path, const char* output_path, int packed,
+                      size_t memory_limit, uint64_t window_seconds, error_sink* errors) {
+    line_reader* input_reader = line_reader_open(input_path);
+    if (!input_reader) {
+        fprintf(stderr, "Error: Cannot open input file '%s'\n", input_path);
+        return 1;
+    }
+
+    FILE* output_stream = strcmp(output_path, "-") == 0 ? stdout : fopen(output_path, "w");
+    if (!output_stream) {
+        fprintf(stderr, "Error: Cannot create output file '%s'\n", output_path);
+        line_reader_close(input_reader);
+        return 1;
+    }
+
+    size_t late = 0;
+    FunctionStatus rstat = window_seconds
+        ? stream_dedup_run_window(input_reader, output_stream, packed, window_seconds, &late, errors)
+        : stream_dedup_run(input_reader, output_stream, packed, memory_limit, errors);
+    line_reader_close(input_reader);
+    error_sink_summary(errors);
+    if (late) {
+        fprintf(stderr, "Warning: %zu values were older than the window and written unchecked\n", late);
+    }
+    int write_failed = fflush(output_stream) != 0 || ferror(output_stream);
+    if (output_stream != stdout && fclose(output_stream) != 0) write_failed = 1;
+    if (write_failed && rstat == RET_SUCCESS) rstat = FILE_IO_ERR;
+
+    if (rstat != RET_SUCCESS) {
+        fprintf(stderr, "Error: Processing failed (error code: %d)\n", rstat);
+        return 1;
+    }
+    return 0;
+}
+
+// External-memory mode: sorted runs on disk, merged into the output
+static int run_spill(const char* input_path, const char* output_path, size_t memory_limit,
+                     const char* tmp_dir, error_sink* errors) {
+    line_reader* input_reader = line_reader_open(input_path);
+    if (!input_reader) {
+        printf("Error: Cannot open input file '%s'\n", input_path);
+        return 1;
+    }
+
+    FILE* output_stream = fopen(output_path, "w");
+    if (!output_stream) {
+        printf("Error: Cannot create output file '%s'\n", output_path);
+        line_reader_close(input_reader);
+        return 1;
+    }
+
+    printf("Processing datetime values...\n");
+    FunctionStatus rstat = spill_dedup_run(input_reader, output_stream, memory_limit, tmp_dir, errors);
+    line_reader_close(input_reader);
+    error_sink_summary(errors);
+    if (fclose(output_stream) != 0 && rstat == RET_SUCCESS) rstat = FILE_IO_ERR;
+
+    if (rstat != RET_SUCCESS) {
+        printf("Error: Processing failed (error code: %d)\n", rstat);
+        return 1;
+    }
+    printf("\n\nUnique valid datetime values:\n");
+    return 0;
+}
+
+// Feed the normalized values of one input into the sketch
+// return RET_SUCCESS, or a negative status on failure
+static FunctionStatus count_approx_input(line_reader* input_reader, hll_sketch* sketch,
+                                         error_sink* errors) {
+    char dt_str_norm[DT_ISO8601_SIZE];
+    const char* block;
+    size_t block_len;
+    FunctionStatus lstat;
+    while ((lstat = line_reader_next_block(input_reader, &block, &block_len, DEDUP_BLOCK_SIZE)) == TRUE_STATUS) {
+        const char* pos = block;
+        const char* end = block + block_len;
+        while (pos < end) {
+            const char* newline = memchr(pos, '\n', (size_t)(end - pos));
+            const char* line_end = newline ? newline : end;
+            size_t dt_len;
+            const char* dt_str = dt_line_token(pos, (size_t)(line_end - pos), &dt_len);
+            pos = newline ? newline + 1 : end;
+            if (dt_len == 0) continue; // blank line
+
+            FunctionStatus rstat = normalize_iso8601_n(dt_str, dt_len, dt_str_norm);
+            if (rstat != RET_SUCCESS) {
+                error_sink_add(errors, dt_str, dt_len, rstat);
+                continue;
+            }
+            hll_sketch_add(sketch, dt_str_norm, strlen(dt_str_norm));
+        }
+    }
+    return lstat == FALSE_STATUS ? RET_SUCCESS : lstat;
+}
+
+// Approximate mode: count distinct values in a sketch instead of keeping
+// them, merged with saved sketches and optionally saved itself
+static int run_count_approx(const input_list* inputs, double error,
+                            const char* const* sketch_paths, int sketch_count,
+                            const char* sketch_out, error_sink* errors) {
+    hll_sketch* sketch = hll_sketch_create(hll_sketch_precision_for_error(error));
+    if (!sketch) {
+        printf("Error: Memory allocation failed\n");
         return 1;
     }
-    
-    FILE* input_stream = fopen(argv[1], "r");
-    if (!input_stream) {
-        printf("Error: Cannot open input file '%s'\n", argv[1]);
+
+    for (int i = 0; i < sketch_count; i++) {
+        hll_sketch* saved = hll_sketch_load(sketch_paths[i]);
+        FunctionStatus rstat = saved ? hll_sketch_merge(sketch, saved) : FILE_IO_ERR;
+        hll_sketch_destroy(saved);
+        if (rstat != RET_SUCCESS) {
+            printf("Error: Cannot read sketch '%s'\n", sketch_paths[i]);
+            hll_sketch_destroy(sketch);
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; inputs && i < inputs->count; i++) {
+        line_reader* input_reader = line_reader_open(inputs->paths[i]);
+        if (!input_reader) {
+            printf("Error: Cannot open input file '%s'\n", inputs->paths[i]);
+            hll_sketch_destroy(sketch);
+            return 1;
+        }
+        FunctionStatus rstat = count_approx_input(input_reader, sketch, errors);
+        line_reader_close(input_reader);
+        if (rstat != RET_SUCCESS) {
+            printf("Error: Processing failed (error code: %d)\n", rstat);
+            hll_sketch_destroy(sketch);
+            return 1;
+        }
+    }
+    error_sink_summary(errors);
+
+    printf("Approximate unique datetime values: %llu (standard error %.2f%%, %zu-byte sketch)\n",
+           (unsigned long long)hll_sketch_estimate(sketch), hll_sketch_error(sketch) * 100.0,
+           sketch->count);
+    if (sketch_out && hll_sketch_save(sketch, sketch_out) != RET_SUCCESS) {
+        printf("Error: Cannot write sketch '%s'\n", sketch_out);
+        hll_sketch_destroy(sketch);
         return 1;
     }
-    
-    hash_set* dt_hset = hash_set_create();
+    hll_sketch_destroy(sketch);
+    return 0;
+}
 
-    if (!dt_hset) {
+// Heavy-hitters mode: count values in a fixed number of Space-Saving
+// counters and write the k most frequent as "value,count" lines
+static int run_top(const char* input_path, const char* output_path, size_t k, error_sink* errors) {
+    // more values than counters could not be told apart from noise
+    size_t capacity = topk_sketch_capacity_for(k);
+    if (k > capacity) k = capacity;
+    topk_sketch* sketch = topk_sketch_create(capacity);
+    const topk_counter** top = malloc(k * sizeof(topk_counter*));
+    if (!sketch || !top) {
         printf("Error: Memory allocation failed\n");
-        fclose(input_stream);
+        topk_sketch_destroy(sketch);
+        free(top);
+        return 1;
+    }
+
+    line_reader* input_reader = line_reader_open(input_path);
+    if (!input_reader) {
+        printf("Error: Cannot open input file '%s'\n", input_path);
+        topk_sketch_destroy(sketch);
+        free(top);
         return 1;
     }
-    
-    char line[MAX_LINE_LENGTH];
-    char dt_str_buffer[MAX_LINE_LENGTH];
-    char dt_str_norm[25];
+
     printf("Processing datetime values...\n");
-    while (fgets(line, MAX_LINE_LENGTH-1, input_stream)) {
-        sscanf(line, "%255s", dt_str_buffer);
+    char dt_str_norm[DT_ISO8601_SIZE];
+    const char* block;
+    size_t block_len;
+    FunctionStatus rstat;
+    while ((rstat = line_reader_next_block(input_reader, &block, &block_len, DEDUP_BLOCK_SIZE)) == TRUE_STATUS) {
+        const char* pos = block;
+        const char* end = block + block_len;
+        while (pos < end && rstat == TRUE_STATUS) {
+            const char* newline = memchr(pos, '\n', (size_t)(end - pos));
+            const char* line_end = newline ? newline : end;
+            size_t dt_len;
+            const char* dt_str = dt_line_token(pos, (size_t)(line_end - pos), &dt_len);
+            pos = newline ? newline + 1 : end;
+            if (dt_len == 0) continue; // blank line
 
-        FunctionStatus rstat = normalize_iso8601(dt_str_buffer, dt_str_norm);
-        if (rstat == RET_SUCCESS) {
-            hash_set_insert(dt_hset, dt_str_norm);
-        } else {
-            printf("Warning: Invalid datetime format '%s' (error code: %d)\n", dt_str_buffer, rstat);
+            FunctionStatus nstat = normalize_iso8601_n(dt_str, dt_len, dt_str_norm);
+            if (nstat != RET_SUCCESS) {
+                error_sink_add(errors, dt_str, dt_len, nstat);
+                continue;
+            }
+            FunctionStatus astat = topk_sketch_add(sketch, dt_str_norm, strlen(dt_str_norm));
+            if (astat != RET_SUCCESS) rstat = astat;
+        }
+        if (rstat != TRUE_STATUS) break;
+    }
+    line_reader_close(input_reader);
+    error_sink_summary(errors);
+    if (rstat != FALSE_STATUS) {
+        printf("Error: Processing failed (error code: %d)\n", rstat);
+        topk_sketch_destroy(sketch);
+        free(top);
+        return 1;
+    }
+
+    FILE* output_stream = fopen(output_path, "w");
+    if (!output_stream) {
+        printf("Error: Cannot create output file '%s'\n", output_path);
+        topk_sketch_destroy(sketch);
+        free(top);
+        return 1;
+    }
+    size_t shown = topk_sketch_top(sketch, top, k);
+    uint64_t max_error = 0;
+    // "value,count,error" lines: the value occurred at least count and at
+    // most count + error times; built in a buffer, one fwrite per buffer full
+    char buffer[TOP_PRINT_BUFFER];
+    size_t used = 0;
+    for (size_t i = 0; i < shown; i++) {
+        if (sizeof(buffer) - used < TOPK_SKETCH_VALUE_SIZE + 2 * DT_COUNT_SUFFIX_MAX) {
+            fwrite(buffer, 1, used, output_stream);
+            used = 0;
+        }
+        memcpy(buffer + used, top[i]->value, top[i]->len);
+        used += top[i]->len;
+        // the error's suffix overwrites the count's newline
+        used += (size_t)dt_format_count_suffix(top[i]->count - top[i]->error, buffer + used) - 1;
+        used += (size_t)dt_format_count_suffix(top[i]->error, buffer + used);
+        if (top[i]->error > max_error) max_error = top[i]->error;
+    }
+    fwrite(buffer, 1, used, output_stream);
+    int write_failed = ferror(output_stream);
+    if (fclose(output_stream) != 0 || write_failed) {
+        printf("Error: Cannot write output file '%s'\n", output_path);
+        topk_sketch_destroy(sketch);
+        free(top);
+        return 1;
+    }
+
+    printf("Top %zu of %llu valid datetime values (%zu counters, %zu bytes); "
+           "true counts exceed the written ones by at most %llu\n",
+           shown, (unsigned long long)sketch->total, sketch->capacity,
+           topk_sketch_memory_usage(sketch), (unsigned long long)max_error);
+    if (shown < k) {
+        printf("Warning: %zu of the top %zu could not be told apart from values that "
+               "took over counters and were left out\n", k - shown, k);
+    }
+    topk_sketch_destroy(sketch);
+    free(top);
+    return 0;
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options] <input_file>... <output_stream>\n", prog);
+    printf("       %s --inputs-from LIST [options] [<input_file>...] <output_stream>\n", prog);
+    printf("       %s --stream [options] [<input_file> [<output_stream>]]\n", prog);
+    printf("       %s --count-approx[=ERROR] [options] [--inputs-from LIST] [<input_file>...]\n", prog);
+    printf("       %s --top K [options] <input_file> <output_stream>\n", prog);
+    printf("  <input_file> may be - to read from stdin; where several are taken, also a\n");
+    printf("  quoted glob pattern (--stream, --spill and --top read a single file)\n");
+    printf("Options:\n");
+    printf("  -p, --packed          deduplicate packed 64-bit keys instead of strings\n");
+    printf("  -j, --jobs N          parse and deduplicate on N threads (same output)\n");
+    printf("  -s, --stream          write each value as soon as it is first seen;\n");
+    printf("                        input and output default to stdin and stdout\n");
+    printf("  -S, --spill           dedup more values than fit in memory through sorted\n");
+    printf("                        runs on disk; the output comes out sorted\n");
+    printf("  -m, --max-memory N    keep stream or spill mode within about N bytes\n");
+    printf("                        (K, M, G suffixes)\n");
+    printf("  -w, --window DURATION stream mode that only suppresses repeats within the last\n");
+    printf("                        DURATION of event time (s, m, h, d suffixes), in memory\n");
+    printf("                        bounded by the window (implies --stream)\n");
+    printf("  -T, --tmp-dir DIR     where spill mode writes its runs (default $TMPDIR or /tmp)\n");
+    printf("      --inputs-from LIST\n");
+    printf("                        also read the files listed in LIST, one path per line\n");
+    printf("                        (- for stdin); -j spreads the files over N threads\n");
+    printf("      --file-stats FILE write bytes, lines, invalid and new values per input\n");
+    printf("                        file to FILE as CSV\n");
+    printf("      --sorted          write the values in chronological order, sorting\n");
+    printf("                        on -j threads or else on every CPU\n");
+    printf("      --max-warnings N  print at most N invalid lines (default %d), count the rest\n",
+           ERROR_SINK_DEFAULT_WARNINGS);
+    printf("      --rejects FILE    write every invalid line to FILE\n");
+    printf("      --stats           print stage timings, invalid lines by error code and\n");
+    printf("                        set statistics as JSON on stderr at exit\n");
+    printf("      --snapshot FILE   write only values not in the snapshot FILE, then add\n");
+    printf("                        this run's values to it (implies -p; FILE may not exist yet)\n");
+    printf("      --count-approx[=ERROR]\n");
+    printf("                        only estimate the number of unique values, within a\n");
+    printf("                        standard error of ERROR (default %g) in constant memory\n",
+           HLL_SKETCH_DEFAULT_ERROR);
+    printf("      --sketch-in FILE  add the values counted in a saved sketch (repeatable)\n");
+    printf("      --sketch-out FILE save the sketch of this count for later merging\n");
+    printf("      --binary          write the values as a sorted, delta-encoded key block\n");
+    printf("                        file (implies -p; read it back with datetime_decode)\n");
+    printf("      --counts          write each unique value as \"value,count\" with the number\n");
+    printf("                        of times it occurred\n");
+    printf("      --top K           only write the K most frequent values as\n");
+    printf("                        \"value,count,error\", counted in bounded memory: each\n");
+    printf("                        occurred count to count + error times; values that\n");
+    printf("                        cannot be told apart from noise are left out\n");
+}
+
+// Options without a short form
+enum {
+    OPT_SORTED = 256,
+    OPT_STATS,
+    OPT_MAX_WARNINGS,
+    OPT_REJECTS,
+    OPT_SNAPSHOT,
+    OPT_COUNT_APPROX,
+    OPT_SKETCH_IN,
+    OPT_SKETCH_OUT,
+    OPT_COUNTS,
+    OPT_TOP,
+    OPT_BINARY,
+    OPT_INPUTS_FROM,
+    OPT_FILE_STATS
+};
+
+// Close the error sink, which finishes the rejects file
+// return the exit status of the program given that of the run
+static int finish_errors(error_sink* errors, int exit_status) {
+    FunctionStatus rstat = error_sink_destroy(errors);
+    if (rstat != RET_SUCCESS) {
+        fprintf(stderr, "Error: Cannot write rejects file (error code: %d)\n", rstat);
+        return 1;
+    }
+    return exit_status;
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"packed", no_argument, NULL, 'p'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"stream", no_argument, NULL, 's'},
+        {"spill", no_argument, NULL, 'S'},
+        {"max-memory", required_argument, NULL, 'm'},
+        {"tmp-dir", required_argument, NULL, 'T'},
+        {"window", required_argument, NULL, 'w'},
+        {"sorted", no_argument, NULL, OPT_SORTED},
+        {"stats", no_argument, NULL, OPT_STATS},
+        {"max-warnings", required_argument, NULL, OPT_MAX_WARNINGS},
+        {"rejects", required_argument, NULL, OPT_REJECTS},
+        {"snapshot", required_argument, NULL, OPT_SNAPSHOT},
+        {"count-approx", optional_argument, NULL, OPT_COUNT_APPROX},
+        {"sketch-in", required_argument, NULL, OPT_SKETCH_IN},
+        {"sketch-out", required_argument, NULL, OPT_SKETCH_OUT},
+        {"counts", no_argument, NULL, OPT_COUNTS},
+        {"top", required_argument, NULL, OPT_TOP},
+        {"binary", no_argument, NULL, OPT_BINARY},
+        {"inputs-from", required_argument, NULL, OPT_INPUTS_FROM},
+        {"file-stats", required_argument, NULL, OPT_FILE_STATS},
+        {NULL, 0, NULL, 0}
+    };
+
+    int packed = 0;
+    int num_threads = 1;
+    int stream = 0;
+    int spill = 0;
+    int sorted = 0;
+    int want_stats = 0;
+    size_t max_warnings = ERROR_SINK_DEFAULT_WARNINGS;
+    const char* rejects_path = NULL;
+    const char* snapshot_path = NULL;
+    int count_approx = 0;
+    double approx_error = HLL_SKETCH_DEFAULT_ERROR;
+    const char* sketch_paths[argc];
+    int sketch_count = 0;
+    const char* sketch_out = NULL;
+    int counts = 0;
+    int binary = 0;
+    const char* inputs_from = NULL;
+    const char* file_stats_path = NULL;
+    size_t top_k = 0;
+    size_t memory_limit = 0;
+    uint64_t window_seconds = 0;
+    const char* tmp_dir = getenv("TMPDIR");
+    if (!tmp_dir || !*tmp_dir) tmp_dir = "/tmp";
+    int opt;
+    while ((opt = getopt_long(argc, argv, "pj:sSm:T:w:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'p':
+            packed = 1;
+            break;
+        case 'j':
+            num_threads = atoi(optarg);
+            if (num_threads < 1 || num_threads > PIPELINE_MAX_THREADS) {
+                printf("Error: -j expects a thread count from 1 to %d\n", PIPELINE_MAX_THREADS);
+                return 1;
+            }
+            break;
+        case 's':
+            stream = 1;
+            break;
+        case 'S':
+            spill = 1;
+            break;
+        case 'm':
+            memory_limit = parse_size(optarg);
+            if (memory_limit == 0) {
+                printf("Error: -m expects a size such as 512M or 8G\n");
+                return 1;
+            }
+            break;
+        case 'T':
+            tmp_dir = optarg;
+            break;
+        case 'w':
+            // the window applies to the stream
+            window_seconds = parse_duration(optarg);
+            if (window_seconds == 0 || window_seconds > WINDOW_SET_MAX_SECONDS) {
+                printf("Error: --window expects a duration from 1s to 366d, such as 10m\n");
+                return 1;
+            }
+            stream = 1;
+            break;
+        case OPT_SORTED:
+            sorted = 1;
+            break;
+        case OPT_STATS:
+            want_stats = 1;
+            break;
+        case OPT_MAX_WARNINGS: {
+            char* end;
+            max_warnings = strtoull(optarg, &end, 10);
+            if (end == optarg || *end != '\0') {
+                printf("Error: --max-warnings expects a number of lines\n");
+                return 1;
+            }
+            break;
+        }
+        case OPT_REJECTS:
+            rejects_path = optarg;
+            break;
+        case OPT_COUNT_APPROX:
+            count_approx = 1;
+            if (optarg) {
+                char* end;
+                approx_error = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || !(approx_error > 0 && approx_error < 1)) {
+                    printf("Error: --count-approx expects a relative error such as 0.01\n");
+                    return 1;
+                }
+            }
+            break;
+        case OPT_SKETCH_IN:
+            sketch_paths[sketch_count++] = optarg;
+            break;
+        case OPT_SKETCH_OUT:
+            sketch_out = optarg;
+            break;
+        case OPT_COUNTS:
+            counts = 1;
+            break;
+        case OPT_INPUTS_FROM:
+            inputs_from = optarg;
+            break;
+        case OPT_FILE_STATS:
+            file_stats_path = optarg;
+            break;
+        case OPT_BINARY:
+            // the blocks hold packed keys
+            binary = 1;
+            packed = 1;
+            break;
+        case OPT_TOP: {
+            char* end;
+            top_k = strtoull(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || top_k == 0) {
+                printf("Error: --top expects a number of values\n");
+                return 1;
+            }
+            break;
+        }
+        case OPT_SNAPSHOT:
+            // the snapshot holds packed keys
+            snapshot_path = optarg;
+            packed = 1;
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((sketch_count || sketch_out) && !count_approx) {
+        printf("Error: --sketch-in and --sketch-out only apply to --count-approx\n");
+        return 1;
+    }
+    if (top_k) {
+        if (count_approx || counts || packed || stream || spill || sorted || want_stats ||
+            snapshot_path || num_threads > 1 || memory_limit || inputs_from || file_stats_path) {
+            printf("Error: --top only combines with the warning options\n");
+            return 1;
+        }
+        if (argc - optind != 2) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        error_sink* errors = error_sink_create(stdout, max_warnings, rejects_path);
+        if (!errors) {
+            printf("Error: Cannot create rejects file '%s'\n", rejects_path);
+            return 1;
+        }
+        int exit_status = run_top(argv[optind], argv[optind + 1], top_k, errors);
+        return finish_errors(errors, exit_status);
+    }
+    if (count_approx) {
+        if (packed || stream || spill || sorted || want_stats || snapshot_path || num_threads > 1 ||
+            memory_limit || counts || file_stats_path) {
+            printf("Error: --count-approx only combines with the sketch, input list and warning options\n");
+            return 1;
+        }
+        if (optind == argc && !inputs_from && !sketch_count) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        // saved sketches alone are a valid run, without any input
+        input_list* inputs = NULL;
+        if (optind < argc || inputs_from) {
+            inputs = collect_inputs(argv + optind, argc - optind, inputs_from);
+            if (!inputs) return 1;
+        }
+        error_sink* errors = error_sink_create(stdout, max_warnings, rejects_path);
+        if (!errors) {
+            printf("Error: Cannot create rejects file '%s'\n", rejects_path);
+            input_list_destroy(inputs);
+            return 1;
+        }
+        int exit_status = run_count_approx(inputs, approx_error, sketch_paths, sketch_count,
+                                           sketch_out, errors);
+        input_list_destroy(inputs);
+        return finish_errors(errors, exit_status);
+    }
+
+    if (stream && spill) {
+        printf("Error: --stream and --spill cannot be combined\n");
+        return 1;
+    }
+    if (want_stats && (stream || spill)) {
+        printf("Error: --stats only applies to the default in-memory mode\n");
+        return 1;
+    }
+    if (snapshot_path && (stream || spill)) {
+        printf("Error: --snapshot only applies to the default in-memory mode\n");
+        return 1;
+    }
+    if (counts && (stream || spill)) {
+        printf("Error: --counts only applies to the default in-memory mode\n");
+        return 1;
+    }
+    if (binary && (stream || spill || counts)) {
+        printf("Error: --binary only applies to the default in-memory mode, without --counts\n");
+        return 1;
+    }
+    if ((inputs_from || file_stats_path) && (stream || spill)) {
+        printf("Error: --inputs-from and --file-stats only apply to the default in-memory mode\n");
+        return 1;
+    }
+    if (memory_limit && window_seconds) {
+        printf("Error: --window bounds memory by itself and does not take -m\n");
+        return 1;
+    }
+    if (memory_limit && !stream && !spill) {
+        printf("Error: -m only applies to --stream and --spill\n");
+        return 1;
+    }
+    size_t min_memory = spill ? SPILL_MIN_MEMORY : STREAM_MIN_MEMORY;
+    if (memory_limit && memory_limit < min_memory) {
+        printf("Error: -m expects a size of at least %zu bytes\n", min_memory);
+        return 1;
+    }
+    if (stream) {
+        if (sorted) {
+            fprintf(stderr, "Error: --stream writes values as they come and cannot sort them\n");
+            return 1;
+        }
+        if (num_threads > 1) {
+            fprintf(stderr, "Error: --stream runs on a single thread\n");
+            return 1;
+        }
+        if (argc - optind > 2) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        // warnings stay on stderr, stdout may be carrying the values
+        error_sink* errors = error_sink_create(stderr, max_warnings, rejects_path);
+        if (!errors) {
+            fprintf(stderr, "Error: Cannot create rejects file '%s'\n", rejects_path);
+            return 1;
+        }
+        int exit_status = run_stream(optind < argc ? argv[optind] : "-",
+                                     optind + 1 < argc ? argv[optind + 1] : "-",
+                                     packed, memory_limit, window_seconds, errors);
+        return finish_errors(errors, exit_status);
+    }
+
+    // every argument before the output is an input; spill mode takes one
+    if (argc - optind < (inputs_from ? 1 : 2) || (spill && argc - optind != 2)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char* output_path = argv[argc - 1];
+    error_sink* errors = error_sink_create(stdout, max_warnings, rejects_path);
+    if (!errors) {
+        printf("Error: Cannot create rejects file '%s'\n", rejects_path);
+        return 1;
+    }
+    dedup_stats run_stats;
+    dedup_stats* stats = NULL;
+    if (want_stats) {
+        stats = &run_stats;
+        dedup_stats_init(stats, packed, num_threads);
+    }
+
+    // spill mode output is sorted already, --sorted changes nothing there
+    if (spill) {
+        if (num_threads > 1) {
+            printf("Error: --spill runs on a single thread\n");
+            return finish_errors(errors, 1);
+        }
+        int exit_status = run_spill(argv[optind], output_path,
+                                    memory_limit ? memory_limit : SPILL_DEFAULT_MEMORY, tmp_dir, errors);
+        return finish_errors(errors, exit_status);
+    }
+
+    key_snapshot* snapshot = NULL;
+    if (snapshot_path) {
+        snapshot = key_snapshot_open(snapshot_path);
+        if (!snapshot) {
+            printf("Error: Cannot open snapshot '%s'\n", snapshot_path);
+            return finish_errors(errors, 1);
+        }
+    }
+
+    input_list* inputs = collect_inputs(argv + optind, argc - optind - 1, inputs_from);
+    if (!inputs) {
+        key_snapshot_close(snapshot);
+        return finish_errors(errors, 1);
+    }
+    // a single input keeps the -j pipeline, which splits one file into
+    // chunks; several are spread over the threads file by file
+    int multi = inputs->count > 1 || file_stats_path;
+    line_reader* input_reader = NULL;
+    if (!multi) {
+        input_reader = line_reader_open(inputs->paths[0]);
+        if (!input_reader) {
+            printf("Error: Cannot open input file '%s'\n", inputs->paths[0]);
+            input_list_destroy(inputs);
+            key_snapshot_close(snapshot);
+            return finish_errors(errors, 1);
+        }
+    }
+
+    hash_set* dt_hset = NULL;
+    key_set* dt_kset = NULL;
+    if (packed) {
+        dt_kset = key_set_create();
+        if (dt_kset && counts && key_set_count_occurrences(dt_kset) != RET_SUCCESS) {
+            key_set_destroy(dt_kset);
+            dt_kset = NULL;
         }
+    } else {
+        dt_hset = hash_set_create();
+    }
+
+    if (!dt_hset && !dt_kset) {
+        printf("Error: Memory allocation failed\n");
+        line_reader_close(input_reader);
+        input_list_destroy(inputs);
+        key_snapshot_close(snapshot);
+        return finish_errors(errors, 1);
+    }
 
+    printf("Processing datetime values...\n");
+    FunctionStatus rstat;
+    multi_file_stats* file_stats = NULL;
+    if (multi) {
+        size_t failed = 0;
+        file_stats = calloc(inputs->count, sizeof(multi_file_stats));
+        rstat = file_stats ? multi_dedup_run(inputs, packed, num_threads, dt_hset, dt_kset, file_stats,
+                                             &failed, stats, errors)
+                           : MEMORY_ALLOCATION_ERR;
+        if (rstat == FILE_IO_ERR) printf("Error: Cannot read input file '%s'\n", inputs->paths[failed]);
+        if (rstat == RET_SUCCESS && file_stats_path &&
+            write_file_stats(file_stats_path, inputs, file_stats) != RET_SUCCESS) {
+            printf("Error: Cannot write file statistics '%s'\n", file_stats_path);
+            rstat = FILE_IO_ERR;
+        }
+    } else if (num_threads > 1) {
+        rstat = dedup_pipeline_run(input_reader, packed, num_threads, &dt_hset, &dt_kset, stats, errors);
+    } else {
+        rstat = multi_dedup_reader(input_reader, packed, dt_hset, dt_kset, stats, errors);
+    }
+    if (rstat == RET_SUCCESS && snapshot) {
+        double filter_mark = dedup_stats_mark(stats);
+        rstat = key_set_filter(dt_kset, snapshot_lacks, snapshot);
+        dedup_stats_lap(stats, DEDUP_STAGE_INSERT, &filter_mark);
+    }
+    free(file_stats);
+    input_list_destroy(inputs);
+    error_sink_summary(errors);
+    if (rstat != RET_SUCCESS) {
+        printf("Error: Processing failed (error code: %d)\n", rstat);
+        line_reader_close(input_reader);
+        hash_set_destroy(dt_hset);
+        key_set_destroy(dt_kset);
+        key_snapshot_close(snapshot);
+        return finish_errors(errors, 1);
     }
     printf("\n\nUnique valid datetime values:\n");
-    fclose(input_stream);
-    
+    line_reader_close(input_reader);
+
     // Write unique valid datetime values to output file
-    FILE* output_stream = fopen(argv[2], "w");
-    if (!output_stream) {
-        printf("Error: Cannot create output file '%s'\n", argv[2]);
+    FILE* output_stream = binary ? NULL : fopen(output_path, "w");
+    if (!binary && !output_stream) {
+        printf("Error: Cannot create output file '%s'\n", output_path);
         hash_set_destroy(dt_hset);
-        return 1;
+        key_set_destroy(dt_kset);
+        key_snapshot_close(snapshot);
+        return finish_errors(errors, 1);
     }
 
-    hash_set_print(output_stream, dt_hset);
-    fclose(output_stream);
-    
+    double mark = dedup_stats_mark(stats);
+    int sort_threads = num_threads > 1 ? num_threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (binary) {
+        rstat = write_key_blocks(output_path, dt_kset, sort_threads, stats);
+        mark = dedup_stats_mark(stats);
+    } else if (sorted) {
+        rstat = print_sorted(output_stream, packed, counts, dt_hset, dt_kset, sort_threads, stats);
+        mark = dedup_stats_mark(stats);
+    } else if (counts && packed) {
+        key_set_print_counts(output_stream, dt_kset);
+    } else if (counts) {
+        hash_set_print_counts(output_stream, dt_hset, NULL);
+    } else if (packed) {
+        key_set_print(output_stream, dt_kset);
+    } else {
+        hash_set_print(output_stream, dt_hset);
+    }
+    if (output_stream) {
+        int write_failed = ferror(output_stream);
+        if ((fclose(output_stream) != 0 || write_failed) && rstat == RET_SUCCESS) rstat = FILE_IO_ERR;
+    }
+    dedup_stats_lap(stats, DEDUP_STAGE_WRITE, &mark);
+    if (rstat != RET_SUCCESS) {
+        if (binary || rstat == FILE_IO_ERR) {
+            printf("Error: Cannot write output file '%s' (error code: %d)\n", output_path, rstat);
+        } else {
+            printf("Error: Sorting failed (error code: %d)\n", rstat);
+        }
+        hash_set_destroy(dt_hset);
+        key_set_destroy(dt_kset);
+        key_snapshot_close(snapshot);
+        return finish_errors(errors, 1);
+    }
+
+    if (snapshot) {
+        size_t known = key_snapshot_get_size(snapshot);
+        rstat = update_snapshot(snapshot_path, snapshot, dt_kset, sort_threads);
+        key_snapshot_close(snapshot);
+        dedup_stats_lap(stats, DEDUP_STAGE_WRITE, &mark);
+        if (rstat != RET_SUCCESS) {
+            printf("Error: Cannot write snapshot '%s' (error code: %d)\n", snapshot_path, rstat);
+            hash_set_destroy(dt_hset);
+            key_set_destroy(dt_kset);
+            return finish_errors(errors, 1);
+        }
+        printf("Snapshot '%s': %zu known values, %zu new\n", snapshot_path, known,
+               key_set_get_size(dt_kset));
+    }
+
+    if (stats) dedup_stats_print(stderr, stats, errors, dt_hset, dt_kset);
     hash_set_destroy(dt_hset);
-    
-    return 0;
+    key_set_destroy(dt_kset);
+
+    return finish_errors(errors, 0);
 }
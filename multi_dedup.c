@@ -0,0 +1,494 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <glob.h>
+#include <sys/stat.h>
+
+#include "multi_dedup.h"
+#include "datetime_util.h"
+
+#define MULTI_DEDUP_NO_FILE     SIZE_MAX
+
+// Parse buffers of one batch of lines, one set per thread
+typedef struct multi_batch_struct {
+    char str[DEDUP_BATCH_LINES][DT_ISO8601_SIZE];
+    const char *ptrs[DEDUP_BATCH_LINES];
+    dt_key keys[DEDUP_BATCH_LINES];
+} multi_batch;
+
+// An invalid line of a file read by a worker
+typedef struct multi_invalid_struct {
+    size_t offset;      // into the result's text
+    size_t len;
+    FunctionStatus status;
+} multi_invalid;
+
+// A file read by a worker, waiting for its turn to be merged. The
+// invalid lines are copied, the file is unmapped by then.
+typedef struct multi_result_struct {
+    hash_set *hset;
+    key_set *kset;
+    char *text;
+    size_t text_used;
+    size_t text_capacity;
+    multi_invalid *invalid;
+    size_t invalid_count;
+    size_t invalid_capacity;
+    FunctionStatus status;
+    int ready;                  // guarded by the run's mutex
+} multi_result;
+
+// Files of one worker: position p holds file id + p * num_threads. The
+// owner takes from the front and thieves from the back, each with one
+// compare-and-swap of both ends.
+typedef struct multi_deque_struct {
+    uint64_t bounds;            // front in the high half, back in the low half
+    char pad[56];               // one deque per cache line
+} multi_deque;
+
+typedef struct multi_run_struct {
+    const input_list *inputs;
+    int packed;
+    int counting;               // keep the occurrences of values for the merge
+    int num_threads;
+    multi_deque *deques;
+    multi_result *results;
+    multi_file_stats *files;
+    int stop;                   // set once the merge has failed
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+} multi_run;
+
+typedef struct multi_worker_struct {
+    multi_run *run;
+    int id;
+} multi_worker;
+
+input_list* input_list_create(void) {
+    return calloc(1, sizeof(input_list));
+}
+
+void input_list_destroy(input_list *list) {
+    if (!list) return;
+
+    for (size_t i = 0; i < list->count; i++) free(list->paths[i]);
+    free(list->paths);
+    free(list);
+}
+
+// Append a copy of the len bytes of path
+// return TRUE_STATUS, or MEMORY_ALLOCATION_ERR
+static FunctionStatus input_list_push(input_list *list, const char *path, size_t len) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        char **paths = realloc(list->paths, capacity * sizeof(char *));
+        if (!paths) return MEMORY_ALLOCATION_ERR;
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    char *copy = malloc(len + 1);
+    if (!copy) return MEMORY_ALLOCATION_ERR;
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+    list->paths[list->count++] = copy;
+    return TRUE_STATUS;
+}
+
+// Add path, or if it holds glob characters and names no file itself, the
+// paths matching it in sorted order; quoting a pattern keeps it from the
+// shell, whose command line may not hold thousands of names
+// return TRUE_STATUS, FALSE_STATUS if the pattern matches nothing, or a
+// negative status
+FunctionStatus input_list_add(input_list *list, const char *path) {
+    if (!list || !path) return NULL_INPUT_POINTER;
+
+    struct stat st;
+    if (!strpbrk(path, "*?[") || stat(path, &st) == 0) return input_list_push(list, path, strlen(path));
+
+    glob_t matches;
+    int gstat = glob(path, 0, NULL, &matches);
+    if (gstat != 0) {
+        if (gstat != GLOB_NOMATCH) globfree(&matches);
+        return gstat == GLOB_NOMATCH ? FALSE_STATUS
+             : gstat == GLOB_NOSPACE ? MEMORY_ALLOCATION_ERR : FILE_IO_ERR;
+    }
+    FunctionStatus rstat = TRUE_STATUS;
+    for (size_t i = 0; i < matches.gl_pathc && rstat == TRUE_STATUS; i++) {
+        rstat = input_list_push(list, matches.gl_pathv[i], strlen(matches.gl_pathv[i]));
+    }
+    globfree(&matches);
+    return rstat;
+}
+
+// Add the paths listed in list_path ("-" for stdin), one per line and
+// taken as they are; blank lines are skipped
+// return RET_SUCCESS, FILE_IO_ERR if the list cannot be read, or a
+// negative status
+FunctionStatus input_list_add_file(input_list *list, const char *list_path) {
+    if (!list || !list_path) return NULL_INPUT_POINTER;
+
+    line_reader *reader = line_reader_open(list_path);
+    if (!reader) return FILE_IO_ERR;
+
+    const char *line;
+    size_t len;
+    FunctionStatus rstat;
+    while ((rstat = line_reader_next(reader, &line, &len)) == TRUE_STATUS) {
+        if (len && line[len - 1] == '\r') len--;
+        if (len == 0) continue;
+        rstat = input_list_push(list, line, len);
+        if (rstat != TRUE_STATUS) break;
+    }
+    line_reader_close(reader);
+    return rstat == FALSE_STATUS ? RET_SUCCESS : rstat;
+}
+
+// Grow a buffer to hold needed elements
+// return 1, or 0 if it cannot grow
+static int multi_reserve(void **data, size_t *capacity, size_t needed, size_t elem_size) {
+    if (needed <= *capacity) return 1;
+
+    size_t grown = *capacity ? *capacity * 2 : 256;
+    while (grown < needed) grown *= 2;
+    void *moved = realloc(*data, grown * elem_size);
+    if (!moved) return 0;
+    *data = moved;
+    *capacity = grown;
+    return 1;
+}
+
+// Copy an invalid line into result for the merge to report
+// return 1, or 0 if it cannot be kept
+static int multi_result_keep_invalid(multi_result *result, const char *line, size_t len,
+                                     FunctionStatus status) {
+    if (!multi_reserve((void **)&result->text, &result->text_capacity, result->text_used + len, 1) ||
+        !multi_reserve((void **)&result->invalid, &result->invalid_capacity, result->invalid_count + 1,
+                       sizeof(multi_invalid))) {
+        return 0;
+    }
+    multi_invalid *bad = &result->invalid[result->invalid_count++];
+    bad->offset = result->text_used;
+    bad->len = len;
+    bad->status = status;
+    memcpy(result->text + result->text_used, line, len);
+    result->text_used += len;
+    return 1;
+}
+
+static void multi_result_free(multi_result *result) {
+    hash_set_destroy(result->hset);
+    key_set_destroy(result->kset);
+    free(result->text);
+    free(result->invalid);
+    result->hset = NULL;
+    result->kset = NULL;
+    result->text = NULL;
+    result->invalid = NULL;
+}
+
+// Dedup everything left in reader into hset, or kset when packed,
+// counting its bytes and lines into file. Invalid lines go to errors, or
+// into deferred when it is given.
+// return RET_SUCCESS, FILE_IO_ERR if the input cannot be read, or a
+// negative status
+static FunctionStatus multi_dedup_lines(line_reader *reader, int packed, multi_batch *batch,
+                                        hash_set *hset, key_set *kset, multi_file_stats *file,
+                                        multi_result *deferred, dedup_stats *stats, error_sink *errors) {
+    const char *block;
+    size_t block_len;
+    FunctionStatus lstat = FALSE_STATUS;
+    FunctionStatus rstat = RET_SUCCESS;
+    double mark = dedup_stats_mark(stats);
+    while (rstat == RET_SUCCESS &&
+           (lstat = line_reader_next_block(reader, &block, &block_len, DEDUP_BLOCK_SIZE)) == TRUE_STATUS) {
+        dedup_stats_lap(stats, DEDUP_STAGE_READ, &mark);
+        file->bytes += block_len;
+        const char *pos = block;
+        const char *end = block + block_len;
+        while (pos < end && rstat == RET_SUCCESS) {
+            size_t count = 0;
+            for (; pos < end && count < DEDUP_BATCH_LINES;) {
+                const char *newline = memchr(pos, '\n', (size_t)(end - pos));
+                const char *line_end = newline ? newline : end;
+                size_t dt_len;
+                const char *dt_str = dt_line_token(pos, (size_t)(line_end - pos), &dt_len);
+                pos = newline ? newline + 1 : end;
+                if (dt_len == 0) continue; // blank line
+                file->lines++;
+
+                FunctionStatus pstat = packed
+                    ? normalize_iso8601_key_n(dt_str, dt_len, &batch->keys[count])
+                    : normalize_iso8601_n(dt_str, dt_len, batch->str[count]);
+                if (pstat != RET_SUCCESS) {
+                    file->invalid++;
+                    if (!deferred) {
+                        error_sink_add(errors, dt_str, dt_len, pstat);
+                    } else if (!multi_result_keep_invalid(deferred, dt_str, dt_len, pstat)) {
+                        rstat = MEMORY_ALLOCATION_ERR;
+                    }
+                    continue;
+                }
+                batch->ptrs[count] = batch->str[count];
+                count++;
+            }
+            dedup_stats_lap(stats, DEDUP_STAGE_PARSE, &mark);
+
+            FunctionStatus istat = packed
+                ? key_set_insert_batch(kset, batch->keys, count, NULL)
+                : hash_set_insert_batch(hset, batch->ptrs, NULL, count, NULL);
+            // a set that cannot grow would silently drop values
+            if (istat < 0) rstat = istat;
+            dedup_stats_lap(stats, DEDUP_STAGE_INSERT, &mark);
+        }
+    }
+    if (rstat == RET_SUCCESS && lstat != FALSE_STATUS) rstat = lstat;
+    if (stats) stats->lines += file->lines;
+    return rstat;
+}
+
+// Dedup the file at path, timing it into file
+// return: as multi_dedup_lines
+static FunctionStatus multi_dedup_file(const char *path, int packed, multi_batch *batch,
+                                       hash_set *hset, key_set *kset, multi_file_stats *file,
+                                       multi_result *deferred, dedup_stats *stats, error_sink *errors) {
+    double start = dedup_stats_now();
+    line_reader *reader = line_reader_open(path);
+    if (!reader) return FILE_IO_ERR;
+
+    FunctionStatus rstat = multi_dedup_lines(reader, packed, batch, hset, kset, file, deferred, stats, errors);
+    line_reader_close(reader);
+    file->seconds = dedup_stats_now() - start;
+    return rstat;
+}
+
+// Single-threaded dedup of everything left in reader into hset, or kset
+// when packed, reporting invalid lines to errors as they come
+// return RET_SUCCESS, or a negative status
+FunctionStatus multi_dedup_reader(line_reader *reader, int packed, hash_set *hset, key_set *kset,
+                                  dedup_stats *stats, error_sink *errors) {
+    if (!reader || (packed ? !kset : !hset)) return NULL_INPUT_POINTER;
+
+    multi_batch *batch = malloc(sizeof(multi_batch));
+    if (!batch) return MEMORY_ALLOCATION_ERR;
+    multi_file_stats file;
+    memset(&file, 0, sizeof(file));
+    FunctionStatus rstat = multi_dedup_lines(reader, packed, batch, hset, kset, &file, NULL, stats, errors);
+    free(batch);
+    return rstat;
+}
+
+// Insert a worker's set into the run's set in its first-seen order,
+// carrying its counts along
+// return RET_SUCCESS, or a negative status
+static FunctionStatus multi_merge(multi_result *result, int packed, hash_set *hset, key_set *kset,
+                                  size_t *added) {
+    FunctionStatus istat = RET_SUCCESS;
+    if (packed) {
+        size_t before = key_set_get_size(kset);
+        key_set *from = result->kset;
+        for (size_t i = 0; i < from->count && istat >= 0; i++) {
+            istat = key_set_insert_counted(kset, from->keys[i], key_set_get_count(from, i));
+        }
+        *added = key_set_get_size(kset) - before;
+    } else {
+        size_t before = hash_set_get_size(hset);
+        hash_set *from = result->hset;
+        for (size_t i = 0; i < from->count && istat >= 0; i++) {
+            const hash_node *node = &from->node_blocks[i >> HASH_SET_NODE_BLOCK_SHIFT][i & (HASH_SET_NODE_BLOCK - 1)];
+            istat = hash_set_insert_counted(hset, node->key, node->key_len, node->hash, node->count);
+        }
+        *added = hash_set_get_size(hset) - before;
+    }
+    return istat < 0 ? istat : RET_SUCCESS;
+}
+
+// Take a file from the front of deque d, or its back when stealing
+// return the file number, or MULTI_DEDUP_NO_FILE if the deque is empty
+static size_t multi_deque_take(multi_run *run, int d, int steal) {
+    multi_deque *deque = &run->deques[d];
+    uint64_t bounds = __atomic_load_n(&deque->bounds, __ATOMIC_ACQUIRE);
+    for (;;) {
+        uint64_t front = bounds >> 32;
+        uint64_t back = bounds & UINT32_MAX;
+        if (front >= back) return MULTI_DEDUP_NO_FILE;
+
+        uint64_t taken = steal ? bounds - 1 : bounds + ((uint64_t)1 << 32);
+        uint64_t position = steal ? back - 1 : front;
+        if (__atomic_compare_exchange_n(&deque->bounds, &bounds, taken, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return (size_t)d + (size_t)position * (size_t)run->num_threads;
+        }
+    }
+}
+
+static FunctionStatus multi_result_init(multi_result *result, const multi_run *run) {
+    if (run->packed) {
+        result->kset = key_set_create();
+        if (result->kset && run->counting && key_set_count_occurrences(result->kset) != RET_SUCCESS) {
+            return MEMORY_ALLOCATION_ERR;
+        }
+    } else {
+        result->hset = hash_set_create();
+    }
+    return result->hset || result->kset ? RET_SUCCESS : MEMORY_ALLOCATION_ERR;
+}
+
+static void* multi_worker_main(void *arg) {
+    multi_worker *worker = arg;
+    multi_run *run = worker->run;
+    multi_batch *batch = malloc(sizeof(multi_batch));
+
+    while (!__atomic_load_n(&run->stop, __ATOMIC_RELAXED)) {
+        // own files first, then the last ones of the other workers
+        size_t f = multi_deque_take(run, worker->id, 0);
+        for (int v = 1; f == MULTI_DEDUP_NO_FILE && v < run->num_threads; v++) {
+            f = multi_deque_take(run, (worker->id + v) % run->num_threads, 1);
+        }
+        if (f == MULTI_DEDUP_NO_FILE) break;
+
+        multi_result *result = &run->results[f];
+        FunctionStatus rstat = batch ? multi_result_init(result, run) : MEMORY_ALLOCATION_ERR;
+        if (rstat == RET_SUCCESS) {
+            rstat = multi_dedup_file(run->inputs->paths[f], run->packed, batch, result->hset, result->kset,
+                                     &run->files[f], result, NULL, NULL);
+        }
+
+        pthread_mutex_lock(&run->mutex);
+        result->status = rstat;
+        result->ready = 1;
+        pthread_cond_broadcast(&run->ready);
+        pthread_mutex_unlock(&run->mutex);
+    }
+
+    free(batch);
+    return NULL;
+}
+
+// One file after the other, straight into the run's set
+static FunctionStatus multi_dedup_sequential(const input_list *inputs, int packed, hash_set *hset,
+                                             key_set *kset, multi_file_stats *files, size_t *failed,
+                                             dedup_stats *stats, error_sink *errors) {
+    multi_batch *batch = malloc(sizeof(multi_batch));
+    if (!batch) return MEMORY_ALLOCATION_ERR;
+
+    FunctionStatus rstat = RET_SUCCESS;
+    for (size_t i = 0; i < inputs->count && rstat == RET_SUCCESS; i++) {
+        size_t before = packed ? key_set_get_size(kset) : hash_set_get_size(hset);
+        rstat = multi_dedup_file(inputs->paths[i], packed, batch, hset, kset, &files[i], NULL, stats, errors);
+        files[i].added = (packed ? key_set_get_size(kset) : hash_set_get_size(hset)) - before;
+        if (rstat != RET_SUCCESS && failed) *failed = i;
+    }
+    free(batch);
+    return rstat;
+}
+
+// Merge the workers' files in list order as they come in
+static FunctionStatus multi_dedup_collect(multi_run *run, hash_set *hset, key_set *kset, size_t *failed,
+                                          dedup_stats *stats, error_sink *errors) {
+    FunctionStatus rstat = RET_SUCCESS;
+    double mark = dedup_stats_mark(stats);
+    for (size_t i = 0; i < run->inputs->count; i++) {
+        multi_result *result = &run->results[i];
+        pthread_mutex_lock(&run->mutex);
+        while (!result->ready) pthread_cond_wait(&run->ready, &run->mutex);
+        pthread_mutex_unlock(&run->mutex);
+        dedup_stats_lap(stats, DEDUP_STAGE_PARSE, &mark);
+
+        rstat = result->status;
+        if (rstat == RET_SUCCESS) {
+            for (size_t b = 0; b < result->invalid_count; b++) {
+                multi_invalid *bad = &result->invalid[b];
+                error_sink_add(errors, result->text + bad->offset, bad->len, bad->status);
+            }
+            if (stats) stats->lines += run->files[i].lines;
+            rstat = multi_merge(result, run->packed, hset, kset, &run->files[i].added);
+        }
+        multi_result_free(result);
+        dedup_stats_lap(stats, DEDUP_STAGE_INSERT, &mark);
+        if (rstat != RET_SUCCESS) {
+            if (failed) *failed = i;
+            break;
+        }
+    }
+    return rstat;
+}
+
+// Dedup every input of inputs into hset, or kset when packed, as one
+// run over their concatenation would. files receives one entry per
+// input. On failure *failed, when given, is the input it happened on;
+// FILE_IO_ERR there means the input could not be read.
+// return RET_SUCCESS, or a negative status
+FunctionStatus multi_dedup_run(const input_list *inputs, int packed, int num_threads,
+                               hash_set *hset, key_set *kset, multi_file_stats *files,
+                               size_t *failed, dedup_stats *stats, error_sink *errors) {
+    if (!inputs || !files || (packed ? !kset : !hset)) return NULL_INPUT_POINTER;
+    memset(files, 0, inputs->count * sizeof(multi_file_stats));
+    if (num_threads > MULTI_DEDUP_MAX_THREADS) num_threads = MULTI_DEDUP_MAX_THREADS;
+    if ((size_t)num_threads > inputs->count) num_threads = (int)inputs->count;
+    if (num_threads <= 1 || inputs->count > UINT32_MAX) {
+        return multi_dedup_sequential(inputs, packed, hset, kset, files, failed, stats, errors);
+    }
+
+    multi_run run;
+    memset(&run, 0, sizeof(run));
+    run.inputs = inputs;
+    run.packed = packed;
+    // hash sets always count, a key set only when asked to
+    run.counting = packed ? kset->counts != NULL : 1;
+    run.num_threads = num_threads;
+    run.files = files;
+    run.deques = calloc((size_t)num_threads, sizeof(multi_deque));
+    run.results = calloc(inputs->count, sizeof(multi_result));
+    pthread_t *threads = malloc((size_t)num_threads * sizeof(pthread_t));
+    multi_worker *workers = malloc((size_t)num_threads * sizeof(multi_worker));
+    if (!run.deques || !run.results || !threads || !workers) {
+        free(run.deques);
+        free(run.results);
+        free(threads);
+        free(workers);
+        return MEMORY_ALLOCATION_ERR;
+    }
+    // worker w owns files w, w + n, w + 2n, ...
+    for (int w = 0; w < num_threads; w++) {
+        run.deques[w].bounds = (inputs->count - (size_t)w + (size_t)num_threads - 1) / (size_t)num_threads;
+    }
+    pthread_mutex_init(&run.mutex, NULL);
+    pthread_cond_init(&run.ready, NULL);
+
+    // the files of workers that could not start are stolen by the others
+    int started = 0;
+    for (int w = 0; w < num_threads; w++) {
+        workers[started].run = &run;
+        workers[started].id = w;
+        if (pthread_create(&threads[started], NULL, multi_worker_main, &workers[started]) == 0) started++;
+    }
+
+    FunctionStatus rstat = started ? multi_dedup_collect(&run, hset, kset, failed, stats, errors)
+                                   : MEMORY_ALLOCATION_ERR;
+
+    __atomic_store_n(&run.stop, 1, __ATOMIC_RELAXED);
+    for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+    for (size_t i = 0; i < inputs->count; i++) multi_result_free(&run.results[i]);
+
+    pthread_mutex_destroy(&run.mutex);
+    pthread_cond_destroy(&run.ready);
+    free(run.deques);
+    free(run.results);
+    free(threads);
+    free(workers);
+    return rstat;
+}
+
+// Write one CSV line per input: bytes, non-blank lines, invalid lines,
+// values no earlier input held, seconds, and the path last, so a comma
+// in it does not shift the other columns
+void multi_dedup_print_file_stats(FILE *ofile, const input_list *inputs, const multi_file_stats *files) {
+    if (!ofile || !inputs || !files) return;
+
+    fprintf(ofile, "bytes,lines,invalid,new,seconds,file\n");
+    for (size_t i = 0; i < inputs->count; i++) {
+        fprintf(ofile, "%llu,%llu,%llu,%zu,%.6f,%s\n", (unsigned long long)files[i].bytes,
+                (unsigned long long)files[i].lines, (unsigned long long)files[i].invalid, files[i].added,
+                files[i].seconds, inputs->paths[i]);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef __multi_dedup_h__
+#define __multi_dedup_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+#include "hash_set.h"
+#include "key_set.h"
+#include "line_reader.h"
+#include "dedup_stats.h"
+#include "error_sink.h"
+
+#define MULTI_DEDUP_MAX_THREADS     256
+#define DEDUP_BLOCK_SIZE            (1 << 20)   // input bytes taken from a reader at a time
+#define DEDUP_BATCH_LINES           1024        // lines parsed before their values are inserted
+
+// Input paths of a run, in the order their values count as seen
+typedef struct input_list_struct {
+    char **paths;
+    size_t count;
+    size_t capacity;
+} input_list;
+
+// What one input contributed to a run
+typedef struct multi_file_stats_struct {
+    uint64_t bytes;
+    uint64_t lines;         // non-blank lines
+    uint64_t invalid;
+    size_t added;           // distinct values no earlier input held
+    double seconds;         // reading, parsing and inserting the file
+} multi_file_stats;
+
+/* Dedup of many inputs into one set.
+    The result is the one a single run over the inputs concatenated in
+    list order would give: the same keys, in the same first-seen order,
+    with the same counts, and the same invalid lines reported in order.
+    With one thread the files are read one after the other straight into
+    the set. With more, a file is the unit of work: each worker dedups
+    whole files into sets of their own, and the calling thread merges
+    those into the result strictly in list order as they come in, so a
+    file's set lives only until the files before it are done.
+    Files are dealt round-robin to per-worker deques. A worker takes its
+    own files from the front, in list order, and an idle worker steals
+    from the back of another's, the files needed last, so a few large
+    files do not hold up a worker with many small ones left behind them.
+    A file is never split, though: one file much larger than the rest
+    is better given a -j run of its own.
+    With stats, the calling thread times waiting for the workers as
+    parsing and the merge as inserting.
+    Every file goes through the same loop as the single input of a
+    plain run, multi_dedup_reader: lines are parsed a batch at a time and
+    the batch is then inserted, which keeps the normalized values in cache
+    and lets --stats time the stages with a clock reading per batch.
+*/
+
+// Function declarations
+input_list* input_list_create(void);
+void input_list_destroy(input_list *list);
+FunctionStatus input_list_add(input_list *list, const char *path);
+FunctionStatus input_list_add_file(input_list *list, const char *list_path);
+FunctionStatus multi_dedup_reader(line_reader *reader, int packed, hash_set *hset, key_set *kset,
+                                  dedup_stats *stats, error_sink *errors);
+FunctionStatus multi_dedup_run(const input_list *inputs, int packed, int num_threads,
+                               hash_set *hset, key_set *kset, multi_file_stats *files,
+                               size_t *failed, dedup_stats *stats, error_sink *errors);
+void multi_dedup_print_file_stats(FILE *ofile, const input_list *inputs, const multi_file_stats *files);
+
+#endif // __multi_dedup_h__
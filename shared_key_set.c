@@ -0,0 +1,357 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "shared_key_set.h"
+
+// Outcome of probing one table for a key
+typedef enum {
+    SHARED_SLOT_NEW,        // the key was stored in an empty slot (lookups: is not here)
+    SHARED_SLOT_FOUND,      // the key was already there
+    SHARED_SLOT_MOVED,      // the probe met a moved slot, go on in the next table
+    SHARED_SLOT_FULL        // every slot holds another key
+} shared_slot_result;
+
+// 64-bit finalizer from MurmurHash3, the same spread as key_set's
+static size_t hash_function_key(dt_key key, size_t capacity) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+
+    return (size_t)key & (capacity - 1);
+}
+
+static shared_key_table* shared_key_table_create(size_t capacity) {
+    shared_key_table *table = calloc(1, sizeof(shared_key_table) + capacity * sizeof(dt_key));
+    if (!table) return NULL;
+
+    table->capacity = capacity;
+    return table;
+}
+
+// Probe table for key and claim the first empty slot if it is not there.
+// A failed compare-and-swap leaves the probe on the same slot, which now
+// holds either the key, another key, or the moved marker.
+static shared_slot_result shared_key_table_insert(shared_key_table *table, dt_key key) {
+    size_t mask = table->capacity - 1;
+    size_t index = hash_function_key(key, table->capacity);
+
+    for (size_t probes = 0; probes < table->capacity; ) {
+        dt_key slot = __atomic_load_n(&table->slots[index], __ATOMIC_ACQUIRE);
+        if (slot == key) return SHARED_SLOT_FOUND;
+        if (slot == SHARED_KEY_SET_MOVED) return SHARED_SLOT_MOVED;
+        if (slot == 0) {
+            if (__atomic_compare_exchange_n(&table->slots[index], &slot, key, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return SHARED_SLOT_NEW;
+            }
+            continue;   // lost the slot, look at what won it
+        }
+        index = (index + 1) & mask;
+        probes++;
+    }
+    return SHARED_SLOT_FULL;
+}
+
+// Probe table for key without changing it. Moved slots are stepped over:
+// while a move is under way a key further along the probe run may not
+// have been copied yet, and one whose slot is already marked was copied
+// before the marker went in, so the next table has it.
+// return SHARED_SLOT_FOUND, or SHARED_SLOT_NEW if the key is not here
+static shared_slot_result shared_key_table_find(shared_key_table *table, dt_key key) {
+    size_t mask = table->capacity - 1;
+    size_t index = hash_function_key(key, table->capacity);
+
+    for (size_t probes = 0; probes < table->capacity; probes++) {
+        dt_key slot = __atomic_load_n(&table->slots[index], __ATOMIC_ACQUIRE);
+        if (slot == key) return SHARED_SLOT_FOUND;
+        if (slot == 0) break;
+        index = (index + 1) & mask;
+    }
+    return SHARED_SLOT_NEW;
+}
+
+// Move one slot to the next table. Only the helper that claimed the slot
+// writes it besides inserters filling it from 0, so a key, once read,
+// stays until it is replaced by the marker here. The key is copied
+// before the marker goes in, so a reader always finds it in one table.
+static void shared_key_table_move_slot(shared_key_table *table, shared_key_table *next,
+                                       size_t index) {
+    dt_key slot = __atomic_load_n(&table->slots[index], __ATOMIC_ACQUIRE);
+    while (slot == 0) {
+        if (__atomic_compare_exchange_n(&table->slots[index], &slot, SHARED_KEY_SET_MOVED, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+    }
+    if (slot == SHARED_KEY_SET_MOVED) return;
+
+    // the next table is twice the size and only receives moved keys until
+    // the move is over, so it cannot be full
+    shared_key_table_insert(next, slot);
+    __atomic_store_n(&table->slots[index], SHARED_KEY_SET_MOVED, __ATOMIC_RELEASE);
+}
+
+// Help move table into its successor: claim chunks of slots until none
+// are left, then wait for the chunks other threads claimed. Inserting into
+// the successor only after the whole move keeps a key from being stored
+// once in each table. Makes the successor current.
+// return the successor
+static shared_key_table* shared_key_set_help_move(shared_key_set *set, shared_key_table *table) {
+    shared_key_table *next = __atomic_load_n(&table->next, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        size_t start = __atomic_fetch_add(&table->migrate_claimed, SHARED_KEY_SET_MIGRATE_CHUNK,
+                                          __ATOMIC_ACQ_REL);
+        if (start >= table->capacity) break;
+        size_t end = start + SHARED_KEY_SET_MIGRATE_CHUNK;
+        if (end > table->capacity) end = table->capacity;
+        for (size_t i = start; i < end; i++) shared_key_table_move_slot(table, next, i);
+        __atomic_fetch_add(&table->migrate_done, end - start, __ATOMIC_ACQ_REL);
+    }
+    while (__atomic_load_n(&table->migrate_done, __ATOMIC_ACQUIRE) < table->capacity) {
+        sched_yield();
+    }
+
+    shared_key_table *expected = table;
+    __atomic_compare_exchange_n(&set->table, &expected, next, 0,
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return next;
+}
+
+// Publish a table twice the size of table unless another thread already
+// did, then help move into it
+// return the successor, or NULL if it could not be allocated
+static shared_key_table* shared_key_set_grow(shared_key_set *set, shared_key_table *table) {
+    if (!__atomic_load_n(&table->next, __ATOMIC_ACQUIRE)) {
+        shared_key_table *next = shared_key_table_create(table->capacity * 2);
+        if (!next) return NULL;
+
+        shared_key_table *expected = NULL;
+        if (!__atomic_compare_exchange_n(&table->next, &expected, next, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            free(next);     // another thread published first
+        }
+    }
+    return shared_key_set_help_move(set, table);
+}
+
+shared_key_set* shared_key_set_create(void) {
+    shared_key_set *set = malloc(sizeof(shared_key_set));
+    if (!set) return NULL;
+
+    set->count = 0;
+    set->first = set->table = shared_key_table_create(SHARED_KEY_SET_INITIAL_CAPACITY);
+
+    // fail check
+    if (!set->table) {
+        shared_key_set_destroy(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+// Free the set and every table it has had; no thread may still use it
+void shared_key_set_destroy(shared_key_set *set) {
+    if (!set) return;
+
+    shared_key_table *table = set->first;
+    while (table) {
+        shared_key_table *next = table->next;
+        free(table);
+        table = next;
+    }
+    free(set);
+}
+
+// Insert a packed key; safe to call from any number of threads at once
+// return TRUE_STATUS if this call added the key, FALSE_STATUS if it was
+// already there, DT_ERR_WRONG_TZ for a value that is not a packed key,
+// or a negative status on failure
+FunctionStatus shared_key_set_insert(shared_key_set *set, dt_key key) {
+    if (!set) return NULL_INPUT_POINTER;
+    // zone flags 0 and 3 are empty and moved slots
+    if (DT_KEY_ZONE(key) != DT_KEY_LOCAL && DT_KEY_ZONE(key) != DT_KEY_UTC) return DT_ERR_WRONG_TZ;
+
+    shared_key_table *table = __atomic_load_n(&set->table, __ATOMIC_ACQUIRE);
+    for (;;) {
+        if (__atomic_load_n(&table->next, __ATOMIC_ACQUIRE)) {
+            table = shared_key_set_help_move(set, table);
+            continue;
+        }
+
+        switch (shared_key_table_insert(table, key)) {
+        case SHARED_SLOT_FOUND:
+            return FALSE_STATUS;
+        case SHARED_SLOT_MOVED:
+            table = shared_key_set_help_move(set, table);
+            break;
+        case SHARED_SLOT_FULL:
+            // only when growth failed earlier, or threads overshot the limit
+            table = shared_key_set_grow(set, table);
+            if (!table) return MEMORY_ALLOCATION_ERR;
+            break;
+        case SHARED_SLOT_NEW: {
+            size_t count = __atomic_add_fetch(&set->count, 1, __ATOMIC_RELAXED);
+            // the key is moved along with the rest; a failed allocation
+            // only leaves the table fuller until the next insert tries again
+            if (count * SHARED_KEY_SET_MAX_LOAD_DEN > table->capacity * SHARED_KEY_SET_MAX_LOAD_NUM) {
+                shared_key_set_grow(set, table);
+            }
+            return TRUE_STATUS;
+        }
+        }
+    }
+}
+
+// Check for a packed key; safe to call while other threads insert
+// return TRUE_STATUS if the key is in the set, FALSE_STATUS if not,
+// or a negative status on failure
+FunctionStatus shared_key_set_contains(shared_key_set *set, dt_key key) {
+    if (!set) return NULL_INPUT_POINTER;
+    if (DT_KEY_ZONE(key) != DT_KEY_LOCAL && DT_KEY_ZONE(key) != DT_KEY_UTC) return FALSE_STATUS;
+
+    shared_key_table *table = __atomic_load_n(&set->table, __ATOMIC_ACQUIRE);
+    while (table) {
+        // a table moved in full holds nothing but markers
+        if (__atomic_load_n(&table->migrate_done, __ATOMIC_ACQUIRE) < table->capacity &&
+            shared_key_table_find(table, key) == SHARED_SLOT_FOUND) {
+            return TRUE_STATUS;
+        }
+        // read after the probe: a key moved under it is in the next table
+        table = __atomic_load_n(&table->next, __ATOMIC_ACQUIRE);
+    }
+    return FALSE_STATUS;
+}
+
+size_t shared_key_set_get_size(shared_key_set *set) {
+    if (!set) return 0;
+
+    return __atomic_load_n(&set->count, __ATOMIC_RELAXED);
+}
+
+// Copy up to max_keys keys, in no particular order, into keys; call it
+// once the inserting threads are done
+// return the number of keys copied
+size_t shared_key_set_get_keys(shared_key_set *set, dt_key *keys, size_t max_keys) {
+    if (!set || !keys) return 0;
+
+    shared_key_table *table = __atomic_load_n(&set->table, __ATOMIC_ACQUIRE);
+    size_t copied = 0;
+    for (size_t i = 0; i < table->capacity && copied < max_keys; i++) {
+        dt_key slot = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE);
+        if (slot && slot != SHARED_KEY_SET_MOVED) keys[copied++] = slot;
+    }
+    return copied;
+}
+
+size_t shared_key_set_memory_usage(shared_key_set *set) {
+    if (!set) return 0;
+
+    size_t bytes = sizeof(shared_key_set);
+    for (shared_key_table *table = set->first; table;
+         table = __atomic_load_n(&table->next, __ATOMIC_ACQUIRE)) {
+        bytes += sizeof(shared_key_table) + table->capacity * sizeof(dt_key);
+    }
+    return bytes;
+}
+
+// A thread of test_shared_key_set: inserts every key of the test, from
+// its own starting point, so that threads race on the same keys while
+// the set grows under them
+typedef struct shared_key_set_test_struct {
+    shared_key_set *set;
+    const dt_key *keys;
+    size_t count;
+    size_t start;
+    size_t inserted;        // inserts told the key was new
+    size_t missing;         // keys not found right after their insert
+} shared_key_set_test;
+
+static void* shared_key_set_test_main(void *arg) {
+    shared_key_set_test *test = arg;
+    for (size_t n = 0; n < test->count; n++) {
+        dt_key key = test->keys[(test->start + n) % test->count];
+        FunctionStatus rstat = shared_key_set_insert(test->set, key);
+        if (rstat == TRUE_STATUS) test->inserted++;
+        if (rstat < 0 || shared_key_set_contains(test->set, key) != TRUE_STATUS) test->missing++;
+    }
+    return NULL;
+}
+
+static int shared_key_set_test_compare(const void *a, const void *b) {
+    dt_key x = *(const dt_key *)a, y = *(const dt_key *)b;
+    return x < y ? -1 : x > y;
+}
+
+int test_shared_key_set()
+{
+    enum { threads = 8, count = 200000 };
+    dt_key *keys = malloc(count * sizeof(dt_key));
+    dt_key *found = malloc((count + 1) * sizeof(dt_key));
+    shared_key_set *set = shared_key_set_create();
+    if (!keys || !found || !set) {
+        printf("Test setup failed: out of memory\n");
+        free(keys);
+        free(found);
+        shared_key_set_destroy(set);
+        return 1;
+    }
+    for (size_t i = 0; i < count; i++) keys[i] = DT_KEY_MAKE(i * 7919 + 1, i % 1000, DT_KEY_UTC);
+
+    pthread_t thread[threads];
+    shared_key_set_test test[threads];
+    int started = 0;
+    for (; started < threads; started++) {
+        test[started] = (shared_key_set_test){ set, keys, count, (size_t)started * count / threads, 0, 0 };
+        if (pthread_create(&thread[started], NULL, shared_key_set_test_main, &test[started]) != 0) break;
+    }
+    size_t inserted = 0, missing = 0;
+    for (int t = 0; t < started; t++) {
+        pthread_join(thread[t], NULL);
+        inserted += test[t].inserted;
+        missing += test[t].missing;
+    }
+
+    size_t absent = 0;
+    for (size_t i = 0; i < count; i++) absent += shared_key_set_contains(set, keys[i]) != TRUE_STATUS;
+    size_t copied = shared_key_set_get_keys(set, found, count + 1);
+    qsort(found, copied, sizeof(dt_key), shared_key_set_test_compare);
+    int same = copied == count;
+    for (size_t i = 0; same && i < count; i++) same = found[i] == keys[i];
+
+    struct test_data_struct
+    {
+        const char* name;
+        int ok;
+    };
+    struct test_data_struct  test_cases[] = {
+        {"threads started",                 started == threads},
+        {"one new insert per key",          inserted == count},
+        {"contains right after insert",     missing == 0},
+        {"contains every key at the end",   absent == 0},
+        {"size is the number of keys",      shared_key_set_get_size(set) == count},
+        {"get_keys returns every key",      same},
+    };
+
+    int num_tests = sizeof(test_cases) / sizeof(test_cases[0]);
+    int passed = 0;
+    for (int i = 0; i < num_tests; i++) {
+        if (test_cases[i].ok) {
+            printf("Test %d passed: %s\n", i + 1, test_cases[i].name);
+            passed++;
+        } else {
+            printf("Test %d failed: %s\n", i + 1, test_cases[i].name);
+        }
+    }
+    printf("%d/%d shared key set tests passed (%d threads, %d keys).\n", passed, num_tests, threads, count);
+
+    free(keys);
+    free(found);
+    shared_key_set_destroy(set);
+    return num_tests - passed;
+}
@@ -0,0 +1,64 @@
+#ifndef __shared_key_set_h__
+#define __shared_key_set_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+#include "datetime_util.h"
+
+#define SHARED_KEY_SET_INITIAL_CAPACITY 1024        // must be a power of two
+#define SHARED_KEY_SET_MAX_LOAD_NUM     3           // grow once count > capacity * 3/4
+#define SHARED_KEY_SET_MAX_LOAD_DEN     4
+#define SHARED_KEY_SET_MIGRATE_CHUNK    4096        // slots a helper moves per claim
+#define SHARED_KEY_SET_MOVED            ((dt_key)3) // zone 3 is never a key's
+
+// One generation of slots. Slots go 0 -> key -> SHARED_KEY_SET_MOVED and
+// never back, which is what makes the compare-and-swap protocol safe.
+typedef struct shared_key_table_struct {
+    size_t capacity;                        // number of slots, a power of two
+    struct shared_key_table_struct *next;   // the larger table replacing this one
+    size_t migrate_claimed;                 // slots handed out to helpers
+    size_t migrate_done;                    // slots moved to next
+    dt_key slots[];
+} shared_key_table;
+
+/* Open-addressing set of packed datetime keys that many threads may
+    insert into and query at once.
+    The keys themselves are the 64-bit slots (0 marks an empty slot), and
+    a key is claimed by a single compare-and-swap of its slot from 0, so
+    insert and contains take no lock. Two threads inserting the same key
+    end on the same slot; exactly one of them is told it was new.
+    Growth is cooperative: the thread that crosses the load limit
+    publishes a table twice the size, and every thread that then touches
+    the set claims chunks of old slots, copies their keys across and marks
+    the old slots moved, before it inserts into the new table; the only
+    waiting is for chunks another thread claimed and has not finished.
+    A lookup never waits: it steps over moved slots and, when the key is
+    not in a table that is being replaced, goes on to its successor.
+    Replaced tables stay allocated until the set is destroyed, since a
+    slow reader may still be walking them; they add up to less than the
+    current table.
+    Unlike key_set, no insertion order is kept.
+*/
+typedef struct shared_key_set_struct {
+    shared_key_table *table;    // the current table
+    shared_key_table *first;    // the first table, the others follow through next
+    size_t count;               // number of keys stored
+} shared_key_set;
+
+// Function declarations
+shared_key_set* shared_key_set_create(void);
+void shared_key_set_destroy(shared_key_set *sset);
+FunctionStatus shared_key_set_insert(shared_key_set *sset, dt_key key);
+FunctionStatus shared_key_set_contains(shared_key_set *sset, dt_key key);
+size_t shared_key_set_get_size(shared_key_set *sset);
+size_t shared_key_set_get_keys(shared_key_set *sset, dt_key *keys, size_t max_keys);
+size_t shared_key_set_memory_usage(shared_key_set *sset);
+
+// Self test, run by datetime_bench -t; returns its number of failures
+int test_shared_key_set();
+
+#endif // __shared_key_set_h__
@@ -0,0 +1,293 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include "spill_dedup.h"
+#include "key_set.h"
+#include "key_sort.h"
+#include "datetime_util.h"
+
+// One sorted input of the merge: a run file read in slices, or the keys
+// still held in memory
+typedef struct spill_source_struct {
+    FILE *run;          // NULL for the in-memory source
+    dt_key *keys;       // read buffer, or the sorted in-memory keys
+    size_t count;       // keys in keys
+    size_t pos;         // next key in keys
+} spill_source;
+
+// Receives the merged keys, each exactly once and in ascending order
+typedef FunctionStatus (*spill_sink)(void *ctx, dt_key key);
+
+// Create an empty run file in dir; it is unlinked right away and only
+// lives as long as the returned stream
+// return the stream, or NULL on failure
+static FILE* spill_run_create(const char *dir) {
+    static const char name[] = "/datetime_unique.XXXXXX";
+    size_t dir_len = strlen(dir);
+    char *path = malloc(dir_len + sizeof(name));
+    if (!path) return NULL;
+    memcpy(path, dir, dir_len);
+    memcpy(path + dir_len, name, sizeof(name));
+
+    FILE *run = NULL;
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+        run = fdopen(fd, "w+b");
+        if (!run) close(fd);
+    }
+    free(path);
+    return run;
+}
+
+// Sink writing keys to a run file
+static FunctionStatus spill_sink_run(void *ctx, dt_key key) {
+    return fwrite(&key, sizeof(dt_key), 1, (FILE *)ctx) == 1 ? RET_SUCCESS : FILE_IO_ERR;
+}
+
+// Text output; keys are collected and formatted SPILL_TEXT_KEYS at a time
+typedef struct spill_text_struct {
+    FILE *out;
+    size_t count;
+    dt_key keys[SPILL_TEXT_KEYS];
+} spill_text;
+
+// Write out the collected keys
+// return RET_SUCCESS, or FILE_IO_ERR if the output cannot be written
+static FunctionStatus spill_text_flush(spill_text *text) {
+    char buffer[SPILL_TEXT_KEYS * DT_ISO8601_LINE_MAX];
+    size_t written;
+    dt_key_format_batch(text->keys, text->count, buffer, sizeof(buffer), &written);
+    text->count = 0;
+    return fwrite(buffer, 1, written, text->out) == written ? RET_SUCCESS : FILE_IO_ERR;
+}
+
+// Sink writing keys as ISO 8601 lines
+static FunctionStatus spill_sink_text(void *ctx, dt_key key) {
+    spill_text *text = ctx;
+    text->keys[text->count++] = key;
+    return text->count == SPILL_TEXT_KEYS ? spill_text_flush(text) : RET_SUCCESS;
+}
+
+// Get the next key of a source
+// return: TRUE_STATUS: *key is the next key
+//         FALSE_STATUS: source exhausted
+//         FILE_IO_ERR: the run could not be read
+static FunctionStatus spill_source_next(spill_source *src, dt_key *key) {
+    if (src->pos == src->count) {
+        if (!src->run) return FALSE_STATUS;
+        src->count = fread(src->keys, sizeof(dt_key), SPILL_READ_KEYS, src->run);
+        src->pos = 0;
+        if (src->count == 0) return ferror(src->run) ? FILE_IO_ERR : FALSE_STATUS;
+    }
+    *key = src->keys[src->pos++];
+    return TRUE_STATUS;
+}
+
+// Restore the heap property below position i; heap holds source indices
+// ordered by their current key in head
+static void spill_heap_down(size_t *heap, size_t n, const dt_key *head, size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < n && head[heap[left]] < head[heap[smallest]]) smallest = left;
+        if (right < n && head[heap[right]] < head[heap[smallest]]) smallest = right;
+        if (smallest == i) return;
+
+        size_t tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// k-way merge of sorted sources, handing each distinct key to sink once
+// return RET_SUCCESS, or a negative status on failure
+static FunctionStatus spill_merge(spill_source *sources, size_t n, spill_sink sink, void *ctx) {
+    size_t *heap = malloc(n * sizeof(size_t));
+    dt_key *head = malloc(n * sizeof(dt_key));
+    if (!heap || !head) {
+        free(heap);
+        free(head);
+        return MEMORY_ALLOCATION_ERR;
+    }
+
+    FunctionStatus rstat = RET_SUCCESS;
+    size_t heap_size = 0;
+    for (size_t i = 0; i < n && rstat == RET_SUCCESS; i++) {
+        FunctionStatus sstat = spill_source_next(&sources[i], &head[i]);
+        if (sstat == TRUE_STATUS) heap[heap_size++] = i;
+        else if (sstat < 0) rstat = sstat;
+    }
+    for (size_t i = heap_size / 2; i-- > 0;) {
+        spill_heap_down(heap, heap_size, head, i);
+    }
+
+    // keys are never 0, so 0 can stand for "nothing written yet"
+    dt_key last = 0;
+    while (heap_size > 0 && rstat == RET_SUCCESS) {
+        size_t top = heap[0];
+        if (head[top] != last) {
+            last = head[top];
+            rstat = sink(ctx, last);
+        }
+
+        FunctionStatus sstat = spill_source_next(&sources[top], &head[top]);
+        if (sstat < 0) rstat = sstat;
+        if (sstat != TRUE_STATUS) heap[0] = heap[--heap_size];
+        spill_heap_down(heap, heap_size, head, 0);
+    }
+
+    free(heap);
+    free(head);
+    return rstat;
+}
+
+// Set up one source per run, plus one over keys[0..count) if keys is given
+// return the number of sources, or 0 on allocation failure
+static size_t spill_sources_open(spill_source *sources, FILE **runs, size_t num_runs,
+                                 dt_key *keys, size_t count) {
+    for (size_t i = 0; i < num_runs; i++) {
+        rewind(runs[i]);
+        sources[i].run = runs[i];
+        sources[i].keys = malloc(SPILL_READ_KEYS * sizeof(dt_key));
+        sources[i].count = 0;
+        sources[i].pos = 0;
+        if (!sources[i].keys) {
+            while (i-- > 0) free(sources[i].keys);
+            return 0;
+        }
+    }
+    if (!keys) return num_runs;
+
+    sources[num_runs].run = NULL;
+    sources[num_runs].keys = keys;
+    sources[num_runs].count = count;
+    sources[num_runs].pos = 0;
+    return num_runs + 1;
+}
+
+static void spill_sources_close(spill_source *sources, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (sources[i].run) free(sources[i].keys);
+    }
+}
+
+// Merge every run into a single new one
+// return RET_SUCCESS, or a negative status on failure
+static FunctionStatus spill_compact(FILE **runs, size_t *num_runs, const char *tmp_dir) {
+    spill_source *sources = malloc(*num_runs * sizeof(spill_source));
+    if (!sources) return MEMORY_ALLOCATION_ERR;
+    size_t n = spill_sources_open(sources, runs, *num_runs, NULL, 0);
+    FILE *merged = n ? spill_run_create(tmp_dir) : NULL;
+    if (!merged) {
+        spill_sources_close(sources, n);
+        free(sources);
+        return n ? FILE_IO_ERR : MEMORY_ALLOCATION_ERR;
+    }
+
+    FunctionStatus rstat = spill_merge(sources, n, spill_sink_run, merged);
+    if (rstat == RET_SUCCESS && fflush(merged) != 0) rstat = FILE_IO_ERR;
+    spill_sources_close(sources, n);
+    free(sources);
+    if (rstat != RET_SUCCESS) {
+        fclose(merged);
+        return rstat;
+    }
+
+    for (size_t i = 0; i < *num_runs; i++) {
+        fclose(runs[i]);
+    }
+    runs[0] = merged;
+    *num_runs = 1;
+    return RET_SUCCESS;
+}
+
+// Sort the keys of a full set and write them out as a new run.
+// The keys are sorted in place, the set is only fit to be destroyed after.
+// return RET_SUCCESS, or a negative status on failure
+static FunctionStatus spill_set(key_set *set, FILE **runs, size_t *num_runs, const char *tmp_dir) {
+    FILE *run = spill_run_create(tmp_dir);
+    if (!run) return FILE_IO_ERR;
+
+    FunctionStatus rstat = key_sort(set->keys, NULL, set->count, 1);
+    if (rstat != RET_SUCCESS) {
+        fclose(run);
+        return rstat;
+    }
+    if (fwrite(set->keys, sizeof(dt_key), set->count, run) != set->count || fflush(run) != 0) {
+        fclose(run);
+        return FILE_IO_ERR;
+    }
+    runs[(*num_runs)++] = run;
+
+    if (*num_runs > SPILL_MAX_RUNS) return spill_compact(runs, num_runs, tmp_dir);
+    return RET_SUCCESS;
+}
+
+// Dedup reader within memory_limit bytes, writing sorted values to out
+// return RET_SUCCESS, or a negative status on failure
+FunctionStatus spill_dedup_run(line_reader *reader, FILE *out, size_t memory_limit,
+                               const char *tmp_dir, error_sink *errors) {
+    if (!reader || !out || !tmp_dir) return NULL_INPUT_POINTER;
+
+    FILE *runs[SPILL_MAX_RUNS + 1];
+    size_t num_runs = 0;
+    key_set *set = key_set_create();
+    if (!set) return MEMORY_ALLOCATION_ERR;
+
+    const char *line;
+    size_t line_len;
+    dt_key dt_norm_key;
+    FunctionStatus rstat = RET_SUCCESS;
+    FunctionStatus lstat;
+    while ((lstat = line_reader_next(reader, &line, &line_len)) == TRUE_STATUS) {
+        size_t dt_len;
+        const char *dt_str = dt_line_token(line, line_len, &dt_len);
+        if (dt_len == 0) continue; // blank line
+
+        FunctionStatus pstat = normalize_iso8601_key_n(dt_str, dt_len, &dt_norm_key);
+        if (pstat != RET_SUCCESS) {
+            error_sink_add(errors, dt_str, dt_len, pstat);
+            continue;
+        }
+
+        rstat = key_set_insert(set, dt_norm_key);
+        if (rstat == TRUE_STATUS && key_set_memory_usage(set) >= memory_limit) {
+            rstat = spill_set(set, runs, &num_runs, tmp_dir);
+            key_set_destroy(set);
+            set = rstat == RET_SUCCESS ? key_set_create() : NULL;
+            if (rstat == RET_SUCCESS && !set) rstat = MEMORY_ALLOCATION_ERR;
+        }
+        if (rstat < 0) break;
+        rstat = RET_SUCCESS;
+    }
+    if (rstat == RET_SUCCESS && lstat < 0) rstat = lstat;
+
+    // final merge of the runs and whatever is still in memory
+    if (rstat == RET_SUCCESS) rstat = key_sort(set->keys, NULL, set->count, 1);
+    if (rstat == RET_SUCCESS) {
+        spill_source sources[SPILL_MAX_RUNS + 1];
+        size_t n = spill_sources_open(sources, runs, num_runs, set->keys, set->count);
+        spill_text *text = malloc(sizeof(spill_text));
+        rstat = n && text ? RET_SUCCESS : MEMORY_ALLOCATION_ERR;
+        if (rstat == RET_SUCCESS) {
+            text->out = out;
+            text->count = 0;
+            rstat = spill_merge(sources, n, spill_sink_text, text);
+            if (rstat == RET_SUCCESS) rstat = spill_text_flush(text);
+            if (rstat == RET_SUCCESS && (fflush(out) != 0 || ferror(out))) rstat = FILE_IO_ERR;
+        }
+        free(text);
+        spill_sources_close(sources, n);
+    }
+
+    for (size_t i = 0; i < num_runs; i++) {
+        fclose(runs[i]);
+    }
+    key_set_destroy(set);
+    return rstat;
+}
@@ -0,0 +1,35 @@
+#ifndef __spill_dedup_h__
+#define __spill_dedup_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "func_status.h"
+#include "line_reader.h"
+#include "error_sink.h"
+
+#define SPILL_DEFAULT_MEMORY    (1ULL << 30)    // budget when none is given
+#define SPILL_MIN_MEMORY        (1 << 23)       // smallest accepted budget
+#define SPILL_MAX_RUNS          64              // runs merged into one beyond this
+#define SPILL_READ_KEYS         8192            // keys buffered per run while merging
+#define SPILL_TEXT_KEYS         2048            // keys formatted per output write
+
+/* External-memory dedup of everything left in reader, for inputs with
+    more distinct values than fit in memory.
+    Values are collected as packed keys in a key set. Whenever the set
+    reaches memory_limit bytes its keys are radix sorted and written to a
+    run file in tmp_dir as raw 8-byte keys, and the set starts over; the
+    sort briefly needs a scratch copy of the keys on top of the budget. Run files
+    are unlinked as soon as they are created, so they vanish when the
+    program exits however it exits. Once more than SPILL_MAX_RUNS runs
+    exist they are merged into one.
+    At the end the runs and the keys still in memory are merged k ways,
+    each key is written once, and the output is therefore in ascending
+    packed-key order rather than in first-seen order.
+    Invalid lines go to errors as in the batch loop.
+*/
+FunctionStatus spill_dedup_run(line_reader *reader, FILE *out, size_t memory_limit,
+                               const char *tmp_dir, error_sink *errors);
+
+#endif // __spill_dedup_h__
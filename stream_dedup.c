@@ -0,0 +1,178 @@
+#include "stream_dedup.h"
+#include "hash_set.h"
+#include "key_set.h"
+#include "window_set.h"
+#include "datetime_util.h"
+
+// Current and previous generation of remembered values; only one of
+// the two kinds of set is used, depending on the mode. With a window,
+// the window set remembers the values instead.
+typedef struct stream_state_struct {
+    int packed;
+    size_t generation_limit;    // bytes per generation, 0 for unbounded
+    hash_set *hset[2];          // [0] current, [1] previous
+    key_set *kset[2];
+    window_set *window;
+} stream_state;
+
+static void stream_state_destroy(stream_state *state) {
+    for (int i = 0; i < 2; i++) {
+        hash_set_destroy(state->hset[i]);
+        key_set_destroy(state->kset[i]);
+        state->hset[i] = NULL;
+        state->kset[i] = NULL;
+    }
+    window_set_destroy(state->window);
+    state->window = NULL;
+}
+
+// Drop the previous generation once the current one is full
+// return RET_SUCCESS, or MEMORY_ALLOCATION_ERR
+static FunctionStatus stream_state_rotate(stream_state *state) {
+    if (state->generation_limit == 0) return RET_SUCCESS;
+
+    if (state->packed) {
+        if (key_set_memory_usage(state->kset[0]) < state->generation_limit) return RET_SUCCESS;
+        key_set_destroy(state->kset[1]);
+        state->kset[1] = state->kset[0];
+        state->kset[0] = key_set_create();
+        return state->kset[0] ? RET_SUCCESS : MEMORY_ALLOCATION_ERR;
+    }
+
+    if (hash_set_memory_usage(state->hset[0]) < state->generation_limit) return RET_SUCCESS;
+    hash_set_destroy(state->hset[1]);
+    state->hset[1] = state->hset[0];
+    state->hset[0] = hash_set_create();
+    return state->hset[0] ? RET_SUCCESS : MEMORY_ALLOCATION_ERR;
+}
+
+// Remember a normalized string value
+// return: TRUE_STATUS: first time seen, write it out
+//         FALSE_STATUS: seen before
+//         negative: error
+static FunctionStatus stream_insert_string(stream_state *state, const char *value) {
+    size_t len = strlen(value);
+    if (state->window) {
+        // the packed key of the value gives its place in time
+        dt_key key;
+        FunctionStatus kstat = normalize_iso8601_key_n(value, len, &key);
+        if (kstat != RET_SUCCESS) return kstat;
+        return window_set_insert_string(state->window, value, len, key);
+    }
+
+    // every set of the process hashes alike, one hash serves both generations
+    uint64_t hash = hash_set_hash(value, len);
+    FunctionStatus rstat = hash_set_insert_hashed(state->hset[0], value, len, hash);
+    if (rstat != TRUE_STATUS) return rstat;
+
+    // new in this generation, but the previous one may know it
+    if (state->hset[1] &&
+        hash_set_contains_hashed(state->hset[1], value, len, hash) == TRUE_STATUS) {
+        rstat = FALSE_STATUS;
+    }
+    FunctionStatus gstat = stream_state_rotate(state);
+    return gstat != RET_SUCCESS ? gstat : rstat;
+}
+
+static FunctionStatus stream_insert_key(stream_state *state, dt_key key) {
+    if (state->window) return window_set_insert_key(state->window, key);
+
+    FunctionStatus rstat = key_set_insert(state->kset[0], key);
+    if (rstat != TRUE_STATUS) return rstat;
+
+    if (state->kset[1] && key_set_contains(state->kset[1], key) == TRUE_STATUS) {
+        rstat = FALSE_STATUS;
+    }
+    FunctionStatus gstat = stream_state_rotate(state);
+    return gstat != RET_SUCCESS ? gstat : rstat;
+}
+
+// Dedup reader line by line into state, writing each new value to out
+// return RET_SUCCESS, or a negative status on failure
+static FunctionStatus stream_dedup_loop(stream_state *state, line_reader *reader, FILE *out,
+                                        error_sink *errors) {
+    int packed = state->packed;
+    line_reader_set_flush(reader, out);
+
+    const char *line;
+    size_t line_len;
+    char dt_str_norm[DT_ISO8601_SIZE];
+    dt_key dt_norm_key;
+    FunctionStatus rstat = RET_SUCCESS;
+    FunctionStatus lstat;
+    while ((lstat = line_reader_next(reader, &line, &line_len)) == TRUE_STATUS) {
+        size_t dt_len;
+        const char *dt_str = dt_line_token(line, line_len, &dt_len);
+        if (dt_len == 0) continue; // blank line
+
+        FunctionStatus pstat;
+        if (packed) {
+            pstat = normalize_iso8601_key_n(dt_str, dt_len, &dt_norm_key);
+            if (pstat == RET_SUCCESS) {
+                rstat = stream_insert_key(state, dt_norm_key);
+                if (rstat == TRUE_STATUS) {
+                    int n = dt_key_to_iso8601(dt_norm_key, dt_str_norm);
+                    dt_str_norm[n] = '\n';
+                    fwrite(dt_str_norm, 1, (size_t)n + 1, out);
+                }
+            }
+        } else {
+            pstat = normalize_iso8601_n(dt_str, dt_len, dt_str_norm);
+            if (pstat == RET_SUCCESS) {
+                rstat = stream_insert_string(state, dt_str_norm);
+                if (rstat == TRUE_STATUS) {
+                    fputs(dt_str_norm, out);
+                    fputc('\n', out);
+                }
+            }
+        }
+        if (pstat != RET_SUCCESS) {
+            error_sink_add(errors, dt_str, dt_len, pstat);
+        }
+        if (rstat < 0) break;
+    }
+    // write errors stick to out, one check covers every value written
+    int write_failed = fflush(out) != 0 || ferror(out);
+    line_reader_set_flush(reader, NULL);
+
+    if (rstat < 0) return rstat;
+    if (lstat < 0) return lstat;
+    return write_failed ? FILE_IO_ERR : RET_SUCCESS;
+}
+
+// Dedup reader line by line, writing each new value to out
+// return RET_SUCCESS, or a negative status on failure
+FunctionStatus stream_dedup_run(line_reader *reader, FILE *out, int packed, size_t memory_limit,
+                                error_sink *errors) {
+    if (!reader || !out) return NULL_INPUT_POINTER;
+
+    stream_state state = { packed, memory_limit / 2, { NULL, NULL }, { NULL, NULL }, NULL };
+    if (packed) {
+        state.kset[0] = key_set_create();
+    } else {
+        state.hset[0] = hash_set_create();
+    }
+    if (!state.hset[0] && !state.kset[0]) return MEMORY_ALLOCATION_ERR;
+
+    FunctionStatus rstat = stream_dedup_loop(&state, reader, out, errors);
+    stream_state_destroy(&state);
+    return rstat;
+}
+
+// Dedup reader line by line within a window of event time, writing each
+// value not seen in the window to out; *late, when not NULL, receives
+// the number of values that were already out of the window
+// return RET_SUCCESS, or a negative status on failure
+FunctionStatus stream_dedup_run_window(line_reader *reader, FILE *out, int packed,
+                                       uint64_t window_seconds, size_t *late, error_sink *errors) {
+    if (!reader || !out) return NULL_INPUT_POINTER;
+
+    stream_state state = { packed, 0, { NULL, NULL }, { NULL, NULL }, NULL };
+    state.window = window_set_create(packed, window_seconds);
+    if (!state.window) return MEMORY_ALLOCATION_ERR;
+
+    FunctionStatus rstat = stream_dedup_loop(&state, reader, out, errors);
+    if (late) *late = state.window->late;
+    stream_state_destroy(&state);
+    return rstat;
+}
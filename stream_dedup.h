@@ -0,0 +1,45 @@
+#ifndef __stream_dedup_h__
+#define __stream_dedup_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+#include "line_reader.h"
+#include "error_sink.h"
+
+#define STREAM_MIN_MEMORY   (1 << 23)   // smallest memory limit, a few times an empty set
+
+/* Online dedup of everything left in reader.
+    Each valid value is normalized and written to out, one per line, the
+    moment it is first seen; out is flushed whenever the reader is about
+    to wait for more input, so a downstream stage sees every value as soon
+    as it has been read. Invalid lines go to errors, which should print
+    on stderr to keep them out of the values.
+
+    With memory_limit 0 every distinct value is remembered and the output
+    is the same as the batch output. Otherwise the values are kept in two
+    generations of sets that together stay within about memory_limit
+    bytes: a value is looked up in both, and once the current generation
+    reaches half the limit the older one is dropped and a new one started.
+    Values seen again are carried over into the current generation, so
+    only a value whose repeats are further apart than a whole generation
+    can be written again.
+*/
+FunctionStatus stream_dedup_run(line_reader *reader, FILE *out, int packed, size_t memory_limit,
+                                error_sink *errors);
+
+/* Online dedup within a sliding window of event time, as stream_dedup_run
+    but with the values remembered in a window_set (window_set.h): a value
+    is written unless the same value was seen while it was within the last
+    window_seconds of the newest timestamp so far. Memory follows the
+    number of distinct values in one window, not the length of the stream.
+    Values that arrive already older than the window are written and
+    counted in *late.
+*/
+FunctionStatus stream_dedup_run_window(line_reader *reader, FILE *out, int packed,
+                                       uint64_t window_seconds, size_t *late, error_sink *errors);
+
+#endif // __stream_dedup_h__
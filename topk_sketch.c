@@ -0,0 +1,218 @@
+#include "topk_sketch.h"
+#include "hash_set.h"
+
+// return a sketch of capacity empty counters, or NULL if the capacity is
+// 0 or too large or there is no memory
+topk_sketch* topk_sketch_create(size_t capacity) {
+    if (capacity == 0 || capacity > UINT32_MAX / 4) return NULL;
+
+    topk_sketch *sketch = malloc(sizeof(topk_sketch));
+    if (!sketch) return NULL;
+
+    sketch->capacity = capacity;
+    sketch->used = 0;
+    sketch->total = 0;
+    sketch->slot_count = 1;
+    while (sketch->slot_count < capacity * 2) sketch->slot_count *= 2;
+    sketch->counters = malloc(capacity * sizeof(topk_counter));
+    sketch->heap = malloc(capacity * sizeof(uint32_t));
+    sketch->slots = calloc(sketch->slot_count, sizeof(uint32_t));
+
+    // fail check
+    if (!sketch->counters || !sketch->heap || !sketch->slots) {
+        topk_sketch_destroy(sketch);
+        return NULL;
+    }
+
+    return sketch;
+}
+
+void topk_sketch_destroy(topk_sketch *sketch) {
+    if (!sketch) return;
+
+    free(sketch->counters);
+    free(sketch->heap);
+    free(sketch->slots);
+    free(sketch);
+}
+
+// Counters to keep for a report of the k most frequent values: enough
+// that the k-th count is well clear of the possible overcount
+size_t topk_sketch_capacity_for(size_t k) {
+    if (k > UINT32_MAX / 4 / TOPK_SKETCH_COUNTERS_PER_K) return UINT32_MAX / 4;
+    size_t capacity = k * TOPK_SKETCH_COUNTERS_PER_K;
+    return capacity < TOPK_SKETCH_MIN_COUNTERS ? TOPK_SKETCH_MIN_COUNTERS : capacity;
+}
+
+// Put counter i at heap position pos
+static inline void topk_heap_set(topk_sketch *sketch, size_t pos, uint32_t i) {
+    sketch->heap[pos] = i;
+    sketch->counters[i].heap_index = (uint32_t)pos;
+}
+
+static void topk_heap_sift_up(topk_sketch *sketch, size_t pos) {
+    uint32_t i = sketch->heap[pos];
+    uint64_t count = sketch->counters[i].count;
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (sketch->counters[sketch->heap[parent]].count <= count) break;
+        topk_heap_set(sketch, pos, sketch->heap[parent]);
+        pos = parent;
+    }
+    topk_heap_set(sketch, pos, i);
+}
+
+// Restore the heap below pos after the count of its counter went up
+static void topk_heap_sift_down(topk_sketch *sketch, size_t pos) {
+    uint32_t i = sketch->heap[pos];
+    uint64_t count = sketch->counters[i].count;
+    for (;;) {
+        size_t child = 2 * pos + 1;
+        if (child >= sketch->used) break;
+        if (child + 1 < sketch->used &&
+            sketch->counters[sketch->heap[child + 1]].count < sketch->counters[sketch->heap[child]].count) {
+            child++;
+        }
+        if (sketch->counters[sketch->heap[child]].count >= count) break;
+        topk_heap_set(sketch, pos, sketch->heap[child]);
+        pos = child;
+    }
+    topk_heap_set(sketch, pos, i);
+}
+
+// Take counter i out of the lookup table, shifting the rest of its probe
+// run back so no tombstone is left behind
+static void topk_slots_remove(topk_sketch *sketch, uint32_t i) {
+    size_t mask = sketch->slot_count - 1;
+    size_t hole = sketch->counters[i].hash & mask;
+    while (sketch->slots[hole] != i + 1) hole = (hole + 1) & mask;
+
+    for (size_t j = (hole + 1) & mask; sketch->slots[j]; j = (j + 1) & mask) {
+        size_t home = sketch->counters[sketch->slots[j] - 1].hash & mask;
+        // the entry at j may move back to the hole unless its home lies
+        // between the hole and j
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            sketch->slots[hole] = sketch->slots[j];
+            hole = j;
+        }
+    }
+    sketch->slots[hole] = 0;
+}
+
+// Count one occurrence of a value, such as a normalized datetime string
+// return RET_SUCCESS, or a negative status on failure
+FunctionStatus topk_sketch_add(topk_sketch *sketch, const char *value, size_t len) {
+    if (!sketch || !value) return NULL_INPUT_POINTER;
+    // a counter has no room for a longer value
+    if (len >= TOPK_SKETCH_VALUE_SIZE) return MEMORY_ALLOCATION_ERR;
+
+    uint64_t hash = hash_set_hash(value, len);
+    size_t mask = sketch->slot_count - 1;
+    size_t slot = hash & mask;
+    sketch->total++;
+
+    while (sketch->slots[slot]) {
+        topk_counter *counter = &sketch->counters[sketch->slots[slot] - 1];
+        if (counter->hash == hash && counter->len == len && memcmp(counter->value, value, len) == 0) {
+            counter->count++;
+            topk_heap_sift_down(sketch, counter->heap_index);
+            return RET_SUCCESS;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    uint32_t i;
+    uint64_t base = 0;
+    if (sketch->used < sketch->capacity) {
+        i = (uint32_t)sketch->used++;
+        topk_heap_set(sketch, sketch->used - 1, i);
+    } else {
+        // replace the value with the smallest count, at the heap root
+        i = sketch->heap[0];
+        base = sketch->counters[i].count;
+        topk_slots_remove(sketch, i);
+        // the removal may have shifted an entry into the free slot found above
+        slot = hash & mask;
+        while (sketch->slots[slot]) slot = (slot + 1) & mask;
+    }
+
+    topk_counter *counter = &sketch->counters[i];
+    counter->count = base + 1;
+    counter->error = base;
+    counter->hash = hash;
+    counter->len = (uint32_t)len;
+    memcpy(counter->value, value, len);
+    sketch->slots[slot] = i + 1;
+    if (base) {
+        topk_heap_sift_down(sketch, counter->heap_index);
+    } else {
+        topk_heap_sift_up(sketch, counter->heap_index);
+    }
+    return RET_SUCCESS;
+}
+
+// qsort order by upper bound: highest count first, then by value
+static int topk_counter_compare(const void *a, const void *b) {
+    const topk_counter *x = *(const topk_counter *const *)a;
+    const topk_counter *y = *(const topk_counter *const *)b;
+    if (x->count != y->count) return x->count < y->count ? 1 : -1;
+
+    int cmp = memcmp(x->value, y->value, x->len < y->len ? x->len : y->len);
+    if (cmp) return cmp;
+    return (x->len > y->len) - (x->len < y->len);
+}
+
+// qsort order of the report: highest guaranteed count, count - error,
+// first; then as topk_counter_compare
+static int topk_counter_compare_guaranteed(const void *a, const void *b) {
+    const topk_counter *x = *(const topk_counter *const *)a;
+    const topk_counter *y = *(const topk_counter *const *)b;
+    uint64_t x_min = x->count - x->error;
+    uint64_t y_min = y->count - y->error;
+    if (x_min != y_min) return x_min < y_min ? 1 : -1;
+    return topk_counter_compare(a, b);
+}
+
+/* Point top at the counters whose values are sure to be among the k most
+    frequent, highest guaranteed count first.
+    A value not among the k highest counts occurred at most as often as
+    the (k+1)-th highest count, and a value that was never monitored at
+    most as often as the smallest count, which is no higher. So a value
+    whose guaranteed count reaches that bound ranks in the top k for
+    certain; the others may be noise that rose by taking over counters
+    and are left out. When no more values were seen than counters kept,
+    every count is exact and the k highest are all reported.
+    return the number of counters stored, at most k, or 0 if there is
+    no memory
+*/
+size_t topk_sketch_top(const topk_sketch *sketch, const topk_counter **top, size_t k) {
+    if (!sketch || !top || !sketch->used) return 0;
+
+    const topk_counter **all = malloc(sketch->used * sizeof(topk_counter *));
+    if (!all) return 0;
+    for (size_t i = 0; i < sketch->used; i++) all[i] = &sketch->counters[i];
+
+    uint64_t bound = 0;
+    if (k < sketch->used) {
+        qsort(all, sketch->used, sizeof(topk_counter *), topk_counter_compare);
+        bound = all[k]->count;
+    }
+    qsort(all, sketch->used, sizeof(topk_counter *), topk_counter_compare_guaranteed);
+
+    size_t shown = 0;
+    while (shown < k && shown < sketch->used && all[shown]->count - all[shown]->error >= bound) {
+        top[shown] = all[shown];
+        shown++;
+    }
+    free(all);
+    return shown;
+}
+
+// Bytes held by the sketch, fixed at creation
+size_t topk_sketch_memory_usage(const topk_sketch *sketch) {
+    if (!sketch) return 0;
+
+    return sizeof(topk_sketch)
+         + sketch->capacity * (sizeof(topk_counter) + sizeof(uint32_t))
+         + sketch->slot_count * sizeof(uint32_t);
+}
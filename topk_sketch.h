@@ -0,0 +1,57 @@
+#ifndef __topk_sketch_h__
+#define __topk_sketch_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+
+#define TOPK_SKETCH_VALUE_SIZE      32      // longest value + 1, fits any normalized datetime
+#define TOPK_SKETCH_COUNTERS_PER_K  8       // counters kept per value reported
+#define TOPK_SKETCH_MIN_COUNTERS    1024
+
+// One monitored value. Its true number of occurrences is between
+// count - error and count.
+typedef struct topk_counter_struct {
+    uint64_t count;
+    uint64_t error;     // the count of the value it replaced
+    uint64_t hash;      // hash_set_hash of the value
+    uint32_t heap_index;
+    uint32_t len;
+    char value[TOPK_SKETCH_VALUE_SIZE];     // not NUL-terminated
+} topk_counter;
+
+/* Space-Saving summary of the most frequent values of a stream.
+    A fixed number of counters monitor one value each. A monitored value
+    that comes again has its counter incremented; a new value, once every
+    counter is taken, replaces the value with the smallest count, takes
+    over that count plus one and remembers the old count as its error.
+    So counts never undercount, overcount by at most the smallest count,
+    which is at most values added / counters, and every value seen more
+    often than that is monitored. Memory is fixed at creation however long
+    the stream runs.
+    Counters are found through a linear-probing table of counter indices
+    + 1, and a min-heap of counter indices keeps the smallest count at
+    hand, so adding a value costs one lookup and a short sift.
+*/
+typedef struct topk_sketch_struct {
+    topk_counter *counters;
+    size_t capacity;        // number of counters
+    size_t used;            // counters monitoring a value
+    uint32_t *heap;         // counter indices, smallest count first
+    uint32_t *slots;        // counter indices + 1, 0 for an empty slot
+    size_t slot_count;      // a power of two, at least twice capacity
+    uint64_t total;         // values added
+} topk_sketch;
+
+// Function declarations
+topk_sketch* topk_sketch_create(size_t capacity);
+void topk_sketch_destroy(topk_sketch *sketch);
+size_t topk_sketch_capacity_for(size_t k);
+FunctionStatus topk_sketch_add(topk_sketch *sketch, const char *value, size_t len);
+size_t topk_sketch_top(const topk_sketch *sketch, const topk_counter **top, size_t k);
+size_t topk_sketch_memory_usage(const topk_sketch *sketch);
+
+#endif // __topk_sketch_h__
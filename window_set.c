@@ -0,0 +1,136 @@
+#include "window_set.h"
+
+// Create an empty window over window_seconds of event time
+// return the set, or NULL if the window is 0 or too long, or on failure
+window_set* window_set_create(int packed, uint64_t window_seconds) {
+    if (window_seconds == 0 || window_seconds > WINDOW_SET_MAX_SECONDS) return NULL;
+
+    window_set *wset = malloc(sizeof(window_set));
+    if (!wset) return NULL;
+
+    wset->packed = packed;
+    wset->bucket_seconds = window_seconds / WINDOW_SET_MIN_BUCKETS;
+    if (wset->bucket_seconds > WINDOW_SET_BUCKET_SECONDS) wset->bucket_seconds = WINDOW_SET_BUCKET_SECONDS;
+    if (wset->bucket_seconds == 0) wset->bucket_seconds = 1;
+    // a long window gets fewer, longer buckets rather than more sets
+    if ((window_seconds + wset->bucket_seconds - 1) / wset->bucket_seconds > WINDOW_SET_MAX_BUCKETS) {
+        wset->bucket_seconds = (window_seconds + WINDOW_SET_MAX_BUCKETS - 1) / WINDOW_SET_MAX_BUCKETS;
+    }
+    // whole buckets covering the window, and the one being filled
+    wset->bucket_count = (size_t)((window_seconds + wset->bucket_seconds - 1) / wset->bucket_seconds) + 1;
+    wset->newest = 0;
+    wset->started = 0;
+    wset->late = 0;
+    wset->expired = 0;
+    wset->buckets = calloc(wset->bucket_count, sizeof(window_bucket));
+
+    // fail check
+    if (!wset->buckets) {
+        window_set_destroy(wset);
+        return NULL;
+    }
+
+    return wset;
+}
+
+static void window_bucket_clear(window_bucket *bucket) {
+    hash_set_destroy(bucket->hset);
+    key_set_destroy(bucket->kset);
+    bucket->hset = NULL;
+    bucket->kset = NULL;
+}
+
+void window_set_destroy(window_set *wset) {
+    if (!wset) return;
+
+    if (wset->buckets) {
+        for (size_t i = 0; i < wset->bucket_count; i++) window_bucket_clear(&wset->buckets[i]);
+    }
+    free(wset->buckets);
+    free(wset);
+}
+
+// Find the bucket for the values of epoch, moving the window forward to
+// it first if it is the newest yet
+// return the bucket, or NULL if epoch has already left the window
+static window_bucket* window_set_bucket(window_set *wset, uint64_t epoch) {
+    if (!wset->started) {
+        wset->newest = epoch;
+        wset->started = 1;
+    } else if (epoch > wset->newest) {
+        // drop the buckets the ring reuses; a jump past the whole window
+        // drops them all
+        uint64_t steps = epoch - wset->newest;
+        if (steps > wset->bucket_count) steps = wset->bucket_count;
+        for (uint64_t e = epoch - steps + 1; e <= epoch; e++) {
+            window_bucket *bucket = &wset->buckets[e % wset->bucket_count];
+            if (bucket->hset || bucket->kset) wset->expired++;
+            window_bucket_clear(bucket);
+        }
+        wset->newest = epoch;
+    } else if (wset->newest - epoch >= wset->bucket_count) {
+        return NULL;
+    }
+
+    window_bucket *bucket = &wset->buckets[epoch % wset->bucket_count];
+    return bucket;
+}
+
+// Insert a packed key
+// return: TRUE_STATUS: new within the window, or too late to tell
+//         FALSE_STATUS: already seen within the window
+//         negative: error
+FunctionStatus window_set_insert_key(window_set *wset, dt_key key) {
+    if (!wset) return NULL_INPUT_POINTER;
+
+    window_bucket *bucket = window_set_bucket(wset, DT_KEY_SECONDS(key) / wset->bucket_seconds);
+    if (!bucket) {
+        wset->late++;
+        return TRUE_STATUS;
+    }
+    if (!bucket->kset) {
+        bucket->kset = key_set_create();
+        if (!bucket->kset) return MEMORY_ALLOCATION_ERR;
+    }
+    return key_set_insert(bucket->kset, key);
+}
+
+// Insert a normalized string whose packed key, which places it in time,
+// is key
+// return: as window_set_insert_key
+FunctionStatus window_set_insert_string(window_set *wset, const char *value, size_t len, dt_key key) {
+    if (!wset || !value) return NULL_INPUT_POINTER;
+
+    window_bucket *bucket = window_set_bucket(wset, DT_KEY_SECONDS(key) / wset->bucket_seconds);
+    if (!bucket) {
+        wset->late++;
+        return TRUE_STATUS;
+    }
+    if (!bucket->hset) {
+        bucket->hset = hash_set_create();
+        if (!bucket->hset) return MEMORY_ALLOCATION_ERR;
+    }
+    return hash_set_insert_hashed(bucket->hset, value, len, hash_set_hash(value, len));
+}
+
+// Number of values currently remembered
+size_t window_set_get_size(window_set *wset) {
+    if (!wset) return 0;
+
+    size_t count = 0;
+    for (size_t i = 0; i < wset->bucket_count; i++) {
+        count += hash_set_get_size(wset->buckets[i].hset) + key_set_get_size(wset->buckets[i].kset);
+    }
+    return count;
+}
+
+// Bytes held by the ring and the sets of its live buckets
+size_t window_set_memory_usage(window_set *wset) {
+    if (!wset) return 0;
+
+    size_t bytes = sizeof(window_set) + wset->bucket_count * sizeof(window_bucket);
+    for (size_t i = 0; i < wset->bucket_count; i++) {
+        bytes += hash_set_memory_usage(wset->buckets[i].hset) + key_set_memory_usage(wset->buckets[i].kset);
+    }
+    return bytes;
+}
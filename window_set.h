@@ -0,0 +1,63 @@
+#ifndef __window_set_h__
+#define __window_set_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "func_status.h"
+#include "datetime_util.h"
+#include "hash_set.h"
+#include "key_set.h"
+
+#define WINDOW_SET_BUCKET_SECONDS   60      // event time per bucket for windows of 10 minutes or more
+#define WINDOW_SET_MIN_BUCKETS      10      // shorter windows are cut into this many buckets
+#define WINDOW_SET_MAX_BUCKETS      1440    // longer windows than a day get longer buckets
+#define WINDOW_SET_MAX_SECONDS      (366LL * 24 * 3600)     // longest window accepted
+
+// One slice of event time, remembered by its own set
+typedef struct window_bucket_struct {
+    hash_set *hset;     // NULL until a value lands in the bucket
+    key_set *kset;
+} window_bucket;
+
+/* Set of the datetime values of the last window_seconds of event time.
+    A value is placed by its own timestamp into a bucket of bucket_seconds,
+    and the buckets form a ring covering the window plus the bucket being
+    filled. The newest timestamp seen so far is the clock: when it moves
+    into a new bucket, the buckets that fall out of the window are dropped
+    whole, which frees a handful of blocks however many values they held,
+    and memory stays at what the window holds however long the stream
+    runs.
+    Every occupied bucket costs an empty set's worth of memory on top of
+    its values, so the ring never has more than WINDOW_SET_MAX_BUCKETS
+    buckets: a day is cut into minutes, a year into buckets of six hours.
+    Since the duplicates of a value share its timestamp, they share its
+    bucket, so an insert touches exactly one set. A value is remembered
+    until the clock passes it by the window, give or take a bucket. A
+    value already older than that can no longer be checked; it is counted
+    as late and reported new, so nothing is lost, only possibly repeated.
+    Strings go into hash sets and packed keys into key sets, as in the
+    other modes.
+*/
+typedef struct window_set_struct {
+    int packed;
+    uint64_t bucket_seconds;
+    size_t bucket_count;        // ring size
+    window_bucket *buckets;
+    uint64_t newest;            // epoch of the newest bucket
+    int started;                // 0 until the first value sets newest
+    size_t late;                // values older than the window
+    size_t expired;             // buckets dropped as the window moved
+} window_set;
+
+// Function declarations
+window_set* window_set_create(int packed, uint64_t window_seconds);
+void window_set_destroy(window_set *wset);
+FunctionStatus window_set_insert_key(window_set *wset, dt_key key);
+FunctionStatus window_set_insert_string(window_set *wset, const char *value, size_t len, dt_key key);
+size_t window_set_get_size(window_set *wset);
+size_t window_set_memory_usage(window_set *wset);
+
+#endif // __window_set_h__